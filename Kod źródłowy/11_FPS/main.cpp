@@ -156,7 +156,7 @@ void ClearColor(float r, float g, float b)
     glViewport(0, 0, window_width, window_height);
 }
 //******************************************************************************
-void FPSCounter(double& fps)
+bool FPSCounter(double& fps)
 {
     static double prev_time = glfwGetTime();
     double actual_time = glfwGetTime();
@@ -174,6 +174,8 @@ void FPSCounter(double& fps)
     }
 
     frames_counter++;
+
+    return frames_counter == 1;
 }
 //******************************************************************************
 int main()
@@ -235,9 +237,11 @@ int main()
     while (RenderingEnabled())
     {
         static double fps = 0;
-        FPSCounter(fps);
-        std::string title = "Game @ FPS: " + std::to_string(fps);
-        glfwSetWindowTitle(window, title.c_str());
+        if (FPSCounter(fps))
+        {
+            std::string title = "Game @ FPS: " + std::to_string(fps);
+            glfwSetWindowTitle(window, title.c_str());
+        }
 
         ClearColor(0.5, 0.5, 0.5);
 
@@ -195,7 +195,7 @@ int LoadTexture(std::string file_name)
     return 0;
 }
 //******************************************************************************
-void FPSCounter(double& fps)
+bool FPSCounter(double& fps)
 {
     static double prev_time = glfwGetTime();
     double actual_time = glfwGetTime();
@@ -213,6 +213,8 @@ void FPSCounter(double& fps)
     }
 
     frames_counter++;
+
+    return frames_counter == 1;
 }
 //******************************************************************************
 int main()
@@ -338,9 +340,11 @@ int main()
     while (RenderingEnabled())
     {
         static double fps = 0;
-        FPSCounter(fps);
-        std::string title = "GL Window @ FPS: " + std::to_string(fps);
-        glfwSetWindowTitle(window, title.c_str());
+        if (FPSCounter(fps))
+        {
+            std::string title = "GL Window @ FPS: " + std::to_string(fps);
+            glfwSetWindowTitle(window, title.c_str());
+        }
 
         ClearColor(0.5, 0.5, 0.5);
 
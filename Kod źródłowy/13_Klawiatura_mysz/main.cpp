@@ -275,7 +275,7 @@ int LoadTexture(std::string file_name)
     return 0;
 }
 //******************************************************************************
-void FPSCounter(double& fps)
+bool FPSCounter(double& fps)
 {
     static double prev_time = glfwGetTime();
     double actual_time = glfwGetTime();
@@ -293,6 +293,8 @@ void FPSCounter(double& fps)
     }
 
     frames_counter++;
+
+    return frames_counter == 1;
 }
 //******************************************************************************
 int main()
@@ -496,9 +498,11 @@ int main()
     while (RenderingEnabled())
     {
         static double fps = 0;
-        FPSCounter(fps);
-        std::string title = "GL Window @ FPS: " + std::to_string(fps);
-        glfwSetWindowTitle(window, title.c_str());
+        if (FPSCounter(fps))
+        {
+            std::string title = "GL Window @ FPS: " + std::to_string(fps);
+            glfwSetWindowTitle(window, title.c_str());
+        }
 
         previous_time = actual_time;
         actual_time = glfwGetTime();
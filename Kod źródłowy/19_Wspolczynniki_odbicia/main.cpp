@@ -15,6 +15,8 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+
+#include "../Wspolne/lighting.h"
 //******************************************************************************
 int window_width;
 int window_height;
@@ -36,6 +38,8 @@ float P2 = 100.0f;
 float FOV = 67.0f;
 float aspect = float(window_width) / float(window_height);
 
+glm::vec3 light_position(5.0, 6.0, 0.0);
+
 double actual_time;
 double previous_time;
 //******************************************************************************
@@ -44,50 +48,16 @@ double GetTimeDelta()
     return actual_time - previous_time;
 }
 //******************************************************************************
-GLint LoadShaders(std::string vertex_shader, std::string fragment_shader)
+// Wartosci wspolne dla wszystkich fragmentow liczone raz na klatke
+void UpdateLightingBuffer(GLuint lighting_buffer)
 {
-    GLuint vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
-
-    std::string vertex_shader_data;
-    std::ifstream vertex_shader_file(vertex_shader.c_str(), std::ios::in);
-    if (vertex_shader_file.is_open())
-    {
-        std::string line;
-        while (std::getline(vertex_shader_file, line))
-            vertex_shader_data += "\n" + line;
-
-        vertex_shader_file.close();
-    }
-
-    std::string fragment_shader_data;
-    std::ifstream fragment_shader_file(fragment_shader.c_str(), std::ios::in);
-    if (fragment_shader_file.is_open())
-    {
-        std::string line;
-        while (std::getline(fragment_shader_file, line))
-            fragment_shader_data += "\n" + line;
+    LightingBlock lighting;
+    lighting.light_position_view = view_matrix * glm::vec4(light_position, 1.0f);
+    lighting.inverse_view_matrix = glm::inverse(view_matrix);
 
-        fragment_shader_file.close();
-   }
-
-   const char* vertex_ptr = vertex_shader_data.c_str();
-   const char* fragment_ptr = fragment_shader_data.c_str();
-   glShaderSource(vertex_shader_id, 1, &vertex_ptr, NULL);
-   glShaderSource(fragment_shader_id, 1, &fragment_ptr, NULL);
-
-   glCompileShader(vertex_shader_id);
-   glCompileShader(fragment_shader_id);
-
-   GLuint shader_programme = glCreateProgram();
-   glAttachShader(shader_programme, vertex_shader_id);
-   glAttachShader(shader_programme, fragment_shader_id);
-   glLinkProgram(shader_programme);
-
-   glDeleteShader(vertex_shader_id);
-   glDeleteShader(fragment_shader_id);
-
-   return shader_programme;
+    glBindBuffer(GL_UNIFORM_BUFFER, lighting_buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(lighting), &lighting);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 //******************************************************************************
 void ErrorCallback(int /*error*/, const char* description)
@@ -284,7 +254,7 @@ int LoadTexture(std::string file_name, GLuint& texture_handle)
     return 0;
 }
 //******************************************************************************
-void FPSCounter(double& fps)
+bool FPSCounter(double& fps)
 {
     static double prev_time = glfwGetTime();
     double actual_time = glfwGetTime();
@@ -302,6 +272,8 @@ void FPSCounter(double& fps)
     }
 
     frames_counter++;
+
+    return frames_counter == 1;
 }
 //******************************************************************************
 int LoadSceneFromFile(std::string file_name, GLuint& vao,
@@ -436,8 +408,9 @@ int main()
                       starting_vertex, textures);
 
     // Zaladowanie shaderow i pobranie lokalizacji zmiennych uniform
-    GLuint shaders = LoadShaders("vertex_shader.glsl", "fragment_shader.glsl");
+    GLuint shaders = GetShaderPermutation(SHADER_FEATURE_SPECULAR_MAP);
     ActivateShaderProgram(shaders);
+    GLuint lighting_buffer = CreateLightingBuffer();
 
     GLint texture_slot = glGetUniformLocation(shaders, "basic_texture");
     glUniform1i(texture_slot, 0);
@@ -490,9 +463,11 @@ int main()
     while (RenderingEnabled())
     {
         static double fps = 0;
-        FPSCounter(fps);
-        std::string title = "GL Window @ FPS: " + std::to_string(fps);
-        glfwSetWindowTitle(window, title.c_str());
+        if (FPSCounter(fps))
+        {
+            std::string title = "GL Window @ FPS: " + std::to_string(fps);
+            glfwSetWindowTitle(window, title.c_str());
+        }
 
         previous_time = actual_time;
         actual_time = glfwGetTime();
@@ -500,6 +475,7 @@ int main()
         ClearColor(0.5, 0.5, 0.5);
 
         // Wyslanie perspektywy i kamery do programu shadera
+        UpdateLightingBuffer(lighting_buffer);
         glUniformMatrix4fv(view_uniform, 1, GL_FALSE, glm::value_ptr(view_matrix));
         glUniformMatrix4fv(perspective_uniform, 1, GL_FALSE, glm::value_ptr(perspective));
 
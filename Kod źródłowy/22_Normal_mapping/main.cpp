@@ -480,7 +480,7 @@ int loadTexture(std::string file_name, GLuint& texture_handle)
     return 0;
 }
 //******************************************************************************
-void FPSCounter(double& fps)
+bool FPSCounter(double& fps)
 {
     static double prev_time = glfwGetTime();
     double actual_time = glfwGetTime();
@@ -498,6 +498,8 @@ void FPSCounter(double& fps)
     }
 
     frames_counter++;
+
+    return frames_counter == 1;
 }
 //******************************************************************************
 int loadSceneFromFile(std::string file_name, std::vector<Mesh*>& mesh_handle)
@@ -773,9 +775,11 @@ int main()
     while (renderingEnabled())
     {
         static double fps = 0;
-        FPSCounter(fps);
-        std::string title = "GL Window @ FPS: " + std::to_string(fps);
-        glfwSetWindowTitle(window_handle, title.c_str());
+        if (FPSCounter(fps))
+        {
+            std::string title = "GL Window @ FPS: " + std::to_string(fps);
+            glfwSetWindowTitle(window_handle, title.c_str());
+        }
 
         updateTimer();
 
@@ -521,7 +521,7 @@ int loadTexture2D(GLuint& texture_handle, Texture texture)
     return 0;
 }
 //******************************************************************************
-void FPSCounter(double& fps)
+bool FPSCounter(double& fps)
 {
     static double prev_time = glfwGetTime();
     double actual_time = glfwGetTime();
@@ -539,6 +539,8 @@ void FPSCounter(double& fps)
     }
 
     frames_counter++;
+
+    return frames_counter == 1;
 }
 //******************************************************************************
 int loadSceneFromFile(std::string file_name, std::vector<Mesh*>& mesh_handle)
@@ -1019,9 +1021,11 @@ int main()
     while (renderingEnabled())
     {
         static double fps = 0;
-        FPSCounter(fps);
-        std::string title = "GL Window @ FPS: " + std::to_string(fps);
-        glfwSetWindowTitle(window_handle, title.c_str());
+        if (FPSCounter(fps))
+        {
+            std::string title = "GL Window @ FPS: " + std::to_string(fps);
+            glfwSetWindowTitle(window_handle, title.c_str());
+        }
 
         updateTimer();
 
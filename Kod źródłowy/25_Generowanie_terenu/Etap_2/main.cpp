@@ -20,11 +20,24 @@
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
 #include <string>
+#include <thread>
 #include <vector>
+
+#include "../../Wspolne/job_system.h"
 //******************************************************************************
 GLFWwindow *window_handle = nullptr;
 int window_width = 0;
@@ -69,6 +82,80 @@ struct Texture
 };
 
 typedef std::vector<Mesh*> MeshHandle;
+
+// Reference for the job system benchmark, one locked queue shared by all
+// threads and a blocking wait
+class NaiveThreadPool
+{
+public:
+    explicit NaiveThreadPool(unsigned int threads_count)
+    {
+        for (unsigned int i = 0; i < std::max(threads_count, 1u); i++)
+            workers_.emplace_back([this] { workerLoop(); });
+    }
+
+    ~NaiveThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+
+        for (auto &worker : workers_)
+            worker.join();
+    }
+
+    void submit(std::function<void()> function)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push(function);
+            unfinished_tasks_++;
+        }
+        wake_.notify_one();
+    }
+
+    void waitAll()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return unfinished_tasks_ == 0; });
+    }
+
+protected:
+    void workerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> function;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+                if (stop_)
+                    return;
+
+                function = std::move(tasks_.front());
+                tasks_.pop();
+            }
+
+            function();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--unfinished_tasks_ == 0)
+                done_.notify_all();
+        }
+    }
+
+protected:
+    bool stop_{false};
+    unsigned int unfinished_tasks_{0};
+    std::condition_variable done_;
+    std::mutex mutex_;
+    std::queue<std::function<void()>> tasks_;
+    std::condition_variable wake_;
+    std::vector<std::thread> workers_;
+
+};
 //******************************************************************************
 double getTimeDelta()
 {
@@ -521,7 +608,7 @@ int loadTexture2D(GLuint& texture_handle, Texture texture)
     return 0;
 }
 //******************************************************************************
-void FPSCounter(double& fps)
+bool FPSCounter(double& fps)
 {
     static double prev_time = glfwGetTime();
     double actual_time = glfwGetTime();
@@ -539,9 +626,12 @@ void FPSCounter(double& fps)
     }
 
     frames_counter++;
+
+    return frames_counter == 1;
 }
 //******************************************************************************
-int loadSceneFromFile(std::string file_name, std::vector<Mesh*>& mesh_handle)
+int loadSceneFromFile(JobSystem &jobs, std::string file_name,
+                      std::vector<Mesh*>& mesh_handle)
 {
     const aiScene* scene = aiImportFile(file_name.c_str(),
                                         aiProcessPreset_TargetRealtime_Fast);
@@ -551,111 +641,174 @@ int loadSceneFromFile(std::string file_name, std::vector<Mesh*>& mesh_handle)
         return -1;
     }
 
-    std::vector<Mesh*> complete_mesh;
-
-    for (unsigned int m = 0; m != scene->mNumMeshes; m++)
+    // Vertex streams and textures of every mesh are prepared on the job system,
+    // only the uploads stay on the GL thread
+    struct MeshData
     {
-        aiMesh *mesh = scene->mMeshes[m];
-
-        Mesh *mesh_entity = new Mesh();
         std::vector<GLfloat> position_container;
         std::vector<GLfloat> normal_vector_container;
         std::vector<GLfloat> texture_coord_container;
         std::vector<GLfloat> tangent_container;
         std::vector<GLfloat> bitangent_container;
+        std::string texture_files[2];
+        Texture textures[2];
+        int texture_results[2] = { -1, -1 };
+    };
 
-        for (unsigned int f = 0; f != mesh->mNumFaces; f++)
-        {
-            const aiFace *face = &mesh->mFaces[f];
+    std::vector<MeshData> meshes_data(scene->mNumMeshes);
+    std::vector<JobSystem::Job> loading_jobs;
 
-            for (unsigned int v = 0; v != 3; v++)
+    for (unsigned int m = 0; m != scene->mNumMeshes; m++)
+    {
+        aiMesh *mesh = scene->mMeshes[m];
+        MeshData &data = meshes_data[m];
+
+        unsigned int vertices_count = mesh->mNumFaces * 3;
+        data.position_container.resize(vertices_count * 3);
+        data.normal_vector_container.resize(vertices_count * 3);
+        data.texture_coord_container.resize(vertices_count * 2);
+        data.tangent_container.resize(vertices_count * 3);
+        data.bitangent_container.resize(vertices_count * 3);
+
+        // Every face writes its own three vertices
+        loading_jobs.push_back(jobs.parallelFor(0, mesh->mNumFaces, 1024,
+                                                [mesh, &data](int first, int last)
+        {
+            for (int f = first; f != last; f++)
             {
-                aiVector3D position{ 0, 0, 0 };
-                aiVector3D normal_vector{ 0, 0, 0 };
-                aiVector3D texture_coords{ 0, 0, 0 };
-                aiVector3D tangent{ 0, 0, 0 };
-                aiVector3D bitangent{ 0, 0, 0 };
+                const aiFace *face = &mesh->mFaces[f];
 
-                if (mesh->HasPositions())
-                    position = mesh->mVertices[face->mIndices[v]];
+                for (unsigned int v = 0; v != 3; v++)
+                {
+                    aiVector3D position{ 0, 0, 0 };
+                    aiVector3D normal_vector{ 0, 0, 0 };
+                    aiVector3D texture_coords{ 0, 0, 0 };
+                    aiVector3D tangent{ 0, 0, 0 };
+                    aiVector3D bitangent{ 0, 0, 0 };
 
-                if (mesh->HasNormals())
-                    normal_vector = mesh->mNormals[face->mIndices[v]];
+                    if (mesh->HasPositions())
+                        position = mesh->mVertices[face->mIndices[v]];
 
-                if (mesh->HasTextureCoords(0))
-                    texture_coords = mesh->mTextureCoords[0][face->mIndices[v]];
+                    if (mesh->HasNormals())
+                        normal_vector = mesh->mNormals[face->mIndices[v]];
 
-                if (mesh->HasTangentsAndBitangents())
-                {
-                    tangent = mesh->mTangents[face->mIndices[v]];
-                    bitangent = mesh->mBitangents[face->mIndices[v]];
-                }
+                    if (mesh->HasTextureCoords(0))
+                        texture_coords = mesh->mTextureCoords[0][face->mIndices[v]];
+
+                    if (mesh->HasTangentsAndBitangents())
+                    {
+                        tangent = mesh->mTangents[face->mIndices[v]];
+                        bitangent = mesh->mBitangents[face->mIndices[v]];
+                    }
 
-                position_container.push_back(position.x);
-                position_container.push_back(position.y);
-                position_container.push_back(position.z);
+                    std::size_t vertex = f * 3 + v;
 
-                normal_vector_container.push_back(normal_vector.x);
-                normal_vector_container.push_back(normal_vector.y);
-                normal_vector_container.push_back(normal_vector.z);
+                    data.position_container[vertex * 3] = position.x;
+                    data.position_container[vertex * 3 + 1] = position.y;
+                    data.position_container[vertex * 3 + 2] = position.z;
 
-                texture_coord_container.push_back(texture_coords.x);
-                texture_coord_container.push_back(texture_coords.y);
+                    data.normal_vector_container[vertex * 3] = normal_vector.x;
+                    data.normal_vector_container[vertex * 3 + 1] = normal_vector.y;
+                    data.normal_vector_container[vertex * 3 + 2] = normal_vector.z;
 
-                glm::vec3 n(normal_vector.x, normal_vector.y,
-                            normal_vector.z);
-                glm::vec3 t(tangent.x, tangent.y, tangent.z);
-                glm::vec3 b(bitangent.x, bitangent.y, bitangent.z);
+                    data.texture_coord_container[vertex * 2] = texture_coords.x;
+                    data.texture_coord_container[vertex * 2 + 1] = texture_coords.y;
 
-                glm::vec3 tangent_corrected = glm::normalize(t - n * glm::dot(n, t));
+                    glm::vec3 n(normal_vector.x, normal_vector.y,
+                                normal_vector.z);
+                    glm::vec3 t(tangent.x, tangent.y, tangent.z);
+                    glm::vec3 b(bitangent.x, bitangent.y, bitangent.z);
 
-                float det = glm::dot(glm::cross(n, t), b);
-                if (det < 0.0f)
-                    det = -1.0f;
-                else
-                    det = 1.0f;
+                    glm::vec3 tangent_corrected = glm::normalize(t - n * glm::dot(n, t));
 
-                glm::vec3 bitangent_corrected = glm::cross(n, tangent_corrected) * det;
+                    float det = glm::dot(glm::cross(n, t), b);
+                    if (det < 0.0f)
+                        det = -1.0f;
+                    else
+                        det = 1.0f;
 
-                tangent_container.push_back(tangent_corrected.x);
-                tangent_container.push_back(tangent_corrected.y);
-                tangent_container.push_back(tangent_corrected.z);
+                    glm::vec3 bitangent_corrected = glm::cross(n, tangent_corrected) * det;
 
-                bitangent_container.push_back(bitangent_corrected.x);
-                bitangent_container.push_back(bitangent_corrected.y);
-                bitangent_container.push_back(bitangent_corrected.z);
+                    data.tangent_container[vertex * 3] = tangent_corrected.x;
+                    data.tangent_container[vertex * 3 + 1] = tangent_corrected.y;
+                    data.tangent_container[vertex * 3 + 2] = tangent_corrected.z;
+
+                    data.bitangent_container[vertex * 3] = bitangent_corrected.x;
+                    data.bitangent_container[vertex * 3 + 1] = bitangent_corrected.y;
+                    data.bitangent_container[vertex * 3 + 2] = bitangent_corrected.z;
+                }
             }
+        }));
+
+        if (scene->mNumMaterials == 0)
+            continue;
+
+        // Diffuse texture and normal map are decoded next to the geometry
+        const aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+        const aiTextureType texture_types[2] = { aiTextureType_DIFFUSE,
+                                                 aiTextureType_HEIGHT };
+
+        for (int i = 0; i < 2; i++)
+        {
+            aiString texture_path;
+            if (material->GetTexture(texture_types[i], 0, &texture_path) !=
+                AI_SUCCESS)
+                continue;
+
+            unsigned int found_pos = file_name.find_last_of("/\\");
+            std::string path = file_name.substr(0, found_pos);
+            std::string name(texture_path.C_Str());
+            if (name[0] == '/')
+                name.erase(0, 1);
+
+            data.texture_files[i] = path + "/" + name;
+
+            loading_jobs.push_back(jobs.submit([&data, i]
+            {
+                data.texture_results[i] = loadTexture(data.texture_files[i],
+                                                      data.textures[i]);
+            }));
         }
+    }
+
+    for (auto &job : loading_jobs)
+        jobs.wait(job);
+
+    std::vector<Mesh*> complete_mesh;
+
+    for (auto &data : meshes_data)
+    {
+        Mesh *mesh_entity = new Mesh();
 
         GLuint position_vbo = 0;
         glGenBuffers(1, &position_vbo);
         glBindBuffer(GL_ARRAY_BUFFER, position_vbo);
-        glBufferData(GL_ARRAY_BUFFER, position_container.size() * sizeof(GLfloat),
-                     position_container.data(), GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, data.position_container.size() * sizeof(GLfloat),
+                     data.position_container.data(), GL_STATIC_DRAW);
 
         GLuint normal_vector_vbo = 0;
         glGenBuffers(1, &normal_vector_vbo);
         glBindBuffer(GL_ARRAY_BUFFER, normal_vector_vbo);
-        glBufferData(GL_ARRAY_BUFFER, normal_vector_container.size() * sizeof(GLfloat),
-                     normal_vector_container.data(), GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, data.normal_vector_container.size() * sizeof(GLfloat),
+                     data.normal_vector_container.data(), GL_STATIC_DRAW);
 
         GLuint texture_coord_vbo = 0;
         glGenBuffers(1, &texture_coord_vbo);
         glBindBuffer(GL_ARRAY_BUFFER, texture_coord_vbo);
-        glBufferData(GL_ARRAY_BUFFER, texture_coord_container.size() * sizeof(GLfloat),
-                     texture_coord_container.data(), GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, data.texture_coord_container.size() * sizeof(GLfloat),
+                     data.texture_coord_container.data(), GL_STATIC_DRAW);
 
         GLuint tangent_vbo = 0;
         glGenBuffers(1, &tangent_vbo);
         glBindBuffer(GL_ARRAY_BUFFER, tangent_vbo);
-        glBufferData(GL_ARRAY_BUFFER, tangent_container.size() * sizeof(GLfloat),
-                     tangent_container.data(), GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, data.tangent_container.size() * sizeof(GLfloat),
+                     data.tangent_container.data(), GL_STATIC_DRAW);
 
         GLuint bitangent_vbo = 0;
         glGenBuffers(1, &bitangent_vbo);
         glBindBuffer(GL_ARRAY_BUFFER, bitangent_vbo);
-        glBufferData(GL_ARRAY_BUFFER, bitangent_container.size() * sizeof(GLfloat),
-                     bitangent_container.data(), GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, data.bitangent_container.size() * sizeof(GLfloat),
+                     data.bitangent_container.data(), GL_STATIC_DRAW);
 
         glGenVertexArrays(1, &mesh_entity->handle);
         glBindVertexArray(mesh_entity->handle);
@@ -677,66 +830,28 @@ int loadSceneFromFile(std::string file_name, std::vector<Mesh*>& mesh_handle)
 
         glBindVertexArray(0);
 
-        mesh_entity->vertices_count = position_container.size();
+        mesh_entity->vertices_count = data.position_container.size();
 
-        if (scene->mNumMaterials != 0)
+        GLuint texture_handles[2] = { 0, 0 };
+        for (int i = 0; i < 2; i++)
         {
-            const aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+            if (data.texture_files[i].empty())
+                continue;
 
-            aiString texture_path;
-
-            GLuint texture_diffuse = 0;
-            if (material->GetTexture(aiTextureType_DIFFUSE, 0, &texture_path) ==
-                AI_SUCCESS)
-            {
-                unsigned int found_pos = file_name.find_last_of("/\\");
-                std::string path = file_name.substr(0, found_pos);
-                std::string name(texture_path.C_Str());
-                if (name[0] == '/')
-                    name.erase(0, 1);
-
-                std::string file_path = path + "/" + name;
-
-                Texture tex;
-                if (loadTexture(file_path, tex))
-                    std::cout << "Texture \"" << file_path << "\" not found." <<
+            if (data.texture_results[i])
+                std::cout << "Texture \"" << data.texture_files[i] << "\" not found." <<
                     std::endl;
-                else
-                {
-                    loadTexture2D(texture_diffuse, tex);
-                    std::cout << "Texture \"" << file_path << "\" loaded." <<
-                        std::endl;
-                }
-            }
-
-            GLuint texture_normalmap = 0;
-            if (material->GetTexture(aiTextureType_HEIGHT, 0, &texture_path) ==
-                AI_SUCCESS)
+            else
             {
-                unsigned int found_pos = file_name.find_last_of("/\\");
-                std::string path = file_name.substr(0, found_pos);
-                std::string name(texture_path.C_Str());
-                if (name[0] == '/')
-                    name.erase(0, 1);
-
-                std::string file_path = path + "/" + name;
-
-                Texture tex;
-                if (loadTexture(file_path, tex))
-                    std::cout << "Texture \"" << file_path << "\" not found." <<
+                loadTexture2D(texture_handles[i], data.textures[i]);
+                std::cout << "Texture \"" << data.texture_files[i] << "\" loaded." <<
                     std::endl;
-                else
-                {
-                    loadTexture2D(texture_normalmap, tex);
-                    std::cout << "Texture \"" << file_path << "\" loaded." <<
-                        std::endl;
-                }
             }
-
-            mesh_entity->diffuse_texture = texture_diffuse;
-            mesh_entity->normalmap_texture = texture_normalmap;
         }
 
+        mesh_entity->diffuse_texture = texture_handles[0];
+        mesh_entity->normalmap_texture = texture_handles[1];
+
         complete_mesh.push_back(mesh_entity);
     }
 
@@ -781,26 +896,202 @@ void drawMesh(const MeshHandle& mesh)
     }
 }
 //******************************************************************************
-void loadSkybox(std::string front, std::string back, std::string left,
-                std::string right, std::string up, std::string down,
-                GLuint &texture_handle)
+int hashFile(std::string file_name, std::uint64_t &hash)
+{
+    std::ifstream file(file_name, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+        return -1;
+
+    // FNV-1a
+    std::vector<char> buffer(64 * 1024);
+    while (file)
+    {
+        file.read(buffer.data(), buffer.size());
+        for (std::streamsize i = 0; i < file.gcount(); i++)
+        {
+            hash ^= static_cast<unsigned char>(buffer[i]);
+            hash *= 1099511628211ull;
+        }
+    }
+
+    return 0;
+}
+//******************************************************************************
+int loadCubemap(std::string file_name, std::uint64_t source_hash)
+{
+    std::ifstream cache_file(file_name, std::ios::in | std::ios::binary);
+    if (!cache_file.is_open())
+        return -1;
+
+    char magic[4] = { 0, 0, 0, 0 };
+    std::uint64_t stored_hash = 0;
+    std::uint32_t levels_count = 0;
+
+    cache_file.read(magic, sizeof(magic));
+    cache_file.read(reinterpret_cast<char*>(&stored_hash), sizeof(stored_hash));
+    cache_file.read(reinterpret_cast<char*>(&levels_count),
+                    sizeof(levels_count));
+
+    if (!cache_file || std::string(magic, 4) != "CUB1" ||
+        stored_hash != source_hash || levels_count == 0 || levels_count > 32)
+        return -1;
+
+    std::vector<std::uint32_t> level_sizes(levels_count * 2);
+    cache_file.read(reinterpret_cast<char*>(level_sizes.data()),
+                    level_sizes.size() * sizeof(std::uint32_t));
+    if (!cache_file)
+        return -1;
+
+    std::size_t face_size = 0;
+    for (unsigned int l = 0; l < levels_count; l++)
+        face_size += ((level_sizes[l * 2] * 3 + 3) & ~3u) * level_sizes[l * 2 + 1];
+
+    // All faces come with a single read, levels are uploaded straight from it
+    std::vector<BYTE> bits(face_size * 6);
+    cache_file.read(reinterpret_cast<char*>(bits.data()), bits.size());
+    if (!cache_file)
+        return -1;
+
+    const BYTE *level_bits = bits.data();
+    for (int i = 0; i < 6; i++)
+    {
+        for (unsigned int l = 0; l < levels_count; l++)
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, l, GL_RGB,
+                         level_sizes[l * 2], level_sizes[l * 2 + 1], 0,
+                         GL_BGR, GL_UNSIGNED_BYTE, level_bits);
+
+            level_bits += ((level_sizes[l * 2] * 3 + 3) & ~3u) *
+                          level_sizes[l * 2 + 1];
+        }
+    }
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels_count - 1);
+
+    return 0;
+}
+//******************************************************************************
+int saveCubemap(std::string file_name, std::uint64_t source_hash)
+{
+    std::ofstream cache_file(file_name, std::ios::out | std::ios::binary);
+    if (!cache_file.is_open())
+        return -1;
+
+    GLint width = 0;
+    GLint height = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0,
+                             GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0,
+                             GL_TEXTURE_HEIGHT, &height);
+
+    std::vector<std::uint32_t> level_sizes;
+    for (GLint l = 0; (width >> l) > 0 || (height >> l) > 0; l++)
+    {
+        level_sizes.push_back(std::max(width >> l, 1));
+        level_sizes.push_back(std::max(height >> l, 1));
+    }
+
+    std::uint32_t levels_count = level_sizes.size() / 2;
+
+    cache_file.write("CUB1", 4);
+    cache_file.write(reinterpret_cast<const char*>(&source_hash),
+                     sizeof(source_hash));
+    cache_file.write(reinterpret_cast<const char*>(&levels_count),
+                     sizeof(levels_count));
+    cache_file.write(reinterpret_cast<const char*>(level_sizes.data()),
+                     level_sizes.size() * sizeof(std::uint32_t));
+
+    // Mipmaps generated by the driver are read back, rows are 4 byte aligned
+    std::vector<BYTE> bits;
+    for (int i = 0; i < 6; i++)
+    {
+        for (unsigned int l = 0; l < levels_count; l++)
+        {
+            bits.resize(((level_sizes[l * 2] * 3 + 3) & ~3u) *
+                        level_sizes[l * 2 + 1]);
+            glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, l, GL_BGR,
+                          GL_UNSIGNED_BYTE, bits.data());
+            cache_file.write(reinterpret_cast<const char*>(bits.data()),
+                             bits.size());
+        }
+    }
+
+    if (!cache_file)
+        return -1;
+
+    return 0;
+}
+//******************************************************************************
+void loadSkybox(JobSystem &jobs, std::string front, std::string back,
+                std::string left, std::string right, std::string up,
+                std::string down, GLuint &texture_handle)
 {
     glGenTextures(1, &texture_handle);
     glBindTexture(GL_TEXTURE_CUBE_MAP, texture_handle);
 
     std::string textures[] = { right, left, down, up, back, front };
 
+    // Whole cubemap with mips is cached in one file, keyed by all six faces
+    std::uint64_t source_hash = 14695981039346656037ull;
     for (int i = 0; i < 6; i++)
+        hashFile(textures[i], source_hash);
+
+    std::string cache_file_name = front.substr(0, front.find_last_of('_')) +
+                                  ".cube";
+
+    GLint unpack_alignment = 0;
+    GLint pack_alignment = 0;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_alignment);
+    glGetIntegerv(GL_PACK_ALIGNMENT, &pack_alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    if (loadCubemap(cache_file_name, source_hash) == 0)
+        std::cout << "Skybox loaded from \"" << cache_file_name << "\"." <<
+            std::endl;
+    else
     {
-        Texture texture;
-        loadTexture(textures[i], texture);
+        // One decoding task per face
+        Texture faces[6];
+        int results[6];
+
+        jobs.wait(jobs.parallelFor(0, 6, 1, [&textures, &faces, &results](int i, int)
+        {
+            results[i] = loadTexture(textures[i], faces[i]);
+        }));
+
+        bool faces_loaded = true;
+        for (int i = 0; i < 6; i++)
+        {
+            if (results[i])
+            {
+                faces_loaded = false;
+                continue;
+            }
 
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, texture.width,
-                     texture.height, 0, GL_BGR, GL_UNSIGNED_BYTE, texture.bits);
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB,
+                         faces[i].width, faces[i].height, 0, GL_BGR,
+                         GL_UNSIGNED_BYTE, faces[i].bits);
+
+            FreeImage_Unload(faces[i].image_ptr);
+        }
+
+        if (faces_loaded)
+        {
+            glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+
+            if (saveCubemap(cache_file_name, source_hash))
+                std::cout << "Unable to write cubemap cache \"" <<
+                    cache_file_name << "\"." << std::endl;
+        }
     }
 
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, pack_alignment);
+
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -826,79 +1117,120 @@ float calculateHeight(Texture *texture, int x, int y)
     return height;
 }
 //******************************************************************************
-glm::vec3 calculateNormal(Texture *texture, int x, int z)
+glm::vec3 calculateNormal(const std::vector<float> &heights, int size, int x,
+                          int z)
 {
-    float hL = calculateHeight(texture, x - 1, z);
-    float hR = calculateHeight(texture, x + 1, z);
-    float hD = calculateHeight(texture, x, z - 1);
-    float hU = calculateHeight(texture, x, z + 1);
+    // Border vertices reuse their own height for the missing neighbour
+    auto height = [&heights, size](int x, int z)
+    {
+        x = std::min(std::max(x, 0), size - 1);
+        z = std::min(std::max(z, 0), size - 1);
+        return heights[z * size + x];
+    };
+
+    float hL = height(x - 1, z);
+    float hR = height(x + 1, z);
+    float hD = height(x, z - 1);
+    float hU = height(x, z + 1);
 
     glm::vec3 new_normal_vector = glm::vec3(hL - hR, 2.0, hD - hU);
     glm::normalize(new_normal_vector);
     return new_normal_vector;
 }
 //******************************************************************************
-GLuint generateTerrain(std::string height_map, unsigned short cell_size, int &elements, int &cells)
+GLuint generateTerrain(JobSystem &jobs, std::string height_map,
+                       unsigned short cell_size, int &elements, int &cells)
 {
+    auto start_time = std::chrono::steady_clock::now();
+
     Texture height_map_tex;
-    loadTexture(height_map, height_map_tex);
+    if (loadTexture(height_map, height_map_tex))
+        return 0;
 
     int vertices_count = height_map_tex.width;
 
-    std::vector<float> positions;
-    std::vector<float> normal_vectors;
-    std::vector<float> texture_coords;
+    std::vector<float> heights(vertices_count * vertices_count);
+    std::vector<float> positions(heights.size() * 3);
+    std::vector<float> normal_vectors(heights.size() * 3);
+    std::vector<float> texture_coords(heights.size() * 2);
 
-    std::vector<int> indices;        
+    std::vector<int> indices((vertices_count - 1) * (vertices_count - 1) * 6);
 
-    for (int w = 0; w < vertices_count; w++)
+    // Rows are independent, normals need the heights of the neighbouring rows
+    JobSystem::Job heights_job = jobs.parallelFor(0, vertices_count, 16,
+                                                  [&](int first, int last)
     {
-        for (int k = 0; k < vertices_count; k++)
+        for (int w = first; w < last; w++)
         {
-            float vertex_x = k * cell_size;
-            float vertex_y = calculateHeight(&height_map_tex, k, w);
-            float vertex_z = w * cell_size;
-
-            positions.push_back(vertex_x);
-            positions.push_back(vertex_y);
-            positions.push_back(vertex_z);
+            for (int k = 0; k < vertices_count; k++)
+            {
+                int vertex = w * vertices_count + k;
+                heights[vertex] = calculateHeight(&height_map_tex, k, w);
 
-            auto normal = calculateNormal(&height_map_tex, k, w);
+                positions[vertex * 3] = k * cell_size;
+                positions[vertex * 3 + 1] = heights[vertex];
+                positions[vertex * 3 + 2] = w * cell_size;
 
-            float vector_x = normal.x;
-            float vector_y = normal.y;
-            float vector_z = normal.z;
+                float s = (1.0 / (vertices_count - 1)) * k;
+                float t = (1.0 / (vertices_count - 1)) * w;
 
-            normal_vectors.push_back(vector_x);
-            normal_vectors.push_back(vector_y);
-            normal_vectors.push_back(vector_z);
+                texture_coords[vertex * 2] = s;
+                texture_coords[vertex * 2 + 1] = t;
+            }
+        }
+    });
 
-            float s = (1.0 / (vertices_count - 1)) * k;
-            float t = (1.0 / (vertices_count - 1)) * w;
+    JobSystem::Job normals_job = jobs.parallelFor(0, vertices_count, 16,
+                                                  [&](int first, int last)
+    {
+        for (int w = first; w < last; w++)
+        {
+            for (int k = 0; k < vertices_count; k++)
+            {
+                int vertex = w * vertices_count + k;
+                auto normal = calculateNormal(heights, vertices_count, k, w);
 
-            texture_coords.push_back(s);
-            texture_coords.push_back(t);
+                normal_vectors[vertex * 3] = normal.x;
+                normal_vectors[vertex * 3 + 1] = normal.y;
+                normal_vectors[vertex * 3 + 2] = normal.z;
+            }
         }
-    }
+    }, { heights_job });
 
-    for (int w = 0; w < vertices_count - 1; w++)
+    JobSystem::Job indices_job = jobs.parallelFor(0, vertices_count - 1, 16,
+                                                  [&](int first, int last)
     {
-        for (int k = 0; k < vertices_count - 1; k++)
+        for (int w = first; w < last; w++)
         {
-            int index_1 = w * vertices_count + k;
-            int index_2 = index_1 + 1;
-            int index_3 = (w + 1) * vertices_count + k;
-            int index_4 = index_3 + 1;
-
-            indices.push_back(index_1);
-            indices.push_back(index_3);
-            indices.push_back(index_2);
-
-            indices.push_back(index_2);
-            indices.push_back(index_3);
-            indices.push_back(index_4);
+            for (int k = 0; k < vertices_count - 1; k++)
+            {
+                int index_1 = w * vertices_count + k;
+                int index_2 = index_1 + 1;
+                int index_3 = (w + 1) * vertices_count + k;
+                int index_4 = index_3 + 1;
+
+                int *cell_indices = &indices[(w * (vertices_count - 1) + k) * 6];
+
+                cell_indices[0] = index_1;
+                cell_indices[1] = index_3;
+                cell_indices[2] = index_2;
+
+                cell_indices[3] = index_2;
+                cell_indices[4] = index_3;
+                cell_indices[5] = index_4;
+            }
         }
-    }
+    });
+
+    jobs.wait(normals_job);
+    jobs.wait(indices_job);
+
+    FreeImage_Unload(height_map_tex.image_ptr);
+
+    std::cout << "Terrain " << vertices_count << "x" << vertices_count <<
+        " generated in " << std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start_time).count() << " ms." <<
+        std::endl;
 
     GLuint position_vbo = 0;
     glGenBuffers(1, &position_vbo);
@@ -946,12 +1278,97 @@ GLuint generateTerrain(std::string height_map, unsigned short cell_size, int &el
     return handle;
 }
 //******************************************************************************
-int main()
+int benchmarkJobSystem()
+{
+    unsigned int threads_count = std::max(std::thread::hardware_concurrency(), 1u);
+    const int repeats = 5;
+
+    // Item cost in square roots, uneven items cost up to 32 times the base
+    std::vector<float> results(1 << 16);
+    auto work = [&results](int first, int last, int cost, bool uneven)
+    {
+        for (int i = first; i < last; i++)
+        {
+            int item_cost = uneven ? cost * (i % 32 + 1) / 16 : cost;
+            float value = static_cast<float>(i);
+            for (int c = 0; c < item_cost; c++)
+                value = std::sqrt(value + 1.0f);
+            results[i % results.size()] = value;
+        }
+    };
+
+    struct BenchmarkCase
+    {
+        const char *name;
+        int items;
+        int grain;
+        int cost;
+        bool uneven;
+    };
+
+    const BenchmarkCase cases[] = {
+        { "small tasks", 200000, 1, 16, false },
+        { "chunked", 1 << 22, 16384, 8, false },
+        { "uneven", 65536, 64, 200, true },
+    };
+
+    NaiveThreadPool naive_pool(threads_count);
+    JobSystem jobs(threads_count);
+
+    std::cout << "Job system benchmark, " << threads_count << " threads:" <<
+        std::endl;
+
+    for (const auto &test : cases)
+    {
+        double naive_time = 0.0;
+        double jobs_time = 0.0;
+
+        for (int r = 0; r < repeats; r++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (int first = 0; first < test.items; first += test.grain)
+            {
+                int last = std::min(first + test.grain, test.items);
+                naive_pool.submit([&work, &test, first, last]
+                {
+                    work(first, last, test.cost, test.uneven);
+                });
+            }
+            naive_pool.waitAll();
+            auto end = std::chrono::steady_clock::now();
+            naive_time += std::chrono::duration<double, std::milli>(end - start).count();
+
+            start = std::chrono::steady_clock::now();
+            jobs.wait(jobs.parallelFor(0, test.items, test.grain,
+                                       [&work, &test](int first, int last)
+            {
+                work(first, last, test.cost, test.uneven);
+            }));
+            end = std::chrono::steady_clock::now();
+            jobs_time += std::chrono::duration<double, std::milli>(end - start).count();
+        }
+
+        std::cout << "  " << test.name << ": naive pool " <<
+            naive_time / repeats << " ms, job system " << jobs_time / repeats <<
+            " ms" << std::endl;
+    }
+
+    return 0;
+}
+//******************************************************************************
+int main(int argc, char *argv[])
 {
+    // Job system against a single queue thread pool, runs without a window
+    if (argc > 1 && std::string(argv[1]) == "--job-benchmark")
+        return benchmarkJobSystem();
+
     int result = createWindow(800, 600, "GL Window", 4, false);
     if (result)
         return -1;
 
+    // Loading work of the GL thread is spread over all cores
+    JobSystem jobs(std::thread::hardware_concurrency());
+
     GLuint shader_program = 0;
     if (createShaderProgram(shader_program, "vertex_shader.glsl",
                             "fragment_shader.glsl"))
@@ -986,11 +1403,20 @@ int main()
     // Load terrain
     int elements = 0;
     int cells = 0;
-    GLuint terrain_handle = generateTerrain("height_map.png", 1, elements, cells);
     Texture grass_texture;
+    int grass_result = -1;
+    JobSystem::Job grass_job = jobs.submit([&grass_texture, &grass_result]
+    {
+        grass_result = loadTexture("Grass.jpg", grass_texture);
+    });
+
+    GLuint terrain_handle = generateTerrain(jobs, "height_map.png", 1, elements,
+                                            cells);
+
+    jobs.wait(grass_job);
     unsigned int grass_tex = 0;
-    loadTexture("Grass.jpg", grass_texture);
-    loadTexture2D(grass_tex, grass_texture);
+    if (grass_result == 0)
+        loadTexture2D(grass_tex, grass_texture);
 
     // Skybox
     GLfloat skybox[] = {
@@ -1048,17 +1474,19 @@ int main()
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
 
     GLuint skybox_texture = 0;
-    loadSkybox("hills_ft.tga", "hills_bk.tga", "hills_lf.tga", "hills_rt.tga",
-               "hills_up.tga", "hills_dn.tga", skybox_texture);
+    loadSkybox(jobs, "hills_ft.tga", "hills_bk.tga", "hills_lf.tga",
+               "hills_rt.tga", "hills_up.tga", "hills_dn.tga", skybox_texture);
 
     enableFaceCulling();
 
     while (renderingEnabled())
     {
         static double fps = 0;
-        FPSCounter(fps);
-        std::string title = "GL Window @ FPS: " + std::to_string(fps);
-        glfwSetWindowTitle(window_handle, title.c_str());
+        if (FPSCounter(fps))
+        {
+            std::string title = "GL Window @ FPS: " + std::to_string(fps);
+            glfwSetWindowTitle(window_handle, title.c_str());
+        }
 
         updateTimer();
 
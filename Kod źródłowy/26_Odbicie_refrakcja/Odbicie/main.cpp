@@ -25,6 +25,8 @@
 #include <iostream>
 #include <string>
 #include <vector>
+
+#include "../../Wspolne/lighting.h"
 //******************************************************************************
 GLFWwindow *window_handle = nullptr;
 int window_width = 0;
@@ -36,6 +38,8 @@ enum class ShaderType
     FRAGMENT_SHADER,
 };
 
+glm::vec3 light_position(5.0, 3.0, 3.0);
+
 double actual_time;
 double previous_time;
 
@@ -404,6 +408,18 @@ int createShaderProgram(GLuint &handle, std::string vertex_shader_file,
     return 0;
 }
 //******************************************************************************
+// Wartosci wspolne dla wszystkich fragmentow liczone raz na klatke
+void updateLightingBuffer(GLuint lighting_buffer)
+{
+    LightingBlock lighting;
+    lighting.light_position_view = view_matrix * glm::vec4(light_position, 1.0f);
+    lighting.inverse_view_matrix = glm::inverse(view_matrix);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, lighting_buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(lighting), &lighting);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+//******************************************************************************
 void enableDepthTesting()
 {
     glEnable(GL_DEPTH_TEST);
@@ -523,7 +539,7 @@ int loadTexture2D(GLuint& texture_handle, Texture texture)
     return 0;
 }
 //******************************************************************************
-void FPSCounter(double& fps)
+bool FPSCounter(double& fps)
 {
     static double prev_time = glfwGetTime();
     double actual_time = glfwGetTime();
@@ -541,6 +557,8 @@ void FPSCounter(double& fps)
     }
 
     frames_counter++;
+
+    return frames_counter == 1;
 }
 //******************************************************************************
 int loadSceneFromFile(std::string file_name, std::vector<Mesh*>& mesh_handle)
@@ -820,11 +838,13 @@ int main()
     if (result)
         return -1;
 
-    GLuint shader_program = 0;
-    if (createShaderProgram(shader_program, "vertex_shader.glsl",
-                            "fragment_shader.glsl"))
+    GLuint shader_program = GetShaderPermutation(SHADER_FEATURE_REFLECTION |
+                                                 SHADER_FEATURE_ALPHA_TEST);
+    if (!shader_program)
         return -1;
 
+    GLuint lighting_buffer = CreateLightingBuffer();
+
     GLuint skybox_shader = 0;
     if (createShaderProgram(skybox_shader, "vertex_shader_skybox.glsl",
                             "fragment_shader_skybox.glsl"))
@@ -915,9 +935,11 @@ int main()
     while (renderingEnabled())
     {
         static double fps = 0;
-        FPSCounter(fps);
-        std::string title = "GL Window @ FPS: " + std::to_string(fps);
-        glfwSetWindowTitle(window_handle, title.c_str());
+        if (FPSCounter(fps))
+        {
+            std::string title = "GL Window @ FPS: " + std::to_string(fps);
+            glfwSetWindowTitle(window_handle, title.c_str());
+        }
 
         updateTimer();
 
@@ -938,6 +960,7 @@ int main()
         glEnable(GL_DEPTH_TEST);
 
         activateShaderProgram(shader_program);
+        updateLightingBuffer(lighting_buffer);
         setUniform(view_uniform, view_matrix);
         setUniform(perspective_uniform, perspective);
         setUniform(model_uniform, model_matrix);
@@ -16,12 +16,16 @@
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <map>
 #include <string>
 #include <vector>
+
+#include "../Wspolne/streaming_buffer.h"
 //******************************************************************************
 // Declarations
 GLFWwindow *window_handle = nullptr;
@@ -68,6 +72,7 @@ struct Texture
 
 typedef std::vector<Mesh*> MeshHandle;
 
+bool FPSCounter(double& fps);
 bool renderingEnabled();
 double getTimeDelta();
 int checkShaderCompileStatus(GLuint shader_handle);
@@ -92,7 +97,6 @@ void closeWindow(GLFWwindow *window);
 void drawMesh(const MeshHandle& mesh);
 void enableDepthTesting(bool state);
 void enableFaceCulling(bool state);
-void FPSCounter(double& fps);
 void freeTextureData(Texture &texture);
 void loadTextureSkybox(std::string front, std::string back, std::string left, std::string right,
                        std::string up, std::string down, GLuint &texture_handle);
@@ -111,13 +115,13 @@ void windowSizeCallback(GLFWwindow *, int width, int height);
 class FontAtlasRenderer
 {
 public:
-    FontAtlasRenderer(std::string font_file_name, int columns, int rows)
+    FontAtlasRenderer(std::string font_file_name, int columns, int rows,
+                      StreamingBuffer &streaming_buffer)
     {
-        // Create objects
+        streaming_buffer_ = &streaming_buffer;
+
+        // Create objects, vertices are sourced from the streaming buffer
         glGenVertexArrays(1, &handle_);
-        
-        glGenBuffers(1, &vertices_vbo_);
-        glGenBuffers(1, &texture_coords_vbo_);        
 
         // Load and store texture
         Texture font_texture;
@@ -138,9 +142,6 @@ public:
 
     ~FontAtlasRenderer()
     {
-        glDeleteBuffers(1, &vertices_vbo_);
-        glDeleteBuffers(1, &texture_coords_vbo_);
-
         glDeleteVertexArrays(1, &handle_);
     }
 
@@ -253,17 +254,20 @@ public:
 
         glBindVertexArray(handle_);
 
-        glBindBuffer(GL_ARRAY_BUFFER, vertices_vbo_);
-        glBufferData(GL_ARRAY_BUFFER, vertices_buffer.size() * sizeof(GLfloat), 
-                     vertices_buffer.data(), GL_STATIC_DRAW);
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-
-        glBindBuffer(GL_ARRAY_BUFFER, texture_coords_vbo_);
-        glBufferData(GL_ARRAY_BUFFER, texture_coords_buffer.size() * sizeof(GLfloat),
-                     texture_coords_buffer.data(), GL_STATIC_DRAW);
-
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+        // Text is rewritten every frame, both streams go to this frame's region. An upload may
+        // move the data to a new buffer, so each pointer is set right after its upload.
+        GLintptr vertices_offset = streaming_buffer_->upload(
+            vertices_buffer.data(), vertices_buffer.size() * sizeof(GLfloat), sizeof(GLfloat));
+        glBindBuffer(GL_ARRAY_BUFFER, streaming_buffer_->getBuffer());
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0,
+                              reinterpret_cast<const void*>(vertices_offset));
+
+        GLintptr texture_coords_offset = streaming_buffer_->upload(
+            texture_coords_buffer.data(), texture_coords_buffer.size() * sizeof(GLfloat),
+            sizeof(GLfloat));
+        glBindBuffer(GL_ARRAY_BUFFER, streaming_buffer_->getBuffer());
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0,
+                              reinterpret_cast<const void*>(texture_coords_offset));
 
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -308,8 +312,7 @@ public:
 protected:
     GLuint font_texture_handle_{0};    
     GLuint handle_{0};
-    GLuint texture_coords_vbo_{0};
-    GLuint vertices_vbo_{0};    
+    StreamingBuffer *streaming_buffer_{nullptr};
     int spacing_horizontal_{3};
     int spacing_vertical_{5};
     std::map<char, int> character_offsets_;
@@ -429,8 +432,11 @@ int main()
     loadSceneFromFile("The City/The City.obj", city);
     glm::mat4 mesh_model_matrix = glm::scale(glm::mat4(1.0f), glm::vec3(0.1, 0.1, 0.1));
 
+    // Text vertices of a frame
+    StreamingBuffer streaming_buffer(64 * 1024);
+
     // Create font renderer   
-    FontAtlasRenderer font_renderer("font_atlas.png", 16, 6);
+    FontAtlasRenderer font_renderer("font_atlas.png", 16, 6, streaming_buffer);
     font_renderer.setAvailableCharacters(" !\"#$%&\'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRST"
                                          "UVWXYZ[\\]^_\'abcdefghijklmnopqrstuvwxyz{|}~");
     font_renderer.setHorizontalSpacing(-15);
@@ -443,11 +449,14 @@ int main()
     while (renderingEnabled())
     {
         static double fps = 0;
-        FPSCounter(fps);
-        std::string title = "GL Window @ FPS: " + std::to_string(fps);
-        glfwSetWindowTitle(window_handle, title.c_str());
+        if (FPSCounter(fps))
+        {
+            std::string title = "GL Window @ FPS: " + std::to_string(fps);
+            glfwSetWindowTitle(window_handle, title.c_str());
+        }
         
         updateTimer();
+        streaming_buffer.beginFrame();
 
         clearColor(0.5, 0.5, 0.5);
 
@@ -1002,7 +1011,7 @@ bool renderingEnabled()
     return true;
 }
 //*************************************************************************************************
-void FPSCounter(double& fps)
+bool FPSCounter(double& fps)
 {
     static double prev_time = glfwGetTime();
     double actual_time = glfwGetTime();
@@ -1018,6 +1027,8 @@ void FPSCounter(double& fps)
     }
 
     frames_counter++;
+
+    return frames_counter == 1;
 }
 //*************************************************************************************************
 void clearColor(float r, float g, float b)
@@ -0,0 +1,266 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Headless benchmark of lesson 28: offscreen context, camera path and JSON report. Included
+// by main.cpp after its declarations.
+#ifndef TEKST_2_BENCHMARK_H
+#define TEKST_2_BENCHMARK_H
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// -DUSE_EGL (Mesa, link with -lEGL) gives the benchmark a surfaceless context, without it
+// the benchmark renders into a hidden window
+#if defined(USE_EGL)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+//******************************************************************************
+// Colour and depth of the headless target, see default_framebuffer
+GLuint headless_renderbuffers[2] = {0, 0};
+#if defined(USE_EGL)
+EGLContext egl_context = EGL_NO_CONTEXT;
+EGLDisplay egl_display = EGL_NO_DISPLAY;
+#endif
+
+// Counters of one headless benchmark frame, GPU pass times stay in the profiler
+struct BenchmarkFrame
+{
+    double draw_list_time = 0.0;
+    double frame_time = 0.0;
+    float overdraw = 0.0f;
+    std::uint64_t triangles = 0;
+    unsigned int draw_calls = 0;
+    unsigned int state_changes = 0;
+    unsigned int uniforms_skipped = 0;
+    unsigned int uniforms_uploaded = 0;
+};
+
+glm::vec3 getCameraSplinePoint(float t);
+int createHeadlessContext(int width, int height);
+int saveBenchmarkReport(std::string file_name, const std::vector<BenchmarkFrame> &frames,
+                        const FrameProfiler &profiler, bool deferred_shading,
+                        DepthOrder depth_order);
+void destroyHeadlessContext();
+//*************************************************************************************************
+int createHeadlessContext(int width, int height)
+{
+#if !defined(USE_EGL)
+    // Without EGL a hidden window only provides the context
+    if (!glfwInit())
+    {
+        std::cout << "GLFW initialization error." << std::endl;
+        return -1;
+    }
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+
+    window_handle = glfwCreateWindow(width, height, "Benchmark", nullptr, nullptr);
+    if (!window_handle)
+    {
+        std::cout << "Error creating hidden benchmark window." << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+
+    glfwMakeContextCurrent(window_handle);
+#else
+    // Mesa surfaceless platform needs no display server, llvmpipe is enough
+    egl_display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY,
+                                        nullptr);
+    if (egl_display == EGL_NO_DISPLAY)
+        egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, nullptr, nullptr))
+    {
+        std::cout << "EGL initialization error." << std::endl;
+        return -1;
+    }
+
+    eglBindAPI(EGL_OPENGL_API);
+
+    const EGLint config_attributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config = nullptr;
+    EGLint configs_count = 0;
+    eglChooseConfig(egl_display, config_attributes, &config, 1, &configs_count);
+
+    const EGLint context_attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    // Without a matching config the context is created config-less (EGL_KHR_no_config_context)
+    egl_context = eglCreateContext(egl_display, configs_count ? config : EGL_NO_CONFIG_KHR,
+                                   EGL_NO_CONTEXT, context_attributes);
+    if (egl_context == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_context))
+    {
+        std::cout << "Error creating EGL context: 0x" << std::hex << eglGetError() << std::dec
+                  << std::endl;
+        return -1;
+    }
+#endif
+
+    // GLEW built for GLX reports the missing X display, the GL entry points are loaded anyway
+    glewExperimental = GL_TRUE;
+    GLenum glew_status = glewInit();
+    if (glew_status != GLEW_OK && glew_status != GLEW_ERROR_NO_GLX_DISPLAY)
+    {
+        std::cout << "GLEW initialization error." << std::endl;
+        return -1;
+    }
+
+    window_width = width;
+    window_height = height;
+
+    // Multisampled colour and depth stand in for the window framebuffer
+    glGenRenderbuffers(2, headless_renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless_renderbuffers[0]);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, 4, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless_renderbuffers[1]);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, 4, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &default_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, default_framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+                              headless_renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+                              headless_renderbuffers[1]);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Offscreen framebuffer incomplete." << std::endl;
+        return -1;
+    }
+
+    std::cout << "Headless context: " << glGetString(GL_RENDERER) << std::endl;
+
+    return 0;
+}
+//*************************************************************************************************
+void destroyHeadlessContext()
+{
+    glDeleteFramebuffers(1, &default_framebuffer);
+    glDeleteRenderbuffers(2, headless_renderbuffers);
+    default_framebuffer = 0;
+
+#if !defined(USE_EGL)
+    terminate();
+#else
+    eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(egl_display, egl_context);
+    eglTerminate(egl_display);
+    egl_context = EGL_NO_CONTEXT;
+    egl_display = EGL_NO_DISPLAY;
+#endif
+}
+//*************************************************************************************************
+// Closed Catmull-Rom loop around the city, t in [0, 1)
+glm::vec3 getCameraSplinePoint(float t)
+{
+    static const glm::vec3 control_points[] = {
+        glm::vec3(  0.0f, 15.0f, -50.0f),
+        glm::vec3( 40.0f, 20.0f, -25.0f),
+        glm::vec3( 55.0f, 10.0f,  20.0f),
+        glm::vec3( 10.0f, 25.0f,  55.0f),
+        glm::vec3(-45.0f, 12.0f,  35.0f),
+        glm::vec3(-50.0f, 18.0f, -20.0f),
+    };
+    const int points_count = sizeof(control_points) / sizeof(control_points[0]);
+
+    float position = (t - std::floor(t)) * points_count;
+    int segment = static_cast<int>(position);
+    float u = position - segment;
+
+    const glm::vec3 &p0 = control_points[(segment + points_count - 1) % points_count];
+    const glm::vec3 &p1 = control_points[segment % points_count];
+    const glm::vec3 &p2 = control_points[(segment + 1) % points_count];
+    const glm::vec3 &p3 = control_points[(segment + 2) % points_count];
+
+    return 0.5f * (2.0f * p1 + (p2 - p0) * u + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * u * u +
+                   (3.0f * p1 - p0 - 3.0f * p2 + p3) * u * u * u);
+}
+//*************************************************************************************************
+int saveBenchmarkReport(std::string file_name, const std::vector<BenchmarkFrame> &frames,
+                        const FrameProfiler &profiler, bool deferred_shading,
+                        DepthOrder depth_order)
+{
+    std::ofstream report_file(file_name, std::ios::out);
+    if (!report_file.is_open())
+    {
+        std::cout << "Error creating benchmark report \"" << file_name << "\"." << std::endl;
+        return -1;
+    }
+
+    std::vector<std::string> passes = {"Streaming", "Light binning", "Frame uniforms", "Skybox",
+                                       "Text", "Overlay"};
+    if (deferred_shading)
+        passes.insert(passes.begin() + 4, {"Geometry", "Lighting"});
+    else
+        passes.insert(passes.begin() + 4, "Meshes");
+    if (!deferred_shading && depth_order == DepthOrder::DEPTH_PREPASS)
+        passes.insert(passes.begin() + 4, "Depth pre-pass");
+
+    const char *depth_order_names[] = {"file_order", "front_to_back", "depth_prepass"};
+
+    std::vector<float> frame_times;
+    for (const auto &frame : frames)
+        frame_times.push_back(static_cast<float>(frame.frame_time));
+    FrameTimeStats stats = calculateFrameTimeStats(frame_times);
+
+    report_file << "{\n"
+                << "  \"renderer\": \"" << glGetString(GL_RENDERER) << "\",\n"
+                << "  \"width\": " << window_width << ",\n"
+                << "  \"height\": " << window_height << ",\n"
+                << "  \"shading\": \"" << (deferred_shading ? "deferred" : "forward") << "\",\n"
+                << "  \"depth_order\": \"" << depth_order_names[static_cast<int>(depth_order)]
+                << "\",\n"
+                << "  \"frames_count\": " << frames.size() << ",\n"
+                << "  \"frame_time_ms\": {\"min\": " << stats.min << ", \"avg\": " << stats.avg
+                << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99 << ", \"max\": "
+                << stats.max << "},\n"
+                << "  \"frames\": [\n";
+
+    // Profiler frames start at 1
+    for (std::size_t i = 0; i < frames.size(); i++)
+    {
+        const BenchmarkFrame &frame = frames[i];
+        report_file << "    {\"frame_time_ms\": " << frame.frame_time << ", \"draw_list_ms\": "
+                    << frame.draw_list_time << ", \"draw_calls\": "
+                    << frame.draw_calls << ", \"triangles\": " << frame.triangles
+                    << ", \"state_changes\": " << frame.state_changes
+                    << ", \"uniforms_uploaded\": " << frame.uniforms_uploaded
+                    << ", \"uniforms_skipped\": " << frame.uniforms_skipped
+                    << ", \"overdraw\": " << frame.overdraw << ", \"gpu_ms\": {";
+
+        for (std::size_t j = 0; j < passes.size(); j++)
+            report_file << (j ? ", " : "") << "\"" << passes[j] << "\": "
+                        << profiler.getGPUTime(passes[j], static_cast<unsigned int>(i + 1));
+
+        report_file << "}}" << (i + 1 < frames.size() ? "," : "") << "\n";
+    }
+
+    report_file << "  ]\n}\n";
+
+    if (!report_file)
+        return -1;
+
+    std::cout << "Benchmark: " << frames.size() << " frames, avg " << stats.avg << " ms, p99 "
+              << stats.p99 << " ms, report saved to \"" << file_name << "\"." << std::endl;
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,762 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// City scene of lesson 28 and its render graph passes, drawn under the text. Included by
+// main.cpp after its declarations.
+#ifndef TEKST_2_CITY_SCENE_H
+#define TEKST_2_CITY_SCENE_H
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+//******************************************************************************
+int loadSceneFromFile(std::string file_name, std::vector<Mesh*>& mesh_handle,
+                      MaterialLibrary &materials);
+
+// City of the lesson with its passes: forward or deferred shading lit by the clustered street
+// lights, the depth pre-pass, the overdraw view and the skybox. Text is drawn over it by main.
+class CityScene
+{
+public:
+    CityScene(JobSystem &jobs, StreamingBuffer &streaming_buffer, int city_grid,
+              unsigned int lights_count, bool deferred_shading, DepthOrder depth_order)
+        // Texture streamer (4 MB uploaded per frame, 64 MB staging), texture arrays with 2048 px
+        // atlas pages, finer mips kept within 256 MB
+        : texture_streamer_(4 * 1024 * 1024, 64 * 1024 * 1024, MipFilter::LANCZOS),
+          materials_(texture_streamer_, 2048, 256 * 1024 * 1024),
+          frame_uniforms_(std::max(64, city_grid * city_grid), streaming_buffer),
+          clustered_lights_(jobs), draw_list_(jobs)
+    {
+        jobs_ = &jobs;
+        city_grid_ = city_grid;
+        deferred_shading_ = deferred_shading;
+        depth_order_ = depth_order;
+
+        createStreetLights(lights_count, lights_);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, default_framebuffer);
+        glGetIntegerv(GL_SAMPLES, &framebuffer_samples_);
+        framebuffer_samples_ = std::max(framebuffer_samples_, 1);
+
+        // Core profile needs a vertex array even when the vertices come from gl_VertexID
+        glGenVertexArrays(1, &fullscreen_vao_);
+    }
+
+    // Shaders compile while the assets load, status is first queried in resolveShaders()
+    int submitShaders(ShaderProgramBatch &shader_batch)
+    {
+        // ----- MESH
+        if (shader_batch.submit(mesh_shader_, "mesh_vs.glsl", "mesh_fs.glsl"))
+            return -1;
+
+        // ----- DEFERRED SHADING
+        if (shader_batch.submit(gbuffer_shader_, "mesh_vs.glsl", "gbuffer_fs.glsl"))
+            return -1;
+
+        if (shader_batch.submit(deferred_shader_, "deferred_vs.glsl", "deferred_fs.glsl"))
+            return -1;
+
+        // ----- DEPTH PRE-PASS
+        if (shader_batch.submit(depth_shader_, "depth_vs.glsl", "depth_fs.glsl"))
+            return -1;
+
+        // ----- OVERDRAW VIEW
+        if (shader_batch.submit(overdraw_shader_, "depth_vs.glsl", "overdraw_fs.glsl"))
+            return -1;
+
+        if (shader_batch.submit(overdraw_view_shader_, "deferred_vs.glsl",
+                                "overdraw_view_fs.glsl"))
+            return -1;
+
+        // ----- SKYBOX
+        if (shader_batch.submit(skybox_shader_, "skybox_vs.glsl", "skybox_fs.glsl"))
+            return -1;
+
+        return 0;
+    }
+
+    void load()
+    {
+        // Create skybox
+        GLfloat skybox_vertices[] = {
+            -1.0f,  1.0f, -1.0f,
+            -1.0f, -1.0f, -1.0f,
+             1.0f, -1.0f, -1.0f,
+             1.0f, -1.0f, -1.0f,
+             1.0f,  1.0f, -1.0f,
+            -1.0f,  1.0f, -1.0f,
+
+            -1.0f, -1.0f,  1.0f,
+            -1.0f, -1.0f, -1.0f,
+            -1.0f,  1.0f, -1.0f,
+            -1.0f,  1.0f, -1.0f,
+            -1.0f,  1.0f,  1.0f,
+            -1.0f, -1.0f,  1.0f,
+
+             1.0f, -1.0f, -1.0f,
+             1.0f, -1.0f,  1.0f,
+             1.0f,  1.0f,  1.0f,
+             1.0f,  1.0f,  1.0f,
+             1.0f,  1.0f, -1.0f,
+             1.0f, -1.0f, -1.0f,
+
+            -1.0f, -1.0f,  1.0f,
+            -1.0f,  1.0f,  1.0f,
+             1.0f,  1.0f,  1.0f,
+             1.0f,  1.0f,  1.0f,
+             1.0f, -1.0f,  1.0f,
+            -1.0f, -1.0f,  1.0f,
+
+            -1.0f,  1.0f, -1.0f,
+             1.0f,  1.0f, -1.0f,
+             1.0f,  1.0f,  1.0f,
+             1.0f,  1.0f,  1.0f,
+            -1.0f,  1.0f,  1.0f,
+            -1.0f,  1.0f, -1.0f,
+
+            -1.0f, -1.0f, -1.0f,
+            -1.0f, -1.0f,  1.0f,
+             1.0f, -1.0f, -1.0f,
+             1.0f, -1.0f, -1.0f,
+            -1.0f, -1.0f,  1.0f,
+             1.0f, -1.0f,  1.0f
+        };
+
+        glGenBuffers(1, &skybox_vertices_vbo_);
+        glBindBuffer(GL_ARRAY_BUFFER, skybox_vertices_vbo_);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(skybox_vertices), &skybox_vertices, GL_STATIC_DRAW);
+
+        glGenVertexArrays(1, &skybox_vao_);
+        glBindVertexArray(skybox_vao_);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+        glEnableVertexAttribArray(0);
+        glBindVertexArray(0);
+
+        loadTextureSkybox(*jobs_, "hills_ft.tga", "hills_bk.tga", "hills_lf.tga", "hills_rt.tga",
+                          "hills_up.tga", "hills_dn.tga", skybox_texture_);
+
+        // Load meshes
+        loadSceneFromFile("city/city.obj", city_, materials_);
+        mesh_model_matrix_ = glm::scale(glm::mat4(1.0f), glm::vec3(0.1, 0.1, 0.1));
+
+        // Copies of the city side by side on a square grid
+        glm::vec3 city_min(0.0f, 0.0f, 0.0f);
+        glm::vec3 city_max(0.0f, 0.0f, 0.0f);
+        bool city_bounds_empty = true;
+        for (const auto &it : city_)
+        {
+            for (const auto &range : it->ranges)
+            {
+                glm::vec3 range_min = range.center - glm::vec3(range.radius);
+                glm::vec3 range_max = range.center + glm::vec3(range.radius);
+                city_min = city_bounds_empty ? range_min : glm::min(city_min, range_min);
+                city_max = city_bounds_empty ? range_max : glm::max(city_max, range_max);
+                city_bounds_empty = false;
+            }
+        }
+
+        glm::vec3 city_size = (city_max - city_min) * 0.1f;
+        for (int z = 0; z < city_grid_; z++)
+            for (int x = 0; x < city_grid_; x++)
+                city_model_matrices_.push_back(
+                    glm::translate(glm::mat4(1.0f), glm::vec3(x * city_size.x, 0.0f,
+                                                              z * city_size.z)) *
+                    mesh_model_matrix_);
+    }
+
+    int resolveShaders(ShaderProgramBatch &shader_batch)
+    {
+        if (shader_batch.resolve(mesh_shader_) || shader_batch.resolve(gbuffer_shader_) ||
+            shader_batch.resolve(deferred_shader_) || shader_batch.resolve(depth_shader_) ||
+            shader_batch.resolve(skybox_shader_) || shader_batch.resolve(overdraw_shader_) ||
+            shader_batch.resolve(overdraw_view_shader_))
+            return -1;
+
+        // Camera and object matrices come from uniform buffers
+        frame_uniforms_.bindProgram(mesh_shader_);
+        frame_uniforms_.bindProgram(gbuffer_shader_);
+        frame_uniforms_.bindProgram(depth_shader_);
+        frame_uniforms_.bindProgram(overdraw_shader_);
+        frame_uniforms_.bindProgram(skybox_shader_);
+
+        // Reflect active uniforms of the linked programs
+        mesh_uniforms_.reset(new ShaderUniforms(mesh_shader_));
+        texture_slot_mesh_ = mesh_uniforms_->find<GLint>("basic_texture");
+        light_data_slot_ = mesh_uniforms_->find<GLint>("light_data");
+        light_clusters_slot_ = mesh_uniforms_->find<GLint>("light_clusters");
+        light_indices_slot_ = mesh_uniforms_->find<GLint>("light_indices");
+        cluster_grid_ = mesh_uniforms_->find<glm::vec4>("cluster_grid");
+
+        gbuffer_uniforms_.reset(new ShaderUniforms(gbuffer_shader_));
+        texture_slot_gbuffer_ = gbuffer_uniforms_->find<GLint>("basic_texture");
+
+        deferred_uniforms_.reset(new ShaderUniforms(deferred_shader_));
+        albedo_slot_ = deferred_uniforms_->find<GLint>("albedo_specular_buffer");
+        normal_slot_ = deferred_uniforms_->find<GLint>("normal_buffer");
+        depth_slot_ = deferred_uniforms_->find<GLint>("depth_buffer");
+        deferred_light_data_slot_ = deferred_uniforms_->find<GLint>("light_data");
+        deferred_light_clusters_slot_ = deferred_uniforms_->find<GLint>("light_clusters");
+        deferred_light_indices_slot_ = deferred_uniforms_->find<GLint>("light_indices");
+        deferred_cluster_grid_ = deferred_uniforms_->find<glm::vec4>("cluster_grid");
+        inverse_projection_ = deferred_uniforms_->find<glm::mat4>("inverse_projection_matrix");
+
+        overdraw_view_uniforms_.reset(new ShaderUniforms(overdraw_view_shader_));
+        overdraw_slot_ = overdraw_view_uniforms_->find<GLint>("overdraw_buffer");
+
+        return 0;
+    }
+
+    void updateStreaming(FrameProfiler &profiler)
+    {
+        profiler.beginScope("Streaming");
+        texture_streamer_.update();
+        materials_.updateResidency(camera_position, camera_direction, mesh_model_matrix_, FOV,
+                                   window_height);
+        profiler.endScope();
+
+        // Uploads above bind textures and buffers without the state cache
+        gl_state.invalidateBindings();
+    }
+
+    // Lights, camera and the draw list of the frame, after the camera has moved
+    void update(FrameProfiler &profiler)
+    {
+        profiler.beginScope("Light binning");
+        clustered_lights_.update(lights_, view_matrix, FOV, aspect, P1, P2);
+        profiler.endScope();
+
+        // Per frame uniforms
+        profiler.beginScope("Frame uniforms");
+        glm::mat4 view_static = view_matrix;
+        glm::vec3 pos(0.0, 0.0, 0.0);
+        view_static = glm::lookAt(pos, pos + camera_direction, camera_up);
+        frame_uniforms_.setCamera(view_matrix, projection_matrix, view_static, camera_position);
+
+        profiler.beginScope("Draw list", false);
+        draw_list_.build(city_, city_model_matrices_, frame_uniforms_, view_matrix,
+                         projection_matrix, window_height, depth_order_);
+        profiler.endScope();
+
+        frame_uniforms_.upload();
+        profiler.endScope();
+    }
+
+    // Passes of the scene, the graph runs them after this call so they capture by value
+    void addPasses(RenderGraph &render_graph, RenderGraph::Resource backbuffer)
+    {
+        RenderGraph::Resource albedo = -1;
+        RenderGraph::Resource normal = -1;
+        RenderGraph::Resource depth = -1;
+
+        std::uint64_t screen_samples =
+            static_cast<std::uint64_t>(window_width) * window_height * framebuffer_samples_;
+
+        // Geometry pass, only surface attributes are written
+        if (deferred_shading_)
+        {
+            albedo = render_graph.createTexture("Albedo", window_width, window_height, GL_RGBA8);
+            normal = render_graph.createTexture("Normal", window_width, window_height, GL_RG16F);
+            depth = render_graph.createTexture("Depth", window_width, window_height,
+                                               GL_DEPTH24_STENCIL8);
+
+            render_graph.addPass("Geometry", {}, {albedo, normal, depth}, [this]() {
+                clearColor(0.0, 0.0, 0.0);
+                gl_state.enable(GL_BLEND, false);
+
+                activateShaderProgram(gbuffer_shader_);
+                gbuffer_uniforms_->set(texture_slot_gbuffer_, 0);
+
+                // G-buffer writes are cheap, sorting alone is enough here
+                overdraw_counter_.begin();
+                draw_list_.draw(frame_uniforms_, false);
+                overdraw_counter_.end(static_cast<std::uint64_t>(window_width) * window_height);
+
+                gl_state.enable(GL_BLEND, true);
+            });
+        }
+
+        // Draw skybox, in the forward path only into pixels no mesh has covered
+        auto draw_skybox = [this]() {
+            if (deferred_shading_)
+            {
+                clearColor(0.5, 0.5, 0.5);
+                enableDepthTesting(false);
+            }
+            else
+            {
+                // Skybox vertices are projected onto the far plane
+                gl_state.depthFunc(GL_LEQUAL);
+                gl_state.depthMask(false);
+            }
+
+            activateShaderProgram(skybox_shader_);
+            gl_state.bindTexture(0, GL_TEXTURE_CUBE_MAP, skybox_texture_);
+            gl_state.bindVertexArray(skybox_vao_);
+            drawArrays(GL_TRIANGLES, 0, 36);
+
+            gl_state.depthMask(true);
+            enableDepthTesting(true);
+        };
+
+        if (deferred_shading_)
+        {
+            render_graph.addPass("Skybox", {}, {backbuffer}, draw_skybox);
+
+            // Lighting pass, every covered pixel is lit once by the lights of its cluster
+            render_graph.addPass("Lighting", {albedo, normal, depth}, {backbuffer},
+                                 [this, &render_graph, albedo, normal, depth]() {
+                activateShaderProgram(deferred_shader_);
+                deferred_uniforms_->set(albedo_slot_, 0);
+                deferred_uniforms_->set(normal_slot_, 1);
+                deferred_uniforms_->set(depth_slot_, 2);
+                deferred_uniforms_->set(deferred_light_data_slot_, 3);
+                deferred_uniforms_->set(deferred_light_clusters_slot_, 4);
+                deferred_uniforms_->set(deferred_light_indices_slot_, 5);
+                deferred_uniforms_->set(deferred_cluster_grid_,
+                                        clustered_lights_.getGridParameters(window_width,
+                                                                            window_height));
+                deferred_uniforms_->set(inverse_projection_, glm::inverse(projection_matrix));
+                gl_state.bindTexture(0, GL_TEXTURE_2D, render_graph.getTexture(albedo));
+                gl_state.bindTexture(1, GL_TEXTURE_2D, render_graph.getTexture(normal));
+                gl_state.bindTexture(2, GL_TEXTURE_2D, render_graph.getTexture(depth));
+                clustered_lights_.bind(3);
+
+                enableDepthTesting(false);
+                gl_state.bindVertexArray(fullscreen_vao_);
+                drawArrays(GL_TRIANGLES, 0, 3);
+                enableDepthTesting(true);
+            });
+        }
+        else
+        {
+            // Depth only, positions are the single vertex stream and no colour is written
+            if (depth_order_ == DepthOrder::DEPTH_PREPASS)
+            {
+                render_graph.addPass("Depth pre-pass", {}, {backbuffer}, [this]() {
+                    clearColor(0.5, 0.5, 0.5);
+                    gl_state.colorMask(false);
+
+                    activateShaderProgram(depth_shader_);
+                    draw_list_.draw(frame_uniforms_, true);
+
+                    gl_state.colorMask(true);
+                });
+            }
+
+            // Draw meshes, behind the pre-pass only the visible fragment of each pixel passes
+            render_graph.addPass("Meshes", {}, {backbuffer}, [this, screen_samples]() {
+                if (depth_order_ == DepthOrder::DEPTH_PREPASS)
+                {
+                    gl_state.depthFunc(GL_LEQUAL);
+                    gl_state.depthMask(false);
+                }
+                else
+                {
+                    clearColor(0.5, 0.5, 0.5);
+                }
+
+                activateShaderProgram(mesh_shader_);
+                mesh_uniforms_->set(texture_slot_mesh_, 0);
+                mesh_uniforms_->set(light_data_slot_, 1);
+                mesh_uniforms_->set(light_clusters_slot_, 2);
+                mesh_uniforms_->set(light_indices_slot_, 3);
+                mesh_uniforms_->set(cluster_grid_,
+                                    clustered_lights_.getGridParameters(window_width,
+                                                                        window_height));
+                clustered_lights_.bind(1);
+
+                overdraw_counter_.begin();
+                draw_list_.draw(frame_uniforms_, false);
+                overdraw_counter_.end(screen_samples);
+
+                gl_state.depthMask(true);
+                enableDepthTesting(true);
+            });
+
+            render_graph.addPass("Skybox", {}, {backbuffer}, draw_skybox);
+        }
+
+        // Overdraw heat map, every fragment adds one step with no depth test. It is declared
+        // every frame and only the view below reads it, so the graph culls it otherwise. In
+        // the deferred path it starts after the lighting and shares the albedo texture.
+        RenderGraph::Resource overdraw = render_graph.createTexture("Overdraw", window_width,
+                                                                    window_height, GL_RGBA8);
+        render_graph.addPass("Overdraw", {}, {overdraw}, [this]() {
+            clearColor(0.0, 0.0, 0.0);
+            enableDepthTesting(false);
+            gl_state.blendFunc(GL_ONE, GL_ONE);
+
+            activateShaderProgram(overdraw_shader_);
+            draw_list_.draw(frame_uniforms_, false);
+
+            gl_state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            enableDepthTesting(true);
+        });
+
+        if (overdraw_view_)
+        {
+            render_graph.addPass("Overdraw view", {overdraw}, {backbuffer},
+                                 [this, &render_graph, overdraw]() {
+                activateShaderProgram(overdraw_view_shader_);
+                overdraw_view_uniforms_->set(overdraw_slot_, 0);
+                gl_state.bindTexture(0, GL_TEXTURE_2D, render_graph.getTexture(overdraw));
+
+                enableDepthTesting(false);
+                gl_state.enable(GL_BLEND, false);
+                gl_state.bindVertexArray(fullscreen_vao_);
+                drawArrays(GL_TRIANGLES, 0, 3);
+                gl_state.enable(GL_BLEND, true);
+                enableDepthTesting(true);
+            });
+        }
+    }
+
+    void printResidencyStats()
+    {
+        materials_.printResidencyStats();
+    }
+
+    // Street lights binned every frame, the light count sweep doubles them
+    void setLightsCount(unsigned int count)
+    {
+        createStreetLights(count, lights_);
+    }
+
+    unsigned int getLightsCount() const
+    {
+        return static_cast<unsigned int>(lights_.size());
+    }
+
+    double getBinningTime() const
+    {
+        return clustered_lights_.getBinningTime();
+    }
+
+    unsigned int getLightIndicesCount() const
+    {
+        return clustered_lights_.getIndicesCount();
+    }
+
+    void setDeferredShading(bool state)
+    {
+        deferred_shading_ = state;
+    }
+
+    bool isDeferredShading() const
+    {
+        return deferred_shading_;
+    }
+
+    // Opaque meshes in file order, front to back or behind a depth pre-pass
+    void setDepthOrder(DepthOrder depth_order)
+    {
+        depth_order_ = depth_order;
+    }
+
+    DepthOrder getDepthOrder() const
+    {
+        return depth_order_;
+    }
+
+    // Heat map of the fragments drawn per pixel instead of the scene
+    void setOverdrawView(bool state)
+    {
+        overdraw_view_ = state;
+    }
+
+    bool isOverdrawView() const
+    {
+        return overdraw_view_;
+    }
+
+    // Samples per pixel of the opaque pass, a few frames late
+    float getOverdraw() const
+    {
+        return overdraw_counter_.getOverdraw();
+    }
+
+    const DrawListBuilder& getDrawList() const
+    {
+        return draw_list_;
+    }
+
+protected:
+    // Materials keep a reference to the streamer, so it is constructed first
+    TextureStreamer texture_streamer_;
+    MaterialLibrary materials_;
+    FrameUniforms frame_uniforms_;
+    // Lights are binned into view frustum clusters on the shared pool
+    ClusteredLights clustered_lights_;
+    // Culling, detail selection, uniform packing and sorting of the cities run on workers
+    DrawListBuilder draw_list_;
+    OverdrawCounter overdraw_counter_;
+
+    DepthOrder depth_order_{DepthOrder::FILE_ORDER};
+    GLint framebuffer_samples_{0};
+    GLuint deferred_shader_{0};
+    GLuint depth_shader_{0};
+    GLuint fullscreen_vao_{0};
+    GLuint gbuffer_shader_{0};
+    GLuint mesh_shader_{0};
+    GLuint overdraw_shader_{0};
+    GLuint overdraw_view_shader_{0};
+    GLuint skybox_shader_{0};
+    GLuint skybox_texture_{0};
+    GLuint skybox_vao_{0};
+    GLuint skybox_vertices_vbo_{0};
+    JobSystem *jobs_{nullptr};
+    MeshHandle city_;
+    UniformHandle<GLint> albedo_slot_;
+    UniformHandle<GLint> deferred_light_clusters_slot_;
+    UniformHandle<GLint> deferred_light_data_slot_;
+    UniformHandle<GLint> deferred_light_indices_slot_;
+    UniformHandle<GLint> depth_slot_;
+    UniformHandle<GLint> light_clusters_slot_;
+    UniformHandle<GLint> light_data_slot_;
+    UniformHandle<GLint> light_indices_slot_;
+    UniformHandle<GLint> normal_slot_;
+    UniformHandle<GLint> overdraw_slot_;
+    UniformHandle<GLint> texture_slot_gbuffer_;
+    UniformHandle<GLint> texture_slot_mesh_;
+    UniformHandle<glm::mat4> inverse_projection_;
+    UniformHandle<glm::vec4> cluster_grid_;
+    UniformHandle<glm::vec4> deferred_cluster_grid_;
+    bool deferred_shading_{false};
+    bool overdraw_view_{false};
+    glm::mat4 mesh_model_matrix_{1.0f};
+    int city_grid_{1};
+    // Reflected once the programs have linked
+    std::unique_ptr<ShaderUniforms> deferred_uniforms_;
+    std::unique_ptr<ShaderUniforms> gbuffer_uniforms_;
+    std::unique_ptr<ShaderUniforms> mesh_uniforms_;
+    std::unique_ptr<ShaderUniforms> overdraw_view_uniforms_;
+    std::vector<Light> lights_;
+    std::vector<glm::mat4> city_model_matrices_;
+
+};
+//*************************************************************************************************
+int loadSceneFromFile(std::string file_name, std::vector<Mesh*>& mesh_handle,
+                      MaterialLibrary &materials)
+{
+    const aiScene* scene = aiImportFile(file_name.c_str(), aiProcessPreset_TargetRealtime_Fast);
+    if (!scene)
+    {
+        std::cout << "Mesh file \"" << file_name << "\" not found." << std::endl;
+        return -1;
+    }
+
+    // First pass - register textures, atlas placement depends on UV range of all meshes
+    std::vector<int> mesh_materials(scene->mNumMeshes, -1);
+
+    for (unsigned int m = 0; m != scene->mNumMeshes; m++)
+    {
+        aiMesh *mesh = scene->mMeshes[m];
+
+        if (scene->mNumMaterials == 0)
+            continue;
+
+        const aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+
+        aiString texture_path;
+
+        if (material->GetTexture(aiTextureType_DIFFUSE, 0, &texture_path) == AI_SUCCESS)
+        {
+            unsigned int found_pos = file_name.find_last_of("/\\");
+            std::string path = file_name.substr(0, found_pos);
+            std::string name(texture_path.C_Str());
+            if (name[0] == '/')
+                name.erase(0, 1);
+
+            std::string file_path = path + "/" + name;
+
+            glm::vec2 uv_min(0.0f, 0.0f);
+            glm::vec2 uv_max(1.0f, 1.0f);
+            for (unsigned int v = 0; mesh->HasTextureCoords(0) && v != mesh->mNumVertices; v++)
+            {
+                const aiVector3D &uv = mesh->mTextureCoords[0][v];
+                uv_min = glm::vec2(std::min(uv_min.x, uv.x), std::min(uv_min.y, uv.y));
+                uv_max = glm::vec2(std::max(uv_max.x, uv.x), std::max(uv_max.y, uv.y));
+            }
+
+            bool atlas_allowed = mesh->HasTextureCoords(0) && uv_min.x >= 0.0f &&
+                                 uv_min.y >= 0.0f && uv_max.x <= 1.0f && uv_max.y <= 1.0f;
+
+            mesh_materials[m] = materials.addTexture(file_path, atlas_allowed);
+
+            glm::vec3 bounds_min(0.0f, 0.0f, 0.0f);
+            glm::vec3 bounds_max(0.0f, 0.0f, 0.0f);
+            for (unsigned int v = 0; v != mesh->mNumVertices; v++)
+            {
+                glm::vec3 position(mesh->mVertices[v].x, mesh->mVertices[v].y,
+                                   mesh->mVertices[v].z);
+                bounds_min = v == 0 ? position : glm::min(bounds_min, position);
+                bounds_max = v == 0 ? position : glm::max(bounds_max, position);
+            }
+
+            materials.addMeshBounds(mesh_materials[m], (bounds_min + bounds_max) * 0.5f,
+                                    glm::length(bounds_max - bounds_min) * 0.5f,
+                                    std::max(uv_max.x - uv_min.x, uv_max.y - uv_min.y));
+        }
+    }
+
+    materials.build();
+
+    // Second pass - merge meshes sharing a texture array into one vertex array
+    struct Batch
+    {
+        std::vector<GLfloat> layer_container;
+        std::vector<GLfloat> normal_vector_container;
+        std::vector<GLfloat> position_container;
+        std::vector<MeshRange> ranges;
+        std::vector<GLfloat> texture_coord_container;
+    };
+
+    std::map<GLuint, Batch> batches;
+
+    for (unsigned int m = 0; m != scene->mNumMeshes; m++)
+    {
+        aiMesh *mesh = scene->mMeshes[m];
+        int material = mesh_materials[m];
+
+        Batch &batch = batches[materials.getTextureArray(material)];
+        float layer = materials.getLayer(material);
+
+        MeshRange range;
+        range.first = static_cast<GLint>(batch.position_container.size() / 3);
+        glm::vec3 bounds_min(0.0f, 0.0f, 0.0f);
+        glm::vec3 bounds_max(0.0f, 0.0f, 0.0f);
+
+        for (unsigned int f = 0; f != mesh->mNumFaces; f++)
+        {
+            const aiFace *face = &mesh->mFaces[f];
+
+            for (unsigned int v = 0; v != 3; v++)
+            {
+                aiVector3D position{0, 0, 0};
+                aiVector3D normal_vector{0, 0, 0};
+                aiVector3D texture_coords{0, 0, 0};
+
+                if (mesh->HasPositions())
+                    position = mesh->mVertices[face->mIndices[v]];
+
+                glm::vec3 point(position.x, position.y, position.z);
+                bool first_vertex = f == 0 && v == 0;
+                bounds_min = first_vertex ? point : glm::min(bounds_min, point);
+                bounds_max = first_vertex ? point : glm::max(bounds_max, point);
+
+                if (mesh->HasNormals())
+                    normal_vector = mesh->mNormals[face->mIndices[v]];
+
+                if (mesh->HasTextureCoords(0))
+                    texture_coords = mesh->mTextureCoords[0][face->mIndices[v]];
+
+                glm::vec2 uv = materials.remapUV(material,
+                                                 glm::vec2(texture_coords.x, texture_coords.y));
+
+                batch.position_container.push_back(position.x);
+                batch.position_container.push_back(position.y);
+                batch.position_container.push_back(position.z);
+
+                batch.normal_vector_container.push_back(normal_vector.x);
+                batch.normal_vector_container.push_back(normal_vector.y);
+                batch.normal_vector_container.push_back(normal_vector.z);
+
+                batch.texture_coord_container.push_back(uv.x);
+                batch.texture_coord_container.push_back(uv.y);
+
+                batch.layer_container.push_back(layer);
+            }
+        }
+
+        range.center = (bounds_min + bounds_max) * 0.5f;
+        range.radius = glm::length(bounds_max - bounds_min) * 0.5f;
+        range.count = static_cast<GLsizei>(batch.position_container.size() / 3) - range.first;
+        if (range.count > 0)
+            batch.ranges.push_back(range);
+    }
+
+    aiReleaseImport(scene);
+
+    std::vector<Mesh*> complete_mesh;
+
+    for (auto &it : batches)
+    {
+        Batch &batch = it.second;
+
+        Mesh *mesh_entity = new Mesh();
+
+        GLuint position_vbo = 0;
+        glGenBuffers(1, &position_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, position_vbo);
+        glBufferData(GL_ARRAY_BUFFER, batch.position_container.size() * sizeof(GLfloat),
+                     batch.position_container.data(), GL_STATIC_DRAW);
+
+        GLuint normal_vector_vbo = 0;
+        glGenBuffers(1, &normal_vector_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, normal_vector_vbo);
+        glBufferData(GL_ARRAY_BUFFER, batch.normal_vector_container.size() * sizeof(GLfloat),
+                     batch.normal_vector_container.data(), GL_STATIC_DRAW);
+
+        GLuint texture_coord_vbo = 0;
+        glGenBuffers(1, &texture_coord_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, texture_coord_vbo);
+        glBufferData(GL_ARRAY_BUFFER, batch.texture_coord_container.size() * sizeof(GLfloat),
+                     batch.texture_coord_container.data(), GL_STATIC_DRAW);
+
+        GLuint layer_vbo = 0;
+        glGenBuffers(1, &layer_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, layer_vbo);
+        glBufferData(GL_ARRAY_BUFFER, batch.layer_container.size() * sizeof(GLfloat),
+                     batch.layer_container.data(), GL_STATIC_DRAW);
+
+        glGenVertexArrays(1, &mesh_entity->handle);
+        glBindVertexArray(mesh_entity->handle);
+
+        glBindBuffer(GL_ARRAY_BUFFER, position_vbo);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, normal_vector_vbo);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, texture_coord_vbo);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, layer_vbo);
+        glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, 0, 0);
+
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        glEnableVertexAttribArray(3);
+
+        // Depth pre-pass fetches the position stream only
+        glGenVertexArrays(1, &mesh_entity->depth_handle);
+        glBindVertexArray(mesh_entity->depth_handle);
+
+        glBindBuffer(GL_ARRAY_BUFFER, position_vbo);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(0);
+
+        glBindVertexArray(0);
+
+        mesh_entity->vertices_count = batch.position_container.size() / 3;
+        mesh_entity->diffuse_texture = it.first;
+        mesh_entity->ranges = batch.ranges;
+
+        complete_mesh.push_back(mesh_entity);
+    }
+
+    std::cout << "Scene \"" << file_name << "\": " << mesh_materials.size()
+              << " meshes merged into " << complete_mesh.size() << " draw calls." << std::endl;
+
+    mesh_handle = complete_mesh;
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,324 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Lights of lesson 28 binned into view space clusters on the job system, and the street
+// lights of the city. Included by main.cpp after its declarations.
+#ifndef TEKST_2_CLUSTERED_LIGHTS_H
+#define TEKST_2_CLUSTERED_LIGHTS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <vector>
+//******************************************************************************
+// Point light when spot_cutoff is below -1, otherwise a spot light cosine cutoff
+struct Light
+{
+    glm::vec3 position;
+    float radius = 0.0f;
+    glm::vec3 colour;
+    float spot_cutoff = -2.0f;
+    // Normalized on upload, point lights keep the default
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+};
+
+void createStreetLights(unsigned int count, std::vector<Light> &lights);
+
+class ClusteredLights
+{
+public:
+    ClusteredLights(JobSystem &jobs)
+    {
+        jobs_ = &jobs;
+        cluster_lights_.resize(CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z);
+        cluster_bounds_.resize(cluster_lights_.size() * 2);
+
+        glGenBuffers(BUFFERS_COUNT, buffers_);
+        glGenTextures(BUFFERS_COUNT, textures_);
+
+        const GLenum formats[BUFFERS_COUNT] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+        for (unsigned int i = 0; i < BUFFERS_COUNT; i++)
+        {
+            gl_state.bindBuffer(GL_TEXTURE_BUFFER, buffers_[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+
+            gl_state.bindTexture(0, GL_TEXTURE_BUFFER, textures_[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers_[i]);
+        }
+    }
+
+    ~ClusteredLights()
+    {
+        gl_state.deleteTextures(BUFFERS_COUNT, textures_);
+        gl_state.deleteBuffers(BUFFERS_COUNT, buffers_);
+    }
+
+    // Light data, cluster ranges and light indices go to three consecutive texture units
+    void bind(GLuint first_unit)
+    {
+        for (unsigned int i = 0; i < BUFFERS_COUNT; i++)
+            gl_state.bindTexture(first_unit + i, GL_TEXTURE_BUFFER, textures_[i]);
+    }
+
+    double getBinningTime() const
+    {
+        return binning_time_;
+    }
+
+    // Viewport size in pixels and the scale and bias turning log(depth) into a slice, the
+    // shaders split the viewport into the same CLUSTERS_X by CLUSTERS_Y NDC tiles
+    glm::vec4 getGridParameters(int viewport_width, int viewport_height) const
+    {
+        return glm::vec4(static_cast<float>(viewport_width), static_cast<float>(viewport_height),
+                         slice_scale_, slice_bias_);
+    }
+
+    unsigned int getIndicesCount() const
+    {
+        return static_cast<unsigned int>(light_indices_.size());
+    }
+
+    // Bins the lights into the view frustum clusters and uploads the light lists
+    void update(const std::vector<Light> &lights, const glm::mat4 &view_matrix, float fov,
+                float aspect, float near_plane, float far_plane)
+    {
+        auto start_time = std::chrono::steady_clock::now();
+
+        if (fov != fov_ || aspect != aspect_ || near_plane != near_ || far_plane != far_)
+            calculateClusterBounds(fov, aspect, near_plane, far_plane);
+
+        light_data_.resize(lights.size() * 3);
+        for (std::size_t i = 0; i < lights.size(); i++)
+        {
+            const Light &light = lights[i];
+            glm::vec3 position = glm::vec3(view_matrix * glm::vec4(light.position, 1.0f));
+            glm::vec3 direction = glm::vec3(view_matrix * glm::vec4(light.direction, 0.0f));
+
+            light_data_[i * 3] = glm::vec4(position, light.radius);
+            light_data_[i * 3 + 1] = glm::vec4(light.colour, light.spot_cutoff);
+            light_data_[i * 3 + 2] = glm::vec4(glm::normalize(direction), 0.0f);
+        }
+
+        // Every job owns a depth slice, so no cluster is shared
+        JobSystem::Job job = jobs_->parallelFor(0, CLUSTERS_Z, 1, [this](int first, int last) {
+            for (int z = first; z < last; z++)
+                binSlice(static_cast<unsigned int>(z));
+        });
+        jobs_->wait(job);
+
+        cluster_ranges_.resize(cluster_lights_.size() * 2);
+        light_indices_.clear();
+        for (std::size_t i = 0; i < cluster_lights_.size(); i++)
+        {
+            cluster_ranges_[i * 2] = static_cast<GLuint>(light_indices_.size());
+            cluster_ranges_[i * 2 + 1] = static_cast<GLuint>(cluster_lights_[i].size());
+            light_indices_.insert(light_indices_.end(), cluster_lights_[i].begin(),
+                                  cluster_lights_[i].end());
+        }
+
+        binning_time_ = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start_time).count();
+
+        upload(buffers_[0], light_data_.data(), light_data_.size() * sizeof(glm::vec4));
+        upload(buffers_[1], cluster_ranges_.data(), cluster_ranges_.size() * sizeof(GLuint));
+        upload(buffers_[2], light_indices_.data(), light_indices_.size() * sizeof(GLuint));
+    }
+
+    static const unsigned int CLUSTERS_X = 16;
+    static const unsigned int CLUSTERS_Y = 9;
+    static const unsigned int CLUSTERS_Z = 24;
+
+protected:
+    void binSlice(unsigned int z)
+    {
+        float slice_near = getSliceDepth(z);
+        float slice_far = getSliceDepth(z + 1);
+        unsigned int lights_count = static_cast<unsigned int>(light_data_.size() / 3);
+
+        for (unsigned int y = 0; y < CLUSTERS_Y; y++)
+            for (unsigned int x = 0; x < CLUSTERS_X; x++)
+                cluster_lights_[getClusterIndex(x, y, z)].clear();
+
+        for (unsigned int light = 0; light < lights_count; light++)
+        {
+            glm::vec3 center = glm::vec3(light_data_[light * 3]);
+            float radius = light_data_[light * 3].w;
+
+            // The camera looks down -z, depth is the distance along the view direction
+            float depth = -center.z;
+            if (depth + radius < slice_near || depth - radius > slice_far)
+                continue;
+
+            // Screen tiles covered by the sphere, taken at the depth that widens it the most
+            unsigned int first_x = 0;
+            unsigned int last_x = 0;
+            unsigned int first_y = 0;
+            unsigned int last_y = 0;
+            getTileRange(center.x, radius, tan_half_fov_ * aspect_, slice_near, slice_far,
+                         CLUSTERS_X, first_x, last_x);
+            getTileRange(center.y, radius, tan_half_fov_, slice_near, slice_far, CLUSTERS_Y,
+                         first_y, last_y);
+
+            for (unsigned int y = first_y; y <= last_y; y++)
+            {
+                for (unsigned int x = first_x; x <= last_x; x++)
+                {
+                    unsigned int cluster = getClusterIndex(x, y, z);
+                    const glm::vec3 &box_min = cluster_bounds_[cluster * 2];
+                    const glm::vec3 &box_max = cluster_bounds_[cluster * 2 + 1];
+
+                    glm::vec3 closest = glm::clamp(center, box_min, box_max);
+                    glm::vec3 offset = closest - center;
+                    if (glm::dot(offset, offset) <= radius * radius)
+                        cluster_lights_[cluster].push_back(light);
+                }
+            }
+        }
+    }
+
+    // View space bounds of every cluster, rebuilt only when the projection changes
+    void calculateClusterBounds(float fov, float aspect, float near_plane, float far_plane)
+    {
+        fov_ = fov;
+        aspect_ = aspect;
+        near_ = near_plane;
+        far_ = far_plane;
+        tan_half_fov_ = std::tan(fov * 0.5f);
+
+        // slice = log(depth) * scale - bias, exponential slices keep clusters roughly cubic
+        float log_ratio = std::log(far_plane / near_plane);
+        slice_scale_ = CLUSTERS_Z / log_ratio;
+        slice_bias_ = CLUSTERS_Z * std::log(near_plane) / log_ratio;
+
+        for (unsigned int z = 0; z < CLUSTERS_Z; z++)
+        {
+            float depths[2] = {getSliceDepth(z), getSliceDepth(z + 1)};
+
+            for (unsigned int y = 0; y < CLUSTERS_Y; y++)
+            {
+                for (unsigned int x = 0; x < CLUSTERS_X; x++)
+                {
+                    float ndc_x[2] = {2.0f * x / CLUSTERS_X - 1.0f,
+                                      2.0f * (x + 1) / CLUSTERS_X - 1.0f};
+                    float ndc_y[2] = {2.0f * y / CLUSTERS_Y - 1.0f,
+                                      2.0f * (y + 1) / CLUSTERS_Y - 1.0f};
+
+                    glm::vec3 box_min(std::numeric_limits<float>::max());
+                    glm::vec3 box_max(-std::numeric_limits<float>::max());
+                    for (float depth : depths)
+                    {
+                        for (float corner_x : ndc_x)
+                        {
+                            for (float corner_y : ndc_y)
+                            {
+                                glm::vec3 corner(corner_x * depth * tan_half_fov_ * aspect,
+                                                 corner_y * depth * tan_half_fov_, -depth);
+                                box_min = glm::min(box_min, corner);
+                                box_max = glm::max(box_max, corner);
+                            }
+                        }
+                    }
+
+                    unsigned int cluster = getClusterIndex(x, y, z);
+                    cluster_bounds_[cluster * 2] = box_min;
+                    cluster_bounds_[cluster * 2 + 1] = box_max;
+                }
+            }
+        }
+    }
+
+    static unsigned int getClusterIndex(unsigned int x, unsigned int y, unsigned int z)
+    {
+        return x + CLUSTERS_X * (y + CLUSTERS_Y * z);
+    }
+
+    float getSliceDepth(unsigned int slice) const
+    {
+        return near_ * std::pow(far_ / near_, static_cast<float>(slice) / CLUSTERS_Z);
+    }
+
+    static void getTileRange(float center, float radius, float tan_half_extent, float near_depth,
+                             float far_depth, unsigned int tiles_count, unsigned int &first_tile,
+                             unsigned int &last_tile)
+    {
+        float low = center - radius;
+        float high = center + radius;
+        float ndc_low = low / ((low < 0.0f ? near_depth : far_depth) * tan_half_extent);
+        float ndc_high = high / ((high > 0.0f ? near_depth : far_depth) * tan_half_extent);
+
+        auto to_tile = [tiles_count](float ndc) {
+            float tile = std::floor((ndc * 0.5f + 0.5f) * tiles_count);
+            return static_cast<unsigned int>(glm::clamp(tile, 0.0f, tiles_count - 1.0f));
+        };
+
+        first_tile = to_tile(ndc_low);
+        last_tile = to_tile(ndc_high);
+    }
+
+    // Orphans the old storage so the driver does not wait for draws still reading it
+    static void upload(GLuint buffer, const void *data, std::size_t size)
+    {
+        gl_state.bindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, std::max<std::size_t>(size, 16), nullptr,
+                     GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+    }
+
+    static const unsigned int BUFFERS_COUNT = 3;
+
+protected:
+    GLuint buffers_[BUFFERS_COUNT];
+    GLuint textures_[BUFFERS_COUNT];
+    JobSystem *jobs_{nullptr};
+    double binning_time_{0.0};
+    float aspect_{0.0f};
+    float far_{0.0f};
+    float fov_{0.0f};
+    float near_{0.0f};
+    float slice_bias_{0.0f};
+    float slice_scale_{0.0f};
+    float tan_half_fov_{0.0f};
+    std::vector<GLuint> cluster_ranges_;
+    std::vector<GLuint> light_indices_;
+    std::vector<glm::vec3> cluster_bounds_;
+    std::vector<glm::vec4> light_data_;
+    std::vector<std::vector<GLuint>> cluster_lights_;
+
+};
+//*************************************************************************************************
+void createStreetLights(unsigned int count, std::vector<Light> &lights)
+{
+    lights.clear();
+
+    // The original light above the city center
+    Light center_light;
+    center_light.position = glm::vec3(0.0f, 3.0f, 0.0f);
+    center_light.radius = 60.0f;
+    center_light.colour = glm::vec3(0.8f, 0.8f, 0.8f);
+    lights.push_back(center_light);
+
+    // Remaining lights on a square grid over the city, radius follows the spacing
+    unsigned int grid_size = static_cast<unsigned int>(std::ceil(std::sqrt(float(count - 1))));
+    float spacing = 200.0f / std::max(grid_size, 1u);
+
+    for (unsigned int i = 0; i + 1 < count; i++)
+    {
+        Light street_light;
+        street_light.position = glm::vec3(-100.0f + (i % grid_size + 0.5f) * spacing, 4.0f,
+                                          -100.0f + (i / grid_size + 0.5f) * spacing);
+        street_light.radius = std::max(spacing * 1.5f, 6.0f);
+        street_light.colour = glm::vec3(1.0f, 0.75f, 0.45f);
+        street_light.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+
+        // Every fourth light is a point light, the rest are downward spots
+        if (i % 4 != 0)
+            street_light.spot_cutoff = std::cos(glm::radians(50.0f));
+
+        lights.push_back(street_light);
+    }
+}
+
+#endif
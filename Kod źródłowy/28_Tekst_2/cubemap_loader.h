@@ -0,0 +1,220 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Skybox cubemap of lesson 28, faces decoded in parallel and cached with their
+// mips. Included by main.cpp after its declarations.
+#ifndef TEKST_2_CUBEMAP_LOADER_H
+#define TEKST_2_CUBEMAP_LOADER_H
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+//******************************************************************************
+int loadCubemap(std::string file_name, std::uint64_t source_hash);
+int saveCubemap(std::string file_name, std::uint64_t source_hash,
+                const std::vector<MipChain> &faces);
+void loadTextureSkybox(JobSystem &jobs, std::string front, std::string back, std::string left,
+                       std::string right, std::string up, std::string down,
+                       GLuint &texture_handle);
+//*************************************************************************************************
+void loadTextureSkybox(JobSystem &jobs, std::string front, std::string back, std::string left,
+                       std::string right, std::string up, std::string down,
+                       GLuint &texture_handle)
+{
+    std::string textures[] = {right, left, down, up, back, front};
+
+    // Whole cubemap with mips is cached in one file, keyed by all six source images
+    std::uint64_t source_hash = 14695981039346656037ull;
+    for (int i = 0; i < 6; i++)
+    {
+        std::uint64_t face_hash = 0;
+        if (hashFile(textures[i], face_hash))
+        {
+            std::cout << "Unable to load texture \"" << textures[i] << "\"." << std::endl;
+            return;
+        }
+
+        source_hash = hashData(&face_hash, sizeof(face_hash), source_hash);
+    }
+
+    std::string cache_file_name = front.substr(0, front.find_last_of('_')) + ".cube";
+
+    glGenTextures(1, &texture_handle);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture_handle);
+
+    if (loadCubemap(cache_file_name, source_hash) == 0)
+        std::cout << "Skybox loaded from \"" << cache_file_name << "\"." << std::endl;
+    else
+    {
+        // One task per face, the row bands of its mip chain are stolen by idle threads
+        std::vector<MipChain> faces(6);
+        std::vector<int> results(6, -1);
+
+        JobSystem::Job faces_job = jobs.parallelFor(0, 6, 1, [&](int first, int last) {
+            for (int i = first; i < last; i++)
+            {
+                Texture texture;
+                if (loadTexture(textures[i], texture))
+                    continue;
+
+                results[i] = generateMipChain(texture, MipFilter::BOX, true, &jobs, faces[i]);
+                freeTextureData(texture);
+            }
+        });
+        jobs.wait(faces_job);
+
+        for (int i = 0; i < 6; i++)
+        {
+            if (results[i] || faces[i].bpp != faces[0].bpp ||
+                faces[i].levels.size() != faces[0].levels.size() ||
+                faces[i].levels[0].width != faces[0].levels[0].width ||
+                faces[i].levels[0].height != faces[0].levels[0].height)
+            {
+                std::cout << "Skybox face \"" << textures[i] << "\" format error." << std::endl;
+                glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+                return;
+            }
+        }
+
+        GLint unpack_alignment = 0;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_alignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        GLint internal_format = faces[0].bpp == 24 ? GL_RGB : GL_RGBA;
+        GLenum format = faces[0].bpp == 24 ? GL_BGR : GL_BGRA;
+
+        for (int i = 0; i < 6; i++)
+        {
+            for (unsigned int l = 0; l < faces[i].levels.size(); l++)
+            {
+                const MipLevel &level = faces[i].levels[l];
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, l, internal_format, level.width,
+                             level.height, 0, format, GL_UNSIGNED_BYTE, level.bits.data());
+            }
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment);
+
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, faces[0].levels.size() - 1);
+
+        if (saveCubemap(cache_file_name, source_hash, faces))
+            std::cout << "Unable to write cubemap cache \"" << cache_file_name << "\"."
+                      << std::endl;
+    }
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+//*************************************************************************************************
+int loadCubemap(std::string file_name, std::uint64_t source_hash)
+{
+    std::ifstream cache_file(file_name, std::ios::in | std::ios::binary);
+    if (!cache_file.is_open())
+        return -1;
+
+    char magic[4] = {0, 0, 0, 0};
+    std::uint64_t stored_hash = 0;
+    std::uint32_t bpp = 0;
+    std::uint32_t levels_count = 0;
+
+    cache_file.read(magic, sizeof(magic));
+    cache_file.read(reinterpret_cast<char*>(&stored_hash), sizeof(stored_hash));
+    cache_file.read(reinterpret_cast<char*>(&bpp), sizeof(bpp));
+    cache_file.read(reinterpret_cast<char*>(&levels_count), sizeof(levels_count));
+
+    if (!cache_file || std::string(magic, 4) != "CUB1" || stored_hash != source_hash ||
+        (bpp != 24 && bpp != 32) || levels_count == 0 || levels_count > 32)
+        return -1;
+
+    std::vector<std::uint32_t> level_sizes(levels_count * 3);
+    cache_file.read(reinterpret_cast<char*>(level_sizes.data()),
+                    level_sizes.size() * sizeof(std::uint32_t));
+    if (!cache_file)
+        return -1;
+
+    std::size_t face_size = 0;
+    for (unsigned int l = 0; l < levels_count; l++)
+    {
+        if (level_sizes[l * 3 + 2] < level_sizes[l * 3] * bpp / 8)
+            return -1;
+
+        face_size += static_cast<std::size_t>(level_sizes[l * 3 + 2]) * level_sizes[l * 3 + 1];
+    }
+
+    // All faces come with a single read, levels are uploaded straight from the buffer
+    std::vector<BYTE> bits(face_size * 6);
+    cache_file.read(reinterpret_cast<char*>(bits.data()), bits.size());
+    if (!cache_file)
+        return -1;
+
+    GLint unpack_alignment = 0;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    GLint internal_format = bpp == 24 ? GL_RGB : GL_RGBA;
+    GLenum format = bpp == 24 ? GL_BGR : GL_BGRA;
+
+    const BYTE *level_bits = bits.data();
+    for (int i = 0; i < 6; i++)
+    {
+        for (unsigned int l = 0; l < levels_count; l++)
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, l, internal_format,
+                         level_sizes[l * 3], level_sizes[l * 3 + 1], 0, format,
+                         GL_UNSIGNED_BYTE, level_bits);
+
+            level_bits += static_cast<std::size_t>(level_sizes[l * 3 + 2]) *
+                          level_sizes[l * 3 + 1];
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment);
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels_count - 1);
+
+    return 0;
+}
+//*************************************************************************************************
+int saveCubemap(std::string file_name, std::uint64_t source_hash,
+                const std::vector<MipChain> &faces)
+{
+    std::ofstream cache_file(file_name, std::ios::out | std::ios::binary);
+    if (!cache_file.is_open())
+        return -1;
+
+    std::uint32_t bpp = faces[0].bpp;
+    std::uint32_t levels_count = faces[0].levels.size();
+
+    cache_file.write("CUB1", 4);
+    cache_file.write(reinterpret_cast<const char*>(&source_hash), sizeof(source_hash));
+    cache_file.write(reinterpret_cast<const char*>(&bpp), sizeof(bpp));
+    cache_file.write(reinterpret_cast<const char*>(&levels_count), sizeof(levels_count));
+
+    for (const auto &level : faces[0].levels)
+    {
+        std::uint32_t size[3] = {level.width, level.height, level.pitch};
+        cache_file.write(reinterpret_cast<const char*>(size), sizeof(size));
+    }
+
+    for (const auto &face : faces)
+    {
+        for (const auto &level : face.levels)
+            cache_file.write(reinterpret_cast<const char*>(level.bits.data()), level.bits.size());
+    }
+
+    if (!cache_file)
+        return -1;
+
+    return 0;
+}
+
+#endif
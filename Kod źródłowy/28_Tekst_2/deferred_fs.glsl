@@ -0,0 +1,105 @@
+#version 330
+
+uniform sampler2D albedo_specular_buffer;
+uniform sampler2D normal_buffer;
+uniform sampler2D depth_buffer;
+
+// Three texels per light: view position and radius, colour and spot cutoff, view direction
+uniform samplerBuffer light_data;
+// Offset and count into light_indices for every cluster
+uniform usamplerBuffer light_clusters;
+uniform usamplerBuffer light_indices;
+// Viewport size in pixels, scale and bias of the logarithmic depth slices
+uniform vec4 cluster_grid;
+
+uniform mat4 inverse_projection_matrix;
+
+out vec4 frag_colour;
+
+const uvec3 clusters_count = uvec3(16u, 9u, 24u);
+
+vec3 ambient_color = vec3(0.4, 0.4, 0.4);
+vec3 specular_color = vec3(1.0, 1.0, 1.0);
+
+vec3 object_ambient_factor = vec3(1.0, 1.0, 1.0);
+vec3 object_diffuse_factor = vec3(0.5, 0.5, 0.5);
+
+vec3 decodeNormal(vec2 encoded)
+{
+   vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+   float fold = max(-normal.z, 0.0);
+   normal.x += normal.x >= 0.0 ? -fold : fold;
+   normal.y += normal.y >= 0.0 ? -fold : fold;
+
+   return normalize(normal);
+}
+
+void main()
+{
+   ivec2 pixel = ivec2(gl_FragCoord.xy);
+   float depth = texelFetch(depth_buffer, pixel, 0).r;
+
+   // Nothing was drawn here, the skybox stays visible
+   if (depth == 1.0)
+      discard;
+
+   // View space position rebuilt from the depth buffer
+   vec2 screen_position = gl_FragCoord.xy / vec2(textureSize(depth_buffer, 0));
+   vec4 clip_position = vec4(vec3(screen_position, depth) * 2.0 - 1.0, 1.0);
+   vec4 view_position = inverse_projection_matrix * clip_position;
+   vec3 vertex_to_camera = view_position.xyz / view_position.w;
+
+   vec4 albedo_specular = texelFetch(albedo_specular_buffer, pixel, 0);
+   vec3 normal_to_camera = decodeNormal(texelFetch(normal_buffer, pixel, 0).xy);
+
+   // Ambient
+   vec3 ambient_intense = ambient_color * object_ambient_factor;
+
+   // Cluster of this pixel
+   uint slice = uint(clamp(log(-vertex_to_camera.z) * cluster_grid.z - cluster_grid.w, 0.0,
+                           float(clusters_count.z - 1u)));
+   // Same NDC tiles the lights are binned into on the CPU
+   uvec2 tile = min(uvec2(gl_FragCoord.xy * vec2(clusters_count.xy) / cluster_grid.xy),
+                    clusters_count.xy - 1u);
+   uint cluster = tile.x + clusters_count.x * (tile.y + clusters_count.y * slice);
+   uvec2 light_range = texelFetch(light_clusters, int(cluster)).xy;
+
+   vec3 surface_to_camera = normalize(-vertex_to_camera);
+   vec3 diffuse_intense = vec3(0.0);
+   vec3 specular_intense = vec3(0.0);
+
+   for (uint i = 0u; i < light_range.y; i++)
+   {
+      int light = int(texelFetch(light_indices, int(light_range.x + i)).x) * 3;
+      vec4 position_radius = texelFetch(light_data, light);
+      vec4 colour_cutoff = texelFetch(light_data, light + 1);
+
+      vec3 distance_to_light = position_radius.xyz - vertex_to_camera;
+      float light_distance = length(distance_to_light);
+      vec3 light_direction = distance_to_light / light_distance;
+
+      float attenuation = clamp(1.0 - light_distance / position_radius.w, 0.0, 1.0);
+      attenuation *= attenuation;
+
+      if (colour_cutoff.w > -1.0)
+      {
+         vec3 spot_direction = texelFetch(light_data, light + 2).xyz;
+         float spot_cosine = dot(-light_direction, spot_direction);
+         attenuation *= clamp((spot_cosine - colour_cutoff.w) / 0.1, 0.0, 1.0);
+      }
+
+      // Diffuse
+      float dot_product = max(dot(light_direction, normal_to_camera), 0.0);
+      diffuse_intense += colour_cutoff.rgb * object_diffuse_factor * dot_product * attenuation;
+
+      // Specular
+      vec3 reflection = reflect(-light_direction, normal_to_camera);
+      float dot_specular = max(dot(reflection, surface_to_camera), 0.0);
+      float specular_power = 10.0;
+      float specular_factor = pow(dot_specular, specular_power);
+      specular_intense += specular_color * albedo_specular.a * specular_factor * attenuation;
+   }
+
+   frag_colour = vec4(ambient_intense + diffuse_intense + specular_intense, 1.0) *
+                 vec4(albedo_specular.rgb, 1.0);
+}
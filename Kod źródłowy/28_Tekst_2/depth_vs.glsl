@@ -0,0 +1,17 @@
+#version 330
+layout(location = 0) in vec3 position;
+
+layout(std140) uniform Object
+{
+    mat4 mvp_matrix;
+    mat4 model_view_matrix;
+    mat4 normal_matrix;
+};
+
+// Same expression as mesh_vs.glsl, both passes must produce identical depth
+invariant gl_Position;
+ 
+void main() 
+{
+   gl_Position = mvp_matrix * vec4(position, 1.0);
+}
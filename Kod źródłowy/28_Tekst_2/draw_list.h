@@ -0,0 +1,285 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Draw list of lesson 28, built on the job system and replayed by the GL thread. Included by
+// main.cpp after its declarations.
+#ifndef TEKST_2_DRAW_LIST_H
+#define TEKST_2_DRAW_LIST_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+//******************************************************************************
+// Draw packets of every object in view, built on worker threads and replayed by the GL thread
+class DrawListBuilder
+{
+public:
+    DrawListBuilder(JobSystem &jobs)
+    {
+        jobs_ = &jobs;
+        bands_count_ = jobs.getThreadsCount();
+        band_packets_.resize(bands_count_);
+        band_culled_.resize(bands_count_);
+        band_detail_culled_.resize(bands_count_);
+    }
+
+    // Culling, detail selection, object uniform packing and sorting, split into bands of
+    // objects and draw items so no two jobs write the same data
+    void build(const MeshHandle &mesh, const std::vector<glm::mat4> &model_matrices,
+               FrameUniforms &frame_uniforms, const glm::mat4 &view_matrix,
+               const glm::mat4 &projection_matrix, int viewport_height,
+               DepthOrder depth_order)
+    {
+        auto start_time = std::chrono::steady_clock::now();
+
+        items_.clear();
+        assert(mesh.size() <= 1u << BATCH_BITS);
+        for (std::size_t m = 0; m < mesh.size(); m++)
+        {
+            assert(mesh[m]->ranges.size() <= 1u << RANGE_BITS);
+            for (std::size_t r = 0; r < mesh[m]->ranges.size(); r++)
+            {
+                Item item;
+                item.mesh = mesh[m];
+                item.range = &mesh[m]->ranges[r];
+                item.batch = static_cast<unsigned int>(m);
+                item.index = static_cast<unsigned int>(r);
+                items_.push_back(item);
+            }
+        }
+
+        unsigned int objects_count = static_cast<unsigned int>(model_matrices.size());
+        unsigned int first_object = frame_uniforms.reserveObjects(objects_count);
+
+        // Planes point inside, taken from the rows of the view projection matrix
+        glm::mat4 view_projection_matrix = projection_matrix * view_matrix;
+        glm::vec4 planes[6];
+        for (int i = 0; i < 3; i++)
+        {
+            glm::vec4 row_w(view_projection_matrix[0][3], view_projection_matrix[1][3],
+                            view_projection_matrix[2][3], view_projection_matrix[3][3]);
+            glm::vec4 row(view_projection_matrix[0][i], view_projection_matrix[1][i],
+                          view_projection_matrix[2][i], view_projection_matrix[3][i]);
+            planes[i * 2] = row_w + row;
+            planes[i * 2 + 1] = row_w - row;
+        }
+
+        for (auto &plane : planes)
+            plane /= glm::length(glm::vec3(plane));
+
+        glm::vec3 eye = glm::vec3(glm::inverse(view_matrix)[3]);
+        float pixels_scale = projection_matrix[1][1] * viewport_height;
+        std::size_t items_count = items_.size() * objects_count;
+
+        auto build_band = [&](int band) {
+            for (std::size_t o = objects_count * band / bands_count_;
+                 o < objects_count * (band + 1) / bands_count_; o++)
+                frame_uniforms.packObject(first_object + static_cast<unsigned int>(o),
+                                          model_matrices[o]);
+
+            std::vector<Packet> &packets = band_packets_[band];
+            packets.clear();
+            band_culled_[band] = 0;
+            band_detail_culled_[band] = 0;
+
+            for (std::size_t i = items_count * band / bands_count_;
+                 i < items_count * (band + 1) / bands_count_; i++)
+            {
+                unsigned int object = static_cast<unsigned int>(i / items_.size());
+                const Item &item = items_[i % items_.size()];
+                const glm::mat4 &model_matrix = model_matrices[object];
+
+                glm::vec3 center = glm::vec3(model_matrix * glm::vec4(item.range->center, 1.0f));
+                float radius = item.range->radius * glm::length(glm::vec3(model_matrix[0]));
+
+                bool visible = true;
+                for (int p = 0; p < 6 && visible; p++)
+                    visible = glm::dot(glm::vec3(planes[p]), center) + planes[p].w >= -radius;
+
+                if (!visible)
+                {
+                    band_culled_[band]++;
+                    continue;
+                }
+
+                // Detail level from the projected size, tiny meshes are dropped and small
+                // ones are left out of the depth pre-pass
+                float distance = glm::length(center - eye);
+                float pixels = distance > radius ? radius * pixels_scale / distance :
+                                                   static_cast<float>(viewport_height);
+                if (pixels < MIN_PIXELS)
+                {
+                    band_detail_culled_[band]++;
+                    continue;
+                }
+
+                Packet packet;
+                packet.mesh = item.mesh;
+                packet.range = item.range;
+                packet.object = first_object + object;
+                packet.occluder = pixels >= OCCLUDER_PIXELS;
+
+                // File order keeps the batches together, then the ranges of one object in
+                // vertex order, otherwise nearest first
+                if (depth_order == DepthOrder::FILE_ORDER)
+                {
+                    packet.sort_key = static_cast<std::uint64_t>(item.batch) << (64 - BATCH_BITS) |
+                                      static_cast<std::uint64_t>(object) << RANGE_BITS |
+                                      item.index;
+                }
+                else
+                {
+                    std::uint32_t distance_bits = 0;
+                    std::memcpy(&distance_bits, &distance, sizeof(distance_bits));
+                    packet.sort_key = static_cast<std::uint64_t>(distance_bits) << 32 |
+                                      static_cast<std::uint32_t>(i);
+                }
+
+                packets.push_back(packet);
+            }
+
+            std::sort(packets.begin(), packets.end(), [](const Packet &a, const Packet &b) {
+                return a.sort_key < b.sort_key;
+            });
+        };
+
+        JobSystem::Job job = jobs_->parallelFor(0, static_cast<int>(bands_count_), 1,
+                                                [&](int first, int last) {
+                                                    for (int band = first; band < last; band++)
+                                                        build_band(band);
+                                                });
+        jobs_->wait(job);
+
+        // Sorted bands are merged on the GL thread
+        packets_.clear();
+        culled_count_ = 0;
+        detail_culled_count_ = 0;
+        for (unsigned int band = 0; band < bands_count_; band++)
+        {
+            std::size_t middle = packets_.size();
+            packets_.insert(packets_.end(), band_packets_[band].begin(),
+                            band_packets_[band].end());
+            std::inplace_merge(packets_.begin(), packets_.begin() + middle, packets_.end(),
+                               [](const Packet &a, const Packet &b) {
+                                   return a.sort_key < b.sort_key;
+                               });
+
+            culled_count_ += band_culled_[band];
+            detail_culled_count_ += band_detail_culled_[band];
+        }
+
+        build_time_ = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start_time).count();
+    }
+
+    // Neighbouring packets of one vertex array and object are submitted as one draw call
+    void draw(FrameUniforms &frame_uniforms, bool depth_only) const
+    {
+        unsigned int bound_object = std::numeric_limits<unsigned int>::max();
+
+        for (std::size_t i = 0; i < packets_.size();)
+        {
+            const Packet &packet = packets_[i++];
+            if (depth_only && !packet.occluder)
+                continue;
+
+            GLint first = packet.range->first;
+            GLsizei count = packet.range->count;
+            while (i < packets_.size() && packets_[i].mesh == packet.mesh &&
+                   packets_[i].object == packet.object &&
+                   packets_[i].range->first == first + count &&
+                   (!depth_only || packets_[i].occluder))
+                count += packets_[i++].range->count;
+
+            if (packet.object != bound_object)
+            {
+                frame_uniforms.bindObject(packet.object);
+                bound_object = packet.object;
+            }
+
+            if (depth_only)
+            {
+                gl_state.bindVertexArray(packet.mesh->depth_handle);
+            }
+            else
+            {
+                gl_state.bindVertexArray(packet.mesh->handle);
+                gl_state.bindTexture(0, GL_TEXTURE_2D_ARRAY, packet.mesh->diffuse_texture);
+            }
+
+            drawArrays(GL_TRIANGLES, first, count);
+        }
+    }
+
+    double getBuildTime() const
+    {
+        return build_time_;
+    }
+
+    unsigned int getCulledCount() const
+    {
+        return culled_count_;
+    }
+
+    unsigned int getDetailCulledCount() const
+    {
+        return detail_culled_count_;
+    }
+
+    unsigned int getPacketsCount() const
+    {
+        return static_cast<unsigned int>(packets_.size());
+    }
+
+    unsigned int getThreadsCount() const
+    {
+        return jobs_->getThreadsCount();
+    }
+
+protected:
+    struct Item
+    {
+        const Mesh *mesh = nullptr;
+        const MeshRange *range = nullptr;
+        unsigned int batch = 0;
+        // Range within the batch
+        unsigned int index = 0;
+    };
+
+    struct Packet
+    {
+        std::uint64_t sort_key = 0;
+        const Mesh *mesh = nullptr;
+        const MeshRange *range = nullptr;
+        unsigned int object = 0;
+        bool occluder = false;
+    };
+
+    // Projected diameter in pixels
+    static const unsigned int MIN_PIXELS = 1;
+    static const unsigned int OCCLUDER_PIXELS = 32;
+
+    // File order key: batch, the full 32 bit object and the range within the batch
+    static const unsigned int BATCH_BITS = 12;
+    static const unsigned int RANGE_BITS = 20;
+
+protected:
+    JobSystem *jobs_{nullptr};
+    double build_time_{0.0};
+    std::vector<std::vector<Packet>> band_packets_;
+    std::vector<unsigned int> band_culled_;
+    std::vector<unsigned int> band_detail_culled_;
+    std::vector<Item> items_;
+    std::vector<Packet> packets_;
+    unsigned int culled_count_{0};
+    unsigned int detail_culled_count_{0};
+    unsigned int bands_count_{1};
+
+};
+
+#endif
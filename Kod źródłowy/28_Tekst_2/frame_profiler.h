@@ -0,0 +1,277 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// CPU and GPU timing of the passes of lesson 28. Included by main.cpp after its declarations.
+#ifndef TEKST_2_FRAME_PROFILER_H
+#define TEKST_2_FRAME_PROFILER_H
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+//******************************************************************************
+// CPU and GPU time of named passes, GPU results are read once available so nothing stalls
+class FrameProfiler
+{
+public:
+    FrameProfiler(unsigned int history_frames)
+    {
+        history_frames_ = history_frames;
+        start_time_ = std::chrono::steady_clock::now();
+    }
+
+    ~FrameProfiler()
+    {
+        for (auto &queries : queries_)
+            if (!queries.empty())
+                glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+    }
+
+    // Collects the finished frames oldest first, the set about to be reused gives up the
+    // results the GPU has not delivered yet instead of waiting for them
+    void beginFrame()
+    {
+        while (!open_scopes_.empty())
+            endScope();
+
+        frame_++;
+        current_set_ = frame_ % QUERY_SETS_COUNT;
+
+        for (unsigned int i = 0; i < QUERY_SETS_COUNT; i++)
+        {
+            if (!resolveSet((current_set_ + i) % QUERY_SETS_COUNT, i == 0))
+                break;
+        }
+
+        while (!history_.empty() && history_.front().frame + history_frames_ <= frame_)
+            history_.pop_front();
+    }
+
+    // Scopes nest on the CPU, GL_TIME_ELAPSED queries cannot, so only the outer one is timed
+    void beginScope(const std::string &name, bool gpu_timing = true)
+    {
+        Scope scope;
+        scope.name = name;
+        scope.frame = frame_;
+        scope.depth = static_cast<unsigned int>(open_scopes_.size());
+        scope.cpu_begin = getCPUTime();
+
+        if (gpu_timing && gpu_scope_ < 0)
+        {
+            std::vector<GLuint> &queries = queries_[current_set_];
+            if (queries_used_[current_set_] == queries.size())
+            {
+                queries.push_back(0);
+                glGenQueries(1, &queries.back());
+            }
+
+            scope.query = static_cast<int>(queries_used_[current_set_]++);
+            glBeginQuery(GL_TIME_ELAPSED, queries[scope.query]);
+            gpu_scope_ = static_cast<int>(scopes_[current_set_].size());
+        }
+
+        open_scopes_.push_back(scopes_[current_set_].size());
+        scopes_[current_set_].push_back(scope);
+    }
+
+    void endScope()
+    {
+        if (open_scopes_.empty())
+        {
+            std::cout << "Profiler scope ended without a begin." << std::endl;
+            return;
+        }
+
+        std::size_t scope_index = open_scopes_.back();
+        open_scopes_.pop_back();
+
+        Scope &scope = scopes_[current_set_][scope_index];
+        scope.cpu_end = getCPUTime();
+
+        if (gpu_scope_ == static_cast<int>(scope_index))
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            gpu_scope_ = -1;
+        }
+    }
+
+    // Chrome trace_event format, open in chrome://tracing or ui.perfetto.dev
+    int exportTrace(std::string file_name, unsigned int first_frame, unsigned int last_frame)
+    {
+        std::ofstream trace_file(file_name, std::ios::out);
+        if (!trace_file.is_open())
+        {
+            std::cout << "Error creating trace file \"" << file_name << "\"." << std::endl;
+            return -1;
+        }
+
+        trace_file << "{\"traceEvents\":[\n"
+                   << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+                   << "\"args\":{\"name\":\"CPU\"}},\n"
+                   << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,"
+                   << "\"args\":{\"name\":\"GPU\"}}";
+
+        unsigned int events_count = 0;
+        for (const auto &scope : history_)
+        {
+            if (scope.frame < first_frame || scope.frame > last_frame)
+                continue;
+
+            writeTraceEvent(trace_file, scope, 1, scope.cpu_end - scope.cpu_begin);
+
+            // GPU duration is placed at the CPU submission time, queries carry no timestamp
+            if (scope.gpu_time >= 0.0)
+                writeTraceEvent(trace_file, scope, 2, scope.gpu_time);
+
+            events_count++;
+        }
+
+        trace_file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+        if (!trace_file)
+            return -1;
+
+        std::cout << "Trace of frames " << first_frame << "-" << last_frame << " (" << events_count
+                  << " scopes) saved to \"" << file_name << "\"." << std::endl;
+
+        return 0;
+    }
+
+    // Milliseconds, from the newest frame whose queries have been read
+    double getGPUTime(const std::string &name) const
+    {
+        return getGPUTime(name, last_resolved_frame_);
+    }
+
+    // Milliseconds, 0 when the scope did not run or the frame left the history
+    double getGPUTime(const std::string &name, unsigned int frame) const
+    {
+        for (auto it = history_.rbegin(); it != history_.rend(); ++it)
+        {
+            if (it->frame > frame)
+                continue;
+            if (it->frame < frame)
+                break;
+
+            if (it->name == name && it->gpu_time >= 0.0)
+                return it->gpu_time / 1000.0;
+        }
+
+        return 0.0;
+    }
+
+    unsigned int getFrame() const
+    {
+        return frame_;
+    }
+
+    unsigned int getLastResolvedFrame() const
+    {
+        return last_resolved_frame_;
+    }
+
+    // Frames whose GPU times were given up because the GPU was too far behind
+    unsigned int getSkippedFrames() const
+    {
+        return skipped_frames_;
+    }
+
+protected:
+    // Times in microseconds since the profiler was created
+    struct Scope
+    {
+        std::string name;
+        unsigned int frame = 0;
+        unsigned int depth = 0;
+        double cpu_begin = 0.0;
+        double cpu_end = 0.0;
+        double gpu_time = -1.0;
+        int query = -1;
+    };
+
+    double getCPUTime() const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() -
+                                                         start_time_).count();
+    }
+
+    // Queries finish in order, so the last one of the set tells whether all results are in.
+    // Returns false when they are not and the set is kept for a later frame.
+    bool resolveSet(unsigned int set, bool reuse)
+    {
+        std::vector<Scope> &scopes = scopes_[set];
+        if (scopes.empty())
+            return true;
+
+        GLuint available = GL_TRUE;
+        if (queries_used_[set] > 0)
+            glGetQueryObjectuiv(queries_[set][queries_used_[set] - 1],
+                                GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (!available && !reuse)
+            return false;
+
+        for (auto &scope : scopes)
+        {
+            if (scope.query >= 0 && available)
+            {
+                GLuint64 elapsed_time = 0;
+                glGetQueryObjectui64v(queries_[set][scope.query], GL_QUERY_RESULT,
+                                      &elapsed_time);
+                scope.gpu_time = elapsed_time / 1000.0;
+            }
+
+            history_.push_back(scope);
+        }
+
+        last_resolved_frame_ = scopes.front().frame;
+
+        // Queries still in flight are dropped, new ones are generated on the next use
+        if (!available)
+        {
+            glDeleteQueries(static_cast<GLsizei>(queries_[set].size()), queries_[set].data());
+            queries_[set].clear();
+            skipped_frames_++;
+        }
+
+        scopes.clear();
+        queries_used_[set] = 0;
+
+        return true;
+    }
+
+    static void writeTraceEvent(std::ofstream &trace_file, const Scope &scope, int thread,
+                                double duration)
+    {
+        trace_file << ",\n{\"name\":\"" << scope.name << "\",\"cat\":\""
+                   << (thread == 1 ? "cpu" : "gpu") << "\",\"ph\":\"X\",\"ts\":" << scope.cpu_begin
+                   << ",\"dur\":" << duration << ",\"pid\":1,\"tid\":" << thread
+                   << ",\"args\":{\"frame\":" << scope.frame << ",\"depth\":" << scope.depth
+                   << "}}";
+    }
+
+    // Frames the GPU may fall behind before results are skipped
+    static const unsigned int QUERY_SETS_COUNT = 4;
+
+protected:
+    int gpu_scope_{-1};
+    std::chrono::steady_clock::time_point start_time_;
+    std::deque<Scope> history_;
+    std::size_t queries_used_[QUERY_SETS_COUNT] = {};
+    std::vector<GLuint> queries_[QUERY_SETS_COUNT];
+    std::vector<Scope> scopes_[QUERY_SETS_COUNT];
+    std::vector<std::size_t> open_scopes_;
+    unsigned int current_set_{0};
+    unsigned int frame_{0};
+    unsigned int history_frames_{0};
+    unsigned int last_resolved_frame_{0};
+    unsigned int skipped_frames_{0};
+
+};
+
+#endif
@@ -0,0 +1,142 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Window state of lesson 28 sampled on the event thread and handed to the render loop.
+// Included by main.cpp after its declarations.
+#ifndef TEKST_2_FRAME_SNAPSHOT_QUEUE_H
+#define TEKST_2_FRAME_SNAPSHOT_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+//******************************************************************************
+// Keyboard shortcuts, edge detected by the render loop
+enum ShortcutKey
+{
+    SHORTCUT_RESIDENCY_STATS = 1 << 0,
+    SHORTCUT_DEFERRED = 1 << 1,
+    SHORTCUT_DEPTH_ORDER = 1 << 2,
+    SHORTCUT_TRACE = 1 << 3,
+    SHORTCUT_CSV = 1 << 4,
+    SHORTCUT_OVERDRAW_VIEW = 1 << 5,
+};
+
+// Everything the render loop needs from the window, sampled together on the event thread
+struct FrameSnapshot
+{
+    InputState input;
+    std::chrono::steady_clock::time_point sample_time;
+    int window_height = 0;
+    int window_width = 0;
+    std::uint8_t shortcuts = 0;
+};
+
+FrameSnapshot sampleFrameSnapshot();
+std::uint8_t readShortcutKeys();
+
+// Lock-free triple buffer between the event thread and the render thread. The event thread
+// always has a free slot to write, the render thread always takes the newest whole snapshot.
+class FrameSnapshotQueue
+{
+public:
+    FrameSnapshotQueue(unsigned int latency_history_size)
+    {
+        latencies_.resize(latency_history_size, 0.0f);
+    }
+
+    // Event thread only, an unread snapshot in the middle slot is replaced
+    void publish(const FrameSnapshot &snapshot)
+    {
+        slots_[write_slot_] = snapshot;
+        unsigned int previous = middle_slot_.exchange(write_slot_ | FRESH_SLOT,
+                                                      std::memory_order_acq_rel);
+        write_slot_ = previous & ~FRESH_SLOT;
+    }
+
+    // Render thread only, false when nothing newer than the last snapshot was published
+    bool acquire(FrameSnapshot &snapshot)
+    {
+        bool fresh = (middle_slot_.load(std::memory_order_relaxed) & FRESH_SLOT) != 0;
+        if (fresh)
+            read_slot_ = middle_slot_.exchange(read_slot_, std::memory_order_acq_rel) &
+                         ~FRESH_SLOT;
+        else
+            stale_frames_++;
+
+        snapshot = slots_[read_slot_];
+        return fresh;
+    }
+
+    // Time from sampling the input to the end of the swap of the frame it was applied to
+    void addLatency(const FrameSnapshot &snapshot)
+    {
+        latencies_[next_latency_] = std::chrono::duration<float, std::milli>(
+            std::chrono::steady_clock::now() - snapshot.sample_time).count();
+        next_latency_ = (next_latency_ + 1) % latencies_.size();
+        latencies_count_ = std::min(latencies_count_ + 1, latencies_.size());
+    }
+
+    FrameTimeStats getLatencyStats() const
+    {
+        return calculateFrameTimeStats(std::vector<float>(latencies_.begin(),
+                                                          latencies_.begin() + latencies_count_));
+    }
+
+    // Frames rendered again with the input of the previous frame
+    unsigned int getStaleFramesCount() const
+    {
+        return stale_frames_;
+    }
+
+protected:
+    static const unsigned int FRESH_SLOT = 4;
+
+protected:
+    FrameSnapshot slots_[3];
+    std::atomic<unsigned int> middle_slot_{1};
+    std::size_t latencies_count_{0};
+    std::size_t next_latency_{0};
+    std::vector<float> latencies_;
+    unsigned int read_slot_{2};
+    unsigned int stale_frames_{0};
+    unsigned int write_slot_{0};
+
+};
+//*************************************************************************************************
+std::uint8_t readShortcutKeys()
+{
+    const std::pair<int, std::uint8_t> keys[] = {
+        {GLFW_KEY_R, SHORTCUT_RESIDENCY_STATS},
+        {GLFW_KEY_G, SHORTCUT_DEFERRED},
+        {GLFW_KEY_Z, SHORTCUT_DEPTH_ORDER},
+        {GLFW_KEY_T, SHORTCUT_TRACE},
+        {GLFW_KEY_C, SHORTCUT_CSV},
+        {GLFW_KEY_O, SHORTCUT_OVERDRAW_VIEW},
+    };
+
+    std::uint8_t shortcuts = 0;
+    for (const auto &key : keys)
+        if (glfwGetKey(window_handle, key.first) == GLFW_PRESS)
+            shortcuts |= key.second;
+
+    return shortcuts;
+}
+//*************************************************************************************************
+// GLFW input and window functions belong to the thread that polls the events
+FrameSnapshot sampleFrameSnapshot()
+{
+    FrameSnapshot snapshot;
+    snapshot.input = readInput();
+    snapshot.shortcuts = readShortcutKeys();
+    snapshot.sample_time = std::chrono::steady_clock::now();
+    glfwGetWindowSize(window_handle, &snapshot.window_width, &snapshot.window_height);
+
+    return snapshot;
+}
+
+#endif
@@ -0,0 +1,149 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Camera and per object uniform blocks of lesson 28, matrices precomputed on the CPU.
+// Included by main.cpp after its declarations.
+#ifndef TEKST_2_FRAME_UNIFORMS_H
+#define TEKST_2_FRAME_UNIFORMS_H
+
+#include <cstring>
+#include <vector>
+//******************************************************************************
+class FrameUniforms
+{
+public:
+    FrameUniforms(unsigned int max_objects, StreamingBuffer &streaming_buffer)
+    {
+        max_objects_ = max_objects;
+        streaming_buffer_ = &streaming_buffer;
+
+        // Each block must start at the offset alignment for glBindBufferRange
+        GLint offset_alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+        offset_alignment_ = offset_alignment;
+        object_stride_ = (sizeof(ObjectBlock) + offset_alignment - 1) / offset_alignment *
+                         offset_alignment;
+
+        object_data_.resize(object_stride_ * max_objects_);
+    }
+
+    unsigned int addObject(const glm::mat4 &model_matrix)
+    {
+        unsigned int object = reserveObjects(1);
+        packObject(object, model_matrix);
+
+        return object;
+    }
+
+    void bindObject(unsigned int object)
+    {
+        gl_state.bindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BINDING, object_buffer_,
+                                 object_offset_ + object * object_stride_, sizeof(ObjectBlock));
+    }
+
+    // Matrices are combined once here instead of once per vertex, threads may pack different
+    // reserved objects at the same time
+    void packObject(unsigned int object, const glm::mat4 &model_matrix)
+    {
+        glm::mat4 model_view_matrix = camera_block_.view_matrix * model_matrix;
+
+        ObjectBlock object_block;
+        object_block.mvp_matrix = camera_block_.projection_matrix * model_view_matrix;
+        object_block.model_view_matrix = model_view_matrix;
+        object_block.normal_matrix = glm::transpose(glm::inverse(model_view_matrix));
+
+        std::memcpy(object_data_.data() + object * object_stride_, &object_block,
+                    sizeof(object_block));
+    }
+
+    // Staging data grows past the initial object count, the buffer is resized on upload
+    unsigned int reserveObjects(unsigned int count)
+    {
+        unsigned int first_object = objects_count_;
+        objects_count_ += count;
+
+        if (objects_count_ > max_objects_)
+        {
+            max_objects_ = objects_count_;
+            object_data_.resize(object_stride_ * max_objects_);
+        }
+
+        return first_object;
+    }
+
+    // Connects the blocks declared by a program to the shared binding points
+    void bindProgram(GLuint shader_program)
+    {
+        GLuint camera_block = glGetUniformBlockIndex(shader_program, "Camera");
+        if (camera_block != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader_program, camera_block, CAMERA_BINDING);
+
+        GLuint object_block = glGetUniformBlockIndex(shader_program, "Object");
+        if (object_block != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader_program, object_block, OBJECT_BINDING);
+    }
+
+    void setCamera(const glm::mat4 &view_matrix, const glm::mat4 &projection_matrix,
+                   const glm::mat4 &sky_view_matrix, const glm::vec3 &camera_position)
+    {
+        camera_block_.view_matrix = view_matrix;
+        camera_block_.projection_matrix = projection_matrix;
+        camera_block_.view_projection_matrix = projection_matrix * view_matrix;
+        camera_block_.sky_view_projection_matrix = projection_matrix * sky_view_matrix;
+        camera_block_.camera_position = glm::vec4(camera_position, 1.0f);
+    }
+
+    // One copy per block and frame into the streaming buffer, object list starts over afterwards
+    void upload()
+    {
+        GLintptr camera_offset = streaming_buffer_->upload(&camera_block_, sizeof(CameraBlock),
+                                                           offset_alignment_);
+        gl_state.bindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BINDING,
+                                 streaming_buffer_->getBuffer(), camera_offset,
+                                 sizeof(CameraBlock));
+
+        object_offset_ = streaming_buffer_->upload(object_data_.data(),
+                                                   objects_count_ * object_stride_,
+                                                   offset_alignment_);
+        object_buffer_ = streaming_buffer_->getBuffer();
+
+        objects_count_ = 0;
+    }
+
+protected:
+    // std140 layouts, must match the blocks declared in the shaders
+    struct CameraBlock
+    {
+        glm::mat4 view_matrix;
+        glm::mat4 projection_matrix;
+        glm::mat4 view_projection_matrix;
+        glm::mat4 sky_view_projection_matrix;
+        glm::vec4 camera_position;
+    };
+
+    struct ObjectBlock
+    {
+        glm::mat4 mvp_matrix;
+        glm::mat4 model_view_matrix;
+        glm::mat4 normal_matrix;
+    };
+
+    static const GLuint CAMERA_BINDING = 0;
+    static const GLuint OBJECT_BINDING = 1;
+
+protected:
+    CameraBlock camera_block_;
+    GLintptr object_offset_{0};
+    GLsizeiptr object_stride_{0};
+    GLsizeiptr offset_alignment_{0};
+    GLuint object_buffer_{0};
+    StreamingBuffer *streaming_buffer_{nullptr};
+    std::vector<BYTE> object_data_;
+    unsigned int max_objects_{0};
+    unsigned int objects_count_{0};
+
+};
+
+#endif
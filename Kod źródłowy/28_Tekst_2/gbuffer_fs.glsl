@@ -0,0 +1,32 @@
+#version 330
+in vec2 texture_coordinates;
+flat in float texture_layer;
+in vec3 vertex_to_camera;
+in vec3 normal_to_camera;
+
+uniform sampler2DArray basic_texture;
+
+layout(location = 0) out vec4 albedo_specular;
+layout(location = 1) out vec2 octahedral_normal;
+
+float specular_intensity = 1.0;
+
+// Unit normal folded onto the octahedron, two components are enough
+vec2 encodeNormal(vec3 normal)
+{
+   normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+   if (normal.z < 0.0)
+   {
+      vec2 fold_sign = vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+      normal.xy = (1.0 - abs(normal.yx)) * fold_sign;
+   }
+
+   return normal.xy;
+}
+
+void main()
+{
+   vec4 texel = texture(basic_texture, vec3(texture_coordinates, texture_layer));
+   albedo_specular = vec4(texel.rgb, specular_intensity);
+   octahedral_normal = encodeNormal(normalize(normal_to_camera));
+}
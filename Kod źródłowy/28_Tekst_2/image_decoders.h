@@ -0,0 +1,436 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Image decoding backends of lesson 28 and their benchmark. Included by main.cpp after its
+// declarations.
+#ifndef TEKST_2_IMAGE_DECODERS_H
+#define TEKST_2_IMAGE_DECODERS_H
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(USE_TURBOJPEG)
+#include <turbojpeg.h>
+#endif
+#if defined(USE_LIBPNG)
+#include <png.h>
+#endif
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+//******************************************************************************
+class ImageDecoder;
+
+int benchmarkImageDecoders(std::vector<std::string> file_names);
+int mapFile(std::string file_name, MappedFile &mapped_file);
+std::string getFileExtension(std::string file_name);
+std::vector<std::unique_ptr<ImageDecoder>>& getImageDecoders();
+void unmapFile(MappedFile &mapped_file);
+//******************************************************************************
+class ImageDecoder
+{
+public:
+    virtual ~ImageDecoder()
+    {
+    }
+
+    // Returns -1 without a message when the file isn't handled, so the next backend is tried.
+    // Decoders are shared between loading threads and must not keep any state.
+    virtual int decode(std::string file_name, Texture &texture) = 0;
+    virtual std::string getName() = 0;
+
+};
+//*************************************************************************************************
+class TgaImageDecoder : public ImageDecoder
+{
+public:
+    // Uncompressed true colour images stored bottom-up already have the GL row order, so the
+    // texture points straight into the file mapping
+    int decode(std::string file_name, Texture &texture) override
+    {
+        if (getFileExtension(file_name) != "tga")
+            return -1;
+
+        MappedFile mapping;
+        if (mapFile(file_name, mapping))
+            return -1;
+
+        const BYTE *header = mapping.data;
+        if (mapping.size < 18)
+        {
+            unmapFile(mapping);
+            return -1;
+        }
+
+        unsigned int width = header[12] | (header[13] << 8);
+        unsigned int height = header[14] | (header[15] << 8);
+        unsigned int bpp = header[16];
+        unsigned int pitch = width * bpp / 8;
+        std::size_t offset = 18 + header[0];
+
+        if (header[1] != 0 || header[2] != 2 || (bpp != 24 && bpp != 32) ||
+            (header[17] & 0x30) != 0 || width == 0 || height == 0 || pitch % 4 != 0 ||
+            offset + static_cast<std::size_t>(pitch) * height > mapping.size)
+        {
+            unmapFile(mapping);
+            return -1;
+        }
+
+        // Mapping is read only, texture data is never written to
+        texture.bits = const_cast<BYTE*>(mapping.data + offset);
+        texture.width = width;
+        texture.height = height;
+        texture.bpp = bpp;
+        texture.pitch = pitch;
+        texture.mapping = mapping;
+
+        return 0;
+    }
+
+    std::string getName() override
+    {
+        return "TGA mapping";
+    }
+
+};
+//*************************************************************************************************
+#if defined(USE_TURBOJPEG)
+class TurboJpegImageDecoder : public ImageDecoder
+{
+public:
+    int decode(std::string file_name, Texture &texture) override
+    {
+        MappedFile mapping;
+        if (mapFile(file_name, mapping))
+            return -1;
+
+        if (mapping.size < 3 || mapping.data[0] != 0xFF || mapping.data[1] != 0xD8)
+        {
+            unmapFile(mapping);
+            return -1;
+        }
+
+        int result = -1;
+
+        tjhandle decompressor = tjInitDecompress();
+        int width = 0;
+        int height = 0;
+        int subsampling = 0;
+        int colour_space = 0;
+
+        if (decompressor &&
+            tjDecompressHeader3(decompressor, mapping.data, mapping.size, &width, &height,
+                                &subsampling, &colour_space) == 0)
+        {
+            // SIMD colour conversion writes BGR rows bottom-up, like FreeImage does
+            unsigned int pitch = (width * 3 + 3) & ~3;
+            texture.pixels.resize(static_cast<std::size_t>(pitch) * height);
+
+            if (tjDecompress2(decompressor, mapping.data, mapping.size, texture.pixels.data(),
+                              width, pitch, height, TJPF_BGR, TJFLAG_BOTTOMUP) == 0)
+            {
+                texture.bits = texture.pixels.data();
+                texture.width = width;
+                texture.height = height;
+                texture.bpp = 24;
+                texture.pitch = pitch;
+
+                result = 0;
+            }
+            else
+                std::vector<BYTE>().swap(texture.pixels);
+        }
+
+        if (decompressor)
+            tjDestroy(decompressor);
+
+        unmapFile(mapping);
+
+        return result;
+    }
+
+    std::string getName() override
+    {
+        return "libjpeg-turbo";
+    }
+
+};
+#endif
+//*************************************************************************************************
+#if defined(USE_LIBPNG)
+class PngImageDecoder : public ImageDecoder
+{
+public:
+    // Reentrant, so loading threads decode several PNG files at once
+    int decode(std::string file_name, Texture &texture) override
+    {
+        MappedFile mapping;
+        if (mapFile(file_name, mapping))
+            return -1;
+
+        const BYTE png_signature[] = {0x89, 'P', 'N', 'G'};
+        if (mapping.size < 8 || std::memcmp(mapping.data, png_signature, 4) != 0)
+        {
+            unmapFile(mapping);
+            return -1;
+        }
+
+        png_image image;
+        std::memset(&image, 0, sizeof(image));
+        image.version = PNG_IMAGE_VERSION;
+
+        if (!png_image_begin_read_from_memory(&image, mapping.data, mapping.size))
+        {
+            unmapFile(mapping);
+            return -1;
+        }
+
+        // Three channel rows must stay 4 byte aligned, otherwise the alpha channel is kept
+        bool has_alpha = (image.format & PNG_FORMAT_FLAG_ALPHA) || (image.width * 3) % 4 != 0;
+        image.format = has_alpha ? PNG_FORMAT_BGRA : PNG_FORMAT_BGR;
+
+        unsigned int bpp = PNG_IMAGE_PIXEL_SIZE(image.format) * 8;
+        unsigned int pitch = image.width * bpp / 8;
+        texture.pixels.resize(static_cast<std::size_t>(pitch) * image.height);
+
+        // Negative stride stores rows bottom-up
+        if (!png_image_finish_read(&image, nullptr, texture.pixels.data(),
+                                   -static_cast<int>(pitch), nullptr))
+        {
+            png_image_free(&image);
+            std::vector<BYTE>().swap(texture.pixels);
+            unmapFile(mapping);
+            return -1;
+        }
+
+        texture.bits = texture.pixels.data();
+        texture.width = image.width;
+        texture.height = image.height;
+        texture.bpp = bpp;
+        texture.pitch = pitch;
+
+        unmapFile(mapping);
+
+        return 0;
+    }
+
+    std::string getName() override
+    {
+        return "libpng";
+    }
+
+};
+#endif
+//*************************************************************************************************
+class FreeImageDecoder : public ImageDecoder
+{
+public:
+    int decode(std::string file_name, Texture &texture) override
+    {
+        FREE_IMAGE_FORMAT image_format = FIF_UNKNOWN;
+        FIBITMAP *image_ptr = nullptr;
+
+        image_format = FreeImage_GetFileType(file_name.c_str(), 0);
+        if (image_format == FIF_UNKNOWN)
+            image_format = FreeImage_GetFIFFromFilename(file_name.c_str());
+
+        if (image_format == FIF_UNKNOWN)
+            return -1;
+
+        if (FreeImage_FIFSupportsReading(image_format))
+            image_ptr = FreeImage_Load(image_format, file_name.c_str());
+
+        if (!image_ptr)
+            return -1;
+
+        // Everything else is expanded to 32 bits, upload and mip code only handle 24 and 32
+        unsigned int bpp = FreeImage_GetBPP(image_ptr);
+        if (bpp != 24 && bpp != 32)
+        {
+            FIBITMAP *converted_ptr = FreeImage_ConvertTo32Bits(image_ptr);
+            FreeImage_Unload(image_ptr);
+            image_ptr = converted_ptr;
+            bpp = 32;
+
+            if (!image_ptr)
+                return -1;
+        }
+
+        BYTE *bits = FreeImage_GetBits(image_ptr);
+        unsigned int image_width = FreeImage_GetWidth(image_ptr);
+        unsigned int image_height = FreeImage_GetHeight(image_ptr);
+
+        if ((bits == 0) || (image_width == 0) || (image_height == 0))
+        {
+            std::cout << "Texture \"" << file_name << "\" format error." << std::endl;
+            FreeImage_Unload(image_ptr);
+            return -1;
+        }
+
+        texture.bits = bits;
+        texture.image_ptr = image_ptr;
+        texture.width = image_width;
+        texture.height = image_height;
+        texture.bpp = bpp;
+        texture.pitch = FreeImage_GetPitch(image_ptr);
+
+        return 0;
+    }
+
+    std::string getName() override
+    {
+        return "FreeImage";
+    }
+
+};
+//*************************************************************************************************
+std::vector<std::unique_ptr<ImageDecoder>>& getImageDecoders()
+{
+    // Tried in order, FreeImage stays the fallback for every other file
+    static std::vector<std::unique_ptr<ImageDecoder>> decoders = [] {
+        std::vector<std::unique_ptr<ImageDecoder>> backends;
+        backends.emplace_back(new TgaImageDecoder());
+#if defined(USE_TURBOJPEG)
+        backends.emplace_back(new TurboJpegImageDecoder());
+#endif
+#if defined(USE_LIBPNG)
+        backends.emplace_back(new PngImageDecoder());
+#endif
+        backends.emplace_back(new FreeImageDecoder());
+        return backends;
+    }();
+
+    return decoders;
+}
+//*************************************************************************************************
+std::string getFileExtension(std::string file_name)
+{
+    std::size_t found_pos = file_name.find_last_of('.');
+    if (found_pos == std::string::npos)
+        return "";
+
+    std::string extension = file_name.substr(found_pos + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    return extension;
+}
+//*************************************************************************************************
+int mapFile(std::string file_name, MappedFile &mapped_file)
+{
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return -1;
+
+    LARGE_INTEGER file_size;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    CloseHandle(file);
+
+    if (!mapping)
+        return -1;
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+
+    if (!data)
+        return -1;
+
+    mapped_file.size = static_cast<std::size_t>(file_size.QuadPart);
+#else
+    int file = open(file_name.c_str(), O_RDONLY);
+    if (file < 0)
+        return -1;
+
+    struct stat file_stat;
+    void *data = MAP_FAILED;
+    if (fstat(file, &file_stat) == 0 && file_stat.st_size > 0)
+        data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+
+    close(file);
+
+    if (data == MAP_FAILED)
+        return -1;
+
+    mapped_file.size = file_stat.st_size;
+#endif
+    mapped_file.data = static_cast<const BYTE*>(data);
+
+    return 0;
+}
+//*************************************************************************************************
+void unmapFile(MappedFile &mapped_file)
+{
+    if (!mapped_file.data)
+        return;
+
+#if defined(_WIN32)
+    UnmapViewOfFile(mapped_file.data);
+#else
+    munmap(const_cast<BYTE*>(mapped_file.data), mapped_file.size);
+#endif
+
+    mapped_file.data = nullptr;
+    mapped_file.size = 0;
+}
+//*************************************************************************************************
+int benchmarkImageDecoders(std::vector<std::string> file_names)
+{
+    const int repeats = 10;
+
+    for (auto &file_name : file_names)
+    {
+        std::cout << "\"" << file_name << "\":" << std::endl;
+
+        for (auto &decoder : getImageDecoders())
+        {
+            double total_time = 0.0;
+            std::size_t decoded_size = 0;
+            int i = 0;
+
+            for (; i < repeats; i++)
+            {
+                Texture texture;
+
+                auto start = std::chrono::steady_clock::now();
+                int result = decoder->decode(file_name, texture);
+                auto end = std::chrono::steady_clock::now();
+
+                if (result)
+                    break;
+
+                total_time += std::chrono::duration<double, std::milli>(end - start).count();
+                decoded_size = static_cast<std::size_t>(texture.pitch) * texture.height;
+
+                freeTextureData(texture);
+            }
+
+            if (i == 0)
+            {
+                std::cout << "  " << decoder->getName() << ": not handled" << std::endl;
+                continue;
+            }
+
+            double average_time = total_time / i;
+            std::cout << "  " << decoder->getName() << ": " << average_time << " ms, "
+                      << decoded_size / (average_time * 1000.0) << " MB/s" << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,252 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Input recording and replay of lesson 28, with the camera state it checks against. Included
+// by main.cpp after its declarations.
+#ifndef TEKST_2_INPUT_RECORDER_H
+#define TEKST_2_INPUT_RECORDER_H
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+//******************************************************************************
+struct CameraState
+{
+    glm::vec3 position;
+    float horizontal_angle = 0.0f;
+    float vertical_angle = 0.0f;
+};
+
+CameraState getCameraState();
+void setCameraState(const CameraState &camera);
+
+// Per frame input and camera, saved as a compact binary stream and replayed for identical views
+class InputRecorder
+{
+public:
+    ~InputRecorder()
+    {
+        stopRecording();
+    }
+
+    double getReplayTimeDelta() const
+    {
+        return replay_time_delta_;
+    }
+
+    unsigned int getCameraMismatches() const
+    {
+        return camera_mismatches_;
+    }
+
+    unsigned int getFramesCount() const
+    {
+        return static_cast<unsigned int>(frames_.size());
+    }
+
+    bool isRecording() const
+    {
+        return record_file_.is_open();
+    }
+
+    bool isReplaying() const
+    {
+        return replaying_;
+    }
+
+    // Camera after applyInput, replay compares its own result against it
+    void record(const InputState &input, double time_delta, const CameraState &camera)
+    {
+        if (!record_file_.is_open())
+            return;
+
+        Frame frame;
+        frame.time_delta = static_cast<float>(time_delta);
+        frame.input = input;
+        frame.camera = camera;
+        writeFrame(frame);
+    }
+
+    // Next recorded frame, false once the recording has been played back
+    bool nextReplayFrame(InputState &input)
+    {
+        if (!replaying_ || next_frame_ >= frames_.size())
+            return false;
+
+        const Frame &frame = frames_[next_frame_];
+        input = frame.input;
+        replay_time_delta_ = fixed_time_step_ > 0.0 ? fixed_time_step_ : frame.time_delta;
+
+        return true;
+    }
+
+    // Recorded camera wins, mismatches show where the input handling has changed
+    void restoreReplayCamera(CameraState &camera)
+    {
+        const CameraState &recorded = frames_[next_frame_++].camera;
+
+        const float tolerance = 1e-3f;
+        if (glm::length(camera.position - recorded.position) > tolerance ||
+            std::abs(camera.horizontal_angle - recorded.horizontal_angle) > tolerance ||
+            std::abs(camera.vertical_angle - recorded.vertical_angle) > tolerance)
+            camera_mismatches_++;
+
+        camera = recorded;
+    }
+
+    int startRecording(std::string file_name)
+    {
+        record_file_.open(file_name, std::ios::out | std::ios::binary);
+        if (!record_file_.is_open())
+        {
+            std::cout << "Error creating recording \"" << file_name << "\"." << std::endl;
+            return -1;
+        }
+
+        std::uint32_t frame_size = FRAME_SIZE;
+        record_file_.write("INP1", 4);
+        record_file_.write(reinterpret_cast<const char*>(&frame_size), sizeof(frame_size));
+
+        std::cout << "Recording input to \"" << file_name << "\"." << std::endl;
+
+        return 0;
+    }
+
+    // Fixed time step in seconds, 0 keeps the recorded frame times
+    int startReplay(std::string file_name, double fixed_time_step)
+    {
+        std::ifstream replay_file(file_name, std::ios::in | std::ios::binary);
+        if (!replay_file.is_open())
+        {
+            std::cout << "Unable to open recording \"" << file_name << "\"." << std::endl;
+            return -1;
+        }
+
+        char magic[4] = {0, 0, 0, 0};
+        std::uint32_t frame_size = 0;
+        replay_file.read(magic, sizeof(magic));
+        replay_file.read(reinterpret_cast<char*>(&frame_size), sizeof(frame_size));
+
+        if (!replay_file || std::string(magic, 4) != "INP1" || frame_size != FRAME_SIZE)
+        {
+            std::cout << "Recording \"" << file_name << "\" has an unknown format." << std::endl;
+            return -1;
+        }
+
+        Frame frame;
+        while (readFrame(replay_file, frame))
+            frames_.push_back(frame);
+
+        fixed_time_step_ = fixed_time_step;
+        next_frame_ = 0;
+        replaying_ = true;
+
+        std::cout << "Replaying " << frames_.size() << " frames from \"" << file_name << "\"."
+                  << std::endl;
+
+        return 0;
+    }
+
+    void stopRecording()
+    {
+        if (record_file_.is_open())
+            record_file_.close();
+    }
+
+protected:
+    struct Frame
+    {
+        float time_delta = 0.0f;
+        InputState input;
+        CameraState camera;
+    };
+
+    // Fields are written one by one, so the size does not depend on struct padding: 33 bytes
+    static const std::uint32_t FRAME_SIZE = 4 + 1 + 2 * 4 + 3 * 4 + 2 * 4;
+
+    template <typename T>
+    static void readValue(std::ifstream &file, T &value)
+    {
+        file.read(reinterpret_cast<char*>(&value), sizeof(value));
+    }
+
+    static bool readFrame(std::ifstream &file, Frame &frame)
+    {
+        float cursor_x = 0.0f;
+        float cursor_y = 0.0f;
+
+        readValue(file, frame.time_delta);
+        readValue(file, frame.input.buttons);
+        readValue(file, cursor_x);
+        readValue(file, cursor_y);
+        readValue(file, frame.camera.position.x);
+        readValue(file, frame.camera.position.y);
+        readValue(file, frame.camera.position.z);
+        readValue(file, frame.camera.horizontal_angle);
+        readValue(file, frame.camera.vertical_angle);
+
+        frame.input.cursor_x = cursor_x;
+        frame.input.cursor_y = cursor_y;
+
+        return static_cast<bool>(file);
+    }
+
+    template <typename T>
+    void writeValue(const T &value)
+    {
+        record_file_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    // GLFW gives the cursor position as a double, it is stored as a float. Sub-pixel and large
+    // positions of a disabled cursor are rounded, so the replayed mouse deltas may differ
+    // slightly. The camera then counts as a mismatch and is reset to the recorded one.
+    void writeFrame(const Frame &frame)
+    {
+        writeValue(frame.time_delta);
+        writeValue(frame.input.buttons);
+        writeValue(static_cast<float>(frame.input.cursor_x));
+        writeValue(static_cast<float>(frame.input.cursor_y));
+        writeValue(frame.camera.position.x);
+        writeValue(frame.camera.position.y);
+        writeValue(frame.camera.position.z);
+        writeValue(frame.camera.horizontal_angle);
+        writeValue(frame.camera.vertical_angle);
+    }
+
+protected:
+    bool replaying_{false};
+    double fixed_time_step_{0.0};
+    double replay_time_delta_{0.0};
+    std::ofstream record_file_;
+    std::size_t next_frame_{0};
+    std::vector<Frame> frames_;
+    unsigned int camera_mismatches_{0};
+
+};
+//*************************************************************************************************
+CameraState getCameraState()
+{
+    CameraState camera;
+    camera.position = camera_position;
+    camera.horizontal_angle = camera_horizontal_angle;
+    camera.vertical_angle = camera_vertical_angle;
+
+    return camera;
+}
+//*************************************************************************************************
+void setCameraState(const CameraState &camera)
+{
+    camera_position = camera.position;
+    camera_horizontal_angle = camera.horizontal_angle;
+    camera_vertical_angle = camera.vertical_angle;
+
+    setCameraAngles(camera_horizontal_angle, camera_vertical_angle);
+    recalculateCamera();
+}
+
+#endif
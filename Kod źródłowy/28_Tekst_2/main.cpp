@@ -3,6 +3,13 @@
 // http://kurs-opengl.pl
 // Sebastian Tabaka
 //******************************************************************************
+// windows.h goes first, FreeImage.h declares its own Win32 types when it is missing
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
@@ -16,27 +23,59 @@
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
+
+#include "../Wspolne/gl_state_cache.h"
+#include "../Wspolne/job_system.h"
+#include "../Wspolne/streaming_buffer.h"
 //******************************************************************************
 // Declarations
 GLFWwindow *window_handle = nullptr;
 int window_height = 0;
 int window_width = 0;
 
+// Offscreen target of the headless benchmark, 0 while rendering to the window
+GLuint default_framebuffer = 0;
+
 enum class ShaderType
 {
     VERTEX_SHADER,
     FRAGMENT_SHADER,
 };
 
+// Opaque draw order, the depth pre-pass leaves one shaded sample per pixel
+enum class DepthOrder
+{
+    FILE_ORDER,
+    FRONT_TO_BACK,
+    DEPTH_PREPASS,
+};
+
 double actual_time = 0;
 double previous_time = 0;
 
@@ -54,23 +93,74 @@ glm::vec3 camera_up;
 glm::mat4 view_matrix;
 glm::mat4 projection_matrix;
 
+// Source mesh within a merged vertex array, drawn on its own when the order matters
+struct MeshRange
+{
+    glm::vec3 center;
+    float radius = 0.0f;
+    GLint first = 0;
+    GLsizei count = 0;
+};
+
 struct Mesh
 {
     GLuint handle = 0;
+    // Position only vertex array of the depth pre-pass
+    GLuint depth_handle = 0;
     GLuint diffuse_texture = 0;
+    std::vector<MeshRange> ranges;
     unsigned int vertices_count = 0;
 };
 
+struct MappedFile
+{
+    const BYTE *data = nullptr;
+    std::size_t size = 0;
+};
+
 struct Texture
 {
-    BYTE *bits;
-    FIBITMAP *image_ptr;
-    int width;
-    int height;
+    BYTE *bits = nullptr;
+    FIBITMAP *image_ptr = nullptr;
+    int width = 0;
+    int height = 0;
+    MappedFile mapping;
+    std::vector<BYTE> pixels;
+    unsigned int bpp = 0;
+    unsigned int pitch = 0;
+};
+
+// Draw calls and triangles submitted, reset every frame
+struct DrawStats
+{
+    unsigned int draw_calls = 0;
+    std::uint64_t triangles = 0;
+};
+
+DrawStats draw_stats;
+
+// Input sampled once per frame, live from GLFW or from a recording
+enum InputButton
+{
+    INPUT_FORWARD = 1 << 0,
+    INPUT_BACK = 1 << 1,
+    INPUT_LEFT = 1 << 2,
+    INPUT_RIGHT = 1 << 3,
+    INPUT_LOOK = 1 << 4,
+    INPUT_EXIT = 1 << 5,
+};
+
+struct InputState
+{
+    double cursor_x = 0.0;
+    double cursor_y = 0.0;
+    std::uint8_t buttons = 0;
 };
 
 typedef std::vector<Mesh*> MeshHandle;
 
+InputState readInput();
+bool FPSCounter(double& fps);
 bool renderingEnabled();
 double getTimeDelta();
 int checkShaderCompileStatus(GLuint shader_handle);
@@ -79,44 +169,59 @@ int compileShader(GLuint shader_handle);
 int createShaderProgram(GLuint &handle, std::string vertex_shader_file,
                         std::string fragment_shader_file);
 int createWindow(int width, int height, std::string name, int samples, bool fullscreen);
-int findUniform(GLuint shader_program, std::string uniform_name);
 int linkShaderProgram(GLuint &shader_program, GLuint vertex_shader_handle,
                       GLuint fragment_shader_handle);
-int loadSceneFromFile(std::string file_name, std::vector<Mesh*>& mesh_handle);
-int loadShader(GLuint &shader_handle, std::string file_name,
-               ShaderType shader_type);
 int loadShaderCode(std::string file_name, std::string &shader_code);
 int loadTexture(std::string file_name, Texture &texture);
-int loadTexture2D(GLuint& texture_handle, Texture texture);
+int loadTexture2D(JobSystem &jobs, GLuint& texture_handle, const Texture &texture);
 std::string getShaderCompileMsg(GLuint shader_handle);
 void activateShaderProgram(GLuint shader_program);
+void applyInput(const InputState &input);
 void clearColor(float r, float g, float b);
 void closeWindow(GLFWwindow *window);
-void drawMesh(const MeshHandle& mesh);
+void drawArrays(GLenum mode, GLint first, GLsizei count);
 void enableDepthTesting(bool state);
 void enableFaceCulling(bool state);
-void FPSCounter(double& fps);
 void freeTextureData(Texture &texture);
-void loadTextureSkybox(std::string front, std::string back, std::string left, std::string right,
-                       std::string up, std::string down, GLuint &texture_handle);
-void pollKeyboad();
-void pollMouse();
 void processWindowEvents();
 void recalculateCamera();
 void setCameraAngles(float horizontal, float vertical);
 void setCursorPos(double x, double y);
-void setUniform(GLint uniform_handle, GLint value);
-void setUniform(GLint uniform_handle, const glm::mat4 &matrix);
-void setUniform(GLint uniform_handle, const glm::vec3 &vector);
 void terminate();
 void updateTimer();
 void windowSizeCallback(GLFWwindow *, int width, int height);
 
+// Every draw path sets GL state through this cache
+GLStateCache gl_state;
+
+// Subsystems of the scene, they use the declarations above
+#include "mip_chain.h"
+#include "texture_streamer.h"
+#include "material_library.h"
+#include "image_decoders.h"
+#include "shader_programs.h"
+#include "frame_uniforms.h"
+#include "shader_uniforms.h"
+#include "clustered_lights.h"
+#include "frame_profiler.h"
+#include "stats_overlay.h"
+#include "benchmark.h"
+#include "input_recorder.h"
+#include "render_graph.h"
+#include "overdraw_counter.h"
+#include "draw_list.h"
+#include "frame_snapshot_queue.h"
+#include "cubemap_loader.h"
+#include "city_scene.h"
+
 class FreeTypeFontRenderer
 {
 public:
-    FreeTypeFontRenderer(std::string font_name, unsigned int size)
+    FreeTypeFontRenderer(std::string font_name, unsigned int size,
+                         StreamingBuffer &streaming_buffer)
     {
+        streaming_buffer_ = &streaming_buffer;
+
         if (FT_Init_FreeType(&ft_library_))
         {
             std::cout << "FreeType initialization error." << std::endl;
@@ -153,7 +258,6 @@ public:
 
         glGenVertexArrays(1, &handle_);
 
-        glGenBuffers(1, &vertices_vbo_);
         glGenBuffers(1, &texture_coords_vbo_);
 
         float texture_coords[] = {
@@ -165,9 +269,8 @@ public:
             1, 1
         };
 
+        // Glyph positions are sourced from the streaming buffer when drawn
         glBindVertexArray(handle_);
-        glBindBuffer(GL_ARRAY_BUFFER, vertices_vbo_);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
         glBindBuffer(GL_ARRAY_BUFFER, texture_coords_vbo_);
         glBufferData(GL_ARRAY_BUFFER, sizeof(texture_coords), texture_coords, GL_STATIC_DRAW);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, NULL);
@@ -178,12 +281,11 @@ public:
 
     ~FreeTypeFontRenderer()
     {
-        glDeleteTextures(1, &font_texture_handle_);
+        gl_state.deleteTextures(1, &font_texture_handle_);
 
-        glDeleteBuffers(1, &vertices_vbo_);
-        glDeleteBuffers(1, &texture_coords_vbo_);
+        gl_state.deleteBuffers(1, &texture_coords_vbo_);
 
-        glDeleteVertexArrays(1, &handle_);
+        gl_state.deleteVertexArrays(1, &handle_);
     }
 
     float calculateScreenCoordX(float x)
@@ -196,12 +298,12 @@ public:
         return (1 - y / static_cast<float>(viewport_height_) * 2);
     }
 
+    // Text is drawn without depth testing, the next draw sets the state it needs
     void renderText(std::wstring text, int x, int y)
     {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, font_texture_handle_);
-
-        glBindVertexArray(handle_);
+        gl_state.bindTexture(0, GL_TEXTURE_2D, font_texture_handle_);
+        gl_state.bindVertexArray(handle_);
+        gl_state.enable(GL_DEPTH_TEST, false);
 
         int cursor_pos_x = x;
         int cursor_pos_y = y;
@@ -259,20 +361,19 @@ public:
                 vertices_buffer.push_back(vertices[index].z);
             }
 
-            glBindBuffer(GL_ARRAY_BUFFER, vertices_vbo_);
-            glBufferData(GL_ARRAY_BUFFER, vertices_buffer.size() * sizeof(GLfloat),
-                         vertices_buffer.data(), GL_DYNAMIC_DRAW);
-            enableDepthTesting(false);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
-            enableDepthTesting(true);
+            // Each glyph has its own texture, so its quad is drawn on its own
+            GLintptr offset = streaming_buffer_->upload(vertices_buffer.data(),
+                                                        vertices_buffer.size() * sizeof(GLfloat),
+                                                        sizeof(GLfloat));
+            gl_state.bindBuffer(GL_ARRAY_BUFFER, streaming_buffer_->getBuffer());
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0,
+                                  reinterpret_cast<const void*>(offset));
+            drawArrays(GL_TRIANGLES, 0, 6);
 
             cursor_pos_x += font_face_->glyph->advance.x >> 6;
 
             vertices_buffer.clear();
         }
-
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glBindVertexArray(0);
     }
 
 protected:
@@ -281,119 +382,130 @@ protected:
     GLuint font_texture_handle_{0};
     GLuint handle_{0};
     GLuint texture_coords_vbo_{0};
-    GLuint vertices_vbo_{0};
+    StreamingBuffer *streaming_buffer_{nullptr};
     unsigned int viewport_height_{800};
     unsigned int viewport_width_{600};
 
 };
 //*************************************************************************************************
-int main()
+int main(int argc, char *argv[])
 {
-    // Create main window
-    int result = createWindow(800, 600, "GL Window", 4, false);
+    // Decoder backends benchmark, runs without a window
+    if (argc > 1 && std::string(argv[1]) == "--decoder-benchmark")
+    {
+        std::vector<std::string> file_names(argv + 2, argv + argc);
+        if (file_names.empty())
+            file_names = {"hills_ft.tga", "hills_bk.tga", "hills_lf.tga", "hills_rt.tga",
+                          "hills_up.tga", "hills_dn.tga"};
+
+        return benchmarkImageDecoders(file_names);
+    }
+
+    // Light count sweep, renders the scene with 1 to 1024 clustered lights and exits
+    bool light_benchmark = argc > 1 && std::string(argv[1]) == "--light-benchmark";
+
+    // Headless flythrough: --benchmark [frames] [forward|sorted|prepass|deferred], writes a JSON
+    // report, sorted and prepass are forward shading with the opaque meshes ordered
+    bool benchmark = argc > 1 && std::string(argv[1]) == "--benchmark";
+    unsigned int benchmark_frames = 1000;
+    bool benchmark_deferred = false;
+    DepthOrder benchmark_depth_order = DepthOrder::FILE_ORDER;
+    if (benchmark && argc > 2)
+        benchmark_frames = std::max(1, std::atoi(argv[2]));
+    if (benchmark && argc > 3)
+    {
+        std::string mode = argv[3];
+        benchmark_deferred = mode == "deferred";
+        if (mode == "sorted")
+            benchmark_depth_order = DepthOrder::FRONT_TO_BACK;
+        else if (mode == "prepass")
+            benchmark_depth_order = DepthOrder::DEPTH_PREPASS;
+    }
+
+    // Input recording and replay: --record file, --replay file [fixed]
+    InputRecorder input_recorder;
+    if (argc > 2 && std::string(argv[1]) == "--record" &&
+        input_recorder.startRecording(argv[2]))
+        return -1;
+
+    // Recorded frame times by default, "fixed" steps 1/60 s per frame
+    double replay_time_step = argc > 3 && std::string(argv[3]) == "fixed" ? 1.0 / 60.0 : 0.0;
+    if (argc > 2 && std::string(argv[1]) == "--replay" &&
+        input_recorder.startReplay(argv[2], replay_time_step))
+        return -1;
+
+    // Large scene and draw list threads: --city-grid N, --draw-threads N after the mode arguments
+    int city_grid = 1;
+    unsigned int draw_threads = std::thread::hardware_concurrency();
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (std::string(argv[i]) == "--city-grid")
+            city_grid = std::max(1, std::atoi(argv[i + 1]));
+        else if (std::string(argv[i]) == "--draw-threads")
+            draw_threads = std::max(1, std::atoi(argv[i + 1]));
+    }
+
+    // --render-thread: the main thread keeps the window events and input, a second thread owns
+    // the GL context and renders, the headless benchmark has no events to separate
+    bool render_thread = false;
+    for (int i = 1; i < argc; i++)
+        render_thread = render_thread || std::string(argv[i]) == "--render-thread";
+    render_thread = render_thread && !benchmark;
+
+    // Work stealing pool shared by the loaders and the per frame work, the calling thread helps,
+    // --draw-threads sizes it to measure the scaling with cores
+    JobSystem jobs(draw_threads);
+
+    // Create main window, or an offscreen context for the benchmark
+    int result = benchmark ? createHeadlessContext(800, 600) :
+                             createWindow(800, 600, "GL Window", 4, false);
     if (result)
         return -1;
 
-    // Load shaders
-    // ----- MESH
-    GLuint mesh_shader = 0;
-    if (createShaderProgram(mesh_shader, "mesh_vs.glsl", "mesh_fs.glsl"))
+    // Transient vertices and uniform blocks of a frame, grows when one megabyte is not enough
+    StreamingBuffer streaming_buffer(1024 * 1024, &gl_state);
+
+    // City with its lights and passes, the text is drawn over it
+    CityScene city_scene(jobs, streaming_buffer, city_grid, light_benchmark ? 1 : 256,
+                         benchmark_deferred, benchmark_depth_order);
+
+    // Submit shaders, they compile while the assets load
+    ShaderProgramBatch shader_batch;
+    if (city_scene.submitShaders(shader_batch))
         return -1;
 
-    // ----- SKYBOX
-    GLuint skybox_shader = 0;
-    if (createShaderProgram(skybox_shader, "skybox_vs.glsl", "skybox_fs.glsl"))
+    // ----- STATS OVERLAY
+    GLuint overlay_shader = 0;
+    if (shader_batch.submit(overlay_shader, "overlay_vs.glsl", "overlay_fs.glsl"))
         return -1;
 
     // ----- FONT
     GLuint font_shader = 0;
-    if (createShaderProgram(font_shader, "font_vs.glsl", "font_fs.glsl"))
+    if (shader_batch.submit(font_shader, "font_vs.glsl", "font_fs.glsl"))
         return -1;
 
-    // Find uniforms
-    GLint texture_slot_mesh = findUniform(mesh_shader, "basic_texture");
-    GLint view_uniform_mesh = findUniform(mesh_shader, "view_matrix");
-    GLint projection_uniform_mesh = findUniform(mesh_shader, "projection_matrix");
-    GLint model_uniform_mesh = findUniform(mesh_shader, "model_matrix");
-
-    GLint view_uniform_sky = findUniform(skybox_shader, "view_matrix");
-    GLint projection_uniform_sky = findUniform(skybox_shader, "projection_matrix");
-
-    GLint texture_slot_font = findUniform(font_shader, "font_texture");
-    GLint colour_font = findUniform(font_shader, "colour");
-
     // Configure camera
     aspect = float(window_width) / float(window_height);
     recalculateCamera();
 
-    // Create skybox
-    GLfloat skybox_vertices[] = {
-        -1.0f,  1.0f, -1.0f,
-        -1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-         1.0f,  1.0f, -1.0f,
-        -1.0f,  1.0f, -1.0f,
-
-        -1.0f, -1.0f,  1.0f,
-        -1.0f, -1.0f, -1.0f,
-        -1.0f,  1.0f, -1.0f,
-        -1.0f,  1.0f, -1.0f,
-        -1.0f,  1.0f,  1.0f,
-        -1.0f, -1.0f,  1.0f,
-
-         1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-
-        -1.0f, -1.0f,  1.0f,
-        -1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f, -1.0f,  1.0f,
-        -1.0f, -1.0f,  1.0f,
-
-        -1.0f,  1.0f, -1.0f,
-         1.0f,  1.0f, -1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-        -1.0f,  1.0f,  1.0f,
-        -1.0f,  1.0f, -1.0f,
-
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f,  1.0f,
-         1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f,  1.0f,
-         1.0f, -1.0f,  1.0f
-    };
-
-    GLuint skybox_vertices_vbo = 0;
-    glGenBuffers(1, &skybox_vertices_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, skybox_vertices_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(skybox_vertices), &skybox_vertices, GL_STATIC_DRAW);
-
-    GLuint skybox_vao = 0;
-    glGenVertexArrays(1, &skybox_vao);
-    glBindVertexArray(skybox_vao);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
-    glBindVertexArray(0);
-
-    GLuint skybox_texture = 0;
-    loadTextureSkybox("hills_ft.tga", "hills_bk.tga", "hills_lf.tga", "hills_rt.tga",
-                      "hills_up.tga", "hills_dn.tga", skybox_texture);
-
-    // Load meshes
-    MeshHandle city;
-    loadSceneFromFile("city/city.obj", city);
-    glm::mat4 mesh_model_matrix = glm::scale(glm::mat4(1.0f), glm::vec3(0.1, 0.1, 0.1));
+    // Load skybox and meshes
+    city_scene.load();
 
     // Create font renderer
-    FreeTypeFontRenderer ft_font_renderer("/usr/share/fonts/truetype/msttcorefonts/arial.ttf", 32);
+    FreeTypeFontRenderer ft_font_renderer("/usr/share/fonts/truetype/msttcorefonts/arial.ttf", 32,
+                                          streaming_buffer);
+    FreeTypeFontRenderer stats_font_renderer("/usr/share/fonts/truetype/msttcorefonts/arial.ttf",
+                                             16, streaming_buffer);
+
+    // Shader status is first queried here, after the loading work
+    if (city_scene.resolveShaders(shader_batch) || shader_batch.resolve(font_shader) ||
+        shader_batch.resolve(overlay_shader))
+        return -1;
+
+    // Reflect active uniforms of the linked programs
+    ShaderUniforms font_uniforms(font_shader);
+    UniformHandle<GLint> texture_slot_font = font_uniforms.find<GLint>("font_texture");
+    UniformHandle<glm::vec3> colour_font = font_uniforms.find<glm::vec3>("colour");
 
     // Setup state machine
     enableFaceCulling(true);
@@ -401,60 +513,411 @@ int main()
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl_state.enable(GL_BLEND, true);
+    gl_state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    const unsigned int benchmark_max_lights = 1024;
+    const unsigned int benchmark_warmup_frames = 30;
+    const unsigned int benchmark_measured_frames = 120;
+    unsigned int benchmark_frame = 0;
+    double benchmark_binning_time = 0.0;
+    double benchmark_frame_time = 0.0;
+
+    // Passes are declared every frame, G-buffer textures are transients of the graph
+    RenderGraph render_graph;
+
+    // Per pass timings of the last 600 frames, T saves the newest 120 as a Chrome trace
+    FrameProfiler profiler(std::max(600u, benchmark_frames + 2));
+    const unsigned int trace_frames = 120;
+
+    // Frame time statistics drawn over the scene, C saves the history as CSV
+    StatsOverlay stats_overlay(overlay_shader, 240, streaming_buffer);
+    bool gpu_memory_known = false;
+    GLint gpu_memory_available = 0;
+    GLint gpu_memory_total = 0;
+
+    // Fixed timestep, the flythrough is the same on every machine
+    const double benchmark_timestep = 1.0 / 60.0;
+    std::vector<BenchmarkFrame> benchmark_results;
 
-    while (renderingEnabled())
+    if (light_benchmark)
     {
-        static double fps = 0;
-        FPSCounter(fps);
-        std::string title = "GL Window @ FPS: " + std::to_string(fps);
-        glfwSetWindowTitle(window_handle, title.c_str());
-
-        updateTimer();
-
-        clearColor(0.5, 0.5, 0.5);
-
-        // Draw skybox
-        activateShaderProgram(skybox_shader);
-        glm::mat4 view_static = view_matrix;
-        glm::vec3 pos(0.0, 0.0, 0.0);
-        view_static = glm::lookAt(pos, pos + camera_direction, camera_up);
-        setUniform(view_uniform_sky, view_static);
-        setUniform(projection_uniform_sky, projection_matrix);
-
-        enableDepthTesting(false);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_texture);
-        glBindVertexArray(skybox_vao);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        enableDepthTesting(true);
-
-        // Draw meshes
-        activateShaderProgram(mesh_shader);
-        setUniform(texture_slot_mesh, 0);
-        setUniform(view_uniform_mesh, view_matrix);
-        setUniform(projection_uniform_mesh, projection_matrix);
-        setUniform(model_uniform_mesh, mesh_model_matrix);
-        drawMesh(city);
-
-        // Draw font
-        activateShaderProgram(font_shader);
-        setUniform(texture_slot_font, 0);
-        setUniform(colour_font, glm::vec3(1.0, 1.0, 0.0));
-        ft_font_renderer.renderText(L"Hello World!\nNew Line", 100, 50);
-        setUniform(colour_font, glm::vec3(0.6, 0.2, 0.8));
-        ft_font_renderer.renderText(L"Zażółć gęślą jaźń ...", 200, 200);
-        setUniform(colour_font, glm::vec3(1.0, 0.1, 0.9));
-        ft_font_renderer.renderText(L"\x410\x411\x412\x413\x414", 300, 400);
-        setUniform(colour_font, glm::vec3(0.0, 1.0, 0.9));
-        ft_font_renderer.renderText(L"\x3B2\x436\x2122\x263A", 50, 500);
-
-        // Process window
-        processWindowEvents();
-        pollKeyboad();
-        pollMouse();
+        glfwSwapInterval(0);
+        std::cout << "Lights | Frame [ms] | Binning [ms] | Light indices" << std::endl;
+    }
+
+    // Input of the frame being rendered, sampled after the previous swap
+    FrameSnapshotQueue frame_snapshots(240);
+    FrameSnapshot snapshot;
+    if (!benchmark)
+        snapshot = sampleFrameSnapshot();
+    std::atomic<double> render_fps{0.0};
+
+    auto render_frames = [&]() -> int {
+        while (renderingEnabled())
+        {
+            profiler.beginFrame();
+            auto frame_start_time = std::chrono::steady_clock::now();
+            streaming_buffer.beginFrame();
+            InputState input;
+
+            // Title changes go through the window manager, so only with the new FPS average
+            static double fps = 0;
+            if (!benchmark && FPSCounter(fps))
+            {
+                // Window functions are left to the event thread, it picks the average up from here
+                if (render_thread)
+                {
+                    render_fps = fps;
+                }
+                else
+                {
+                    std::string title = "GL Window @ FPS: " + std::to_string(fps);
+                    glfwSetWindowTitle(window_handle, title.c_str());
+                }
+
+                gpu_memory_known = !getGPUMemoryInfo(gpu_memory_available, gpu_memory_total);
+            }
+
+            if (benchmark)
+            {
+                previous_time = actual_time;
+                actual_time += benchmark_timestep;
+
+                // Camera follows the spline, looking at the city center
+                float path_position =
+                    static_cast<float>(benchmark_results.size()) / benchmark_frames;
+                camera_position = getCameraSplinePoint(path_position);
+                camera_direction = glm::normalize(glm::vec3(0.0f) - camera_position);
+                camera_right = glm::normalize(glm::cross(camera_direction,
+                                                         glm::vec3(0.0f, 1.0f, 0.0f)));
+                recalculateCamera();
+            }
+            else if (input_recorder.isReplaying())
+            {
+                if (!input_recorder.nextReplayFrame(input))
+                {
+                    std::cout << "Replay finished: " << input_recorder.getFramesCount()
+                              << " frames, " << input_recorder.getCameraMismatches()
+                              << " camera mismatches." << std::endl;
+                    break;
+                }
+
+                previous_time = actual_time;
+                actual_time += input_recorder.getReplayTimeDelta();
+            }
+            else
+                updateTimer();
+
+            stats_overlay.addFrameTime(getTimeDelta() * 1000.0);
+
+            // Overlay shows the counters of the previous frame
+            FrameTimeStats frame_stats = stats_overlay.getStats();
+            std::vector<std::wostringstream> overlay_lines(10);
+            for (auto &line : overlay_lines)
+                line << std::fixed << std::setprecision(2);
+
+            overlay_lines[0] << L"Frame [ms] min " << frame_stats.min << L" avg " << frame_stats.avg
+                             << L" p95 " << frame_stats.p95 << L" p99 " << frame_stats.p99;
+            overlay_lines[1] << L"Draw calls " << draw_stats.draw_calls << L", triangles "
+                             << draw_stats.triangles;
+
+            if (!gpu_memory_known)
+                overlay_lines[2] << L"GPU memory n/a";
+            else if (gpu_memory_total > 0)
+                overlay_lines[2] << L"GPU memory "
+                                 << (gpu_memory_total - gpu_memory_available) / 1024 << L" / "
+                                 << gpu_memory_total / 1024 << L" MB";
+            else
+                overlay_lines[2] << L"GPU memory " << gpu_memory_available / 1024 << L" MB free";
+
+            overlay_lines[3] << L"Uniforms " << uniform_stats.uploaded << L" sent, "
+                             << uniform_stats.skipped << L" skipped, state changes "
+                             << gl_state.getChangesCount() << L" of " << gl_state.getCallsCount();
+
+            if (city_scene.isDeferredShading())
+                overlay_lines[4] << L"Geometry " << profiler.getGPUTime("Geometry")
+                                 << L" ms, lighting " << profiler.getGPUTime("Lighting") << L" ms";
+            else
+                overlay_lines[4] << L"Meshes " << profiler.getGPUTime("Meshes") << L" ms";
+            if (profiler.getSkippedFrames() > 0)
+                overlay_lines[4] << L", " << profiler.getSkippedFrames() << L" frames skipped";
+            overlay_lines[5] << L"Graph " << render_graph.getCompileTime() << L" us, "
+                             << render_graph.getExecuteTime() << L" ms, passes "
+                             << render_graph.getPassesCount() - render_graph.getCulledPassesCount()
+                             << L"/" << render_graph.getPassesCount() << L", textures "
+                             << render_graph.getTexturesCount() << L"/"
+                             << render_graph.getTransientsCount();
+            const wchar_t *depth_order_names[] = {L"file order", L"front to back",
+                                                  L"depth pre-pass"};
+            DepthOrder depth_order = city_scene.getDepthOrder();
+            overlay_lines[6] << L"Opaque " << depth_order_names[static_cast<int>(depth_order)]
+                             << L", overdraw " << city_scene.getOverdraw() << L" samples/px";
+            if (depth_order == DepthOrder::DEPTH_PREPASS && !city_scene.isDeferredShading())
+                overlay_lines[6] << L", pre-pass " << profiler.getGPUTime("Depth pre-pass")
+                                 << L" ms";
+            const DrawListBuilder &draw_list = city_scene.getDrawList();
+            overlay_lines[7] << L"Draw list " << draw_list.getBuildTime() << L" ms on "
+                             << draw_list.getThreadsCount() << L" threads, "
+                             << draw_list.getPacketsCount() << L" packets, culled "
+                             << draw_list.getCulledCount() << L" + "
+                             << draw_list.getDetailCulledCount() << L" small";
+
+            FrameTimeStats latency_stats = frame_snapshots.getLatencyStats();
+            overlay_lines[8] << L"Input to swap [ms] avg " << latency_stats.avg << L" p99 "
+                             << latency_stats.p99 << L" max " << latency_stats.max;
+            if (render_thread)
+                overlay_lines[8] << L", render thread, stale frames "
+                                 << frame_snapshots.getStaleFramesCount();
+            overlay_lines[9] << L"Streaming " << streaming_buffer.getUsedSize() / 1024 << L" / "
+                             << streaming_buffer.getFrameSize() / 1024 << L" KB, waited "
+                             << streaming_buffer.getWaitTime() << L" ms, "
+                             << (streaming_buffer.isPersistent() ? L"persistent" :
+                                                                   L"unsynchronised");
+
+            uniform_stats = UniformStats();
+            draw_stats = DrawStats();
+            gl_state.resetCounters();
+
+            city_scene.updateStreaming(profiler);
+
+            // Keyboard shortcuts, the headless benchmark has no window to read them from
+            if (!benchmark)
+            {
+                // Texture residency stats dump
+                static bool stats_key_pressed = false;
+                bool stats_key = (snapshot.shortcuts & SHORTCUT_RESIDENCY_STATS) != 0;
+                if (stats_key && !stats_key_pressed)
+                    city_scene.printResidencyStats();
+                stats_key_pressed = stats_key;
+
+                // Forward and deferred shading switch
+                static bool deferred_key_pressed = false;
+                bool deferred_key = (snapshot.shortcuts & SHORTCUT_DEFERRED) != 0;
+                if (deferred_key && !deferred_key_pressed)
+                {
+                    city_scene.setDeferredShading(!city_scene.isDeferredShading());
+                    std::cout << (city_scene.isDeferredShading() ? "Deferred" : "Forward")
+                              << " shading, graph textures "
+                              << render_graph.getTexturesMemorySize() / 1024 << " KB." << std::endl;
+                }
+                deferred_key_pressed = deferred_key;
+
+                // Opaque draw order switch
+                static bool depth_order_key_pressed = false;
+                bool depth_order_key = (snapshot.shortcuts & SHORTCUT_DEPTH_ORDER) != 0;
+                if (depth_order_key && !depth_order_key_pressed)
+                {
+                    const char *names[] = {"File order", "Front to back", "Depth pre-pass"};
+                    int depth_order = (static_cast<int>(city_scene.getDepthOrder()) + 1) % 3;
+                    city_scene.setDepthOrder(static_cast<DepthOrder>(depth_order));
+                    std::cout << names[depth_order] << " opaque meshes." << std::endl;
+                }
+                depth_order_key_pressed = depth_order_key;
+
+                // Overdraw heat map switch, without it the graph culls the heat map pass
+                static bool overdraw_view_key_pressed = false;
+                bool overdraw_view_key = (snapshot.shortcuts & SHORTCUT_OVERDRAW_VIEW) != 0;
+                if (overdraw_view_key && !overdraw_view_key_pressed)
+                    city_scene.setOverdrawView(!city_scene.isOverdrawView());
+                overdraw_view_key_pressed = overdraw_view_key;
+
+                // Chrome trace of the newest frames with complete GPU timings
+                static bool trace_key_pressed = false;
+                bool trace_key = (snapshot.shortcuts & SHORTCUT_TRACE) != 0;
+                if (trace_key && !trace_key_pressed)
+                {
+                    unsigned int last_frame = profiler.getLastResolvedFrame();
+                    unsigned int first_frame =
+                        last_frame > trace_frames ? last_frame - trace_frames + 1 : 1;
+                    profiler.exportTrace("frame_trace.json", first_frame, last_frame);
+                }
+                trace_key_pressed = trace_key;
+
+                // Frame times history dump
+                static bool csv_key_pressed = false;
+                bool csv_key = (snapshot.shortcuts & SHORTCUT_CSV) != 0;
+                if (csv_key && !csv_key_pressed)
+                    stats_overlay.saveCSV("frame_times.csv");
+                csv_key_pressed = csv_key;
+            }
+
+            // Frame time of the previous step is known once the timer has been updated
+            if (light_benchmark && benchmark_frame++ >= benchmark_warmup_frames)
+            {
+                benchmark_frame_time += getTimeDelta() * 1000.0;
+                benchmark_binning_time += city_scene.getBinningTime();
+
+                if (benchmark_frame == benchmark_warmup_frames + benchmark_measured_frames)
+                {
+                    std::cout << city_scene.getLightsCount() << " | "
+                              << benchmark_frame_time / benchmark_measured_frames << " | "
+                              << benchmark_binning_time / benchmark_measured_frames << " | "
+                              << city_scene.getLightIndicesCount() << std::endl;
+
+                    if (city_scene.getLightsCount() >= benchmark_max_lights)
+                        break;
+
+                    city_scene.setLightsCount(city_scene.getLightsCount() * 2);
+                    benchmark_frame = 0;
+                    benchmark_binning_time = 0.0;
+                    benchmark_frame_time = 0.0;
+                }
+            }
+
+            city_scene.update(profiler);
+
+            // Passes of this frame, the backbuffer is the only output read outside of the graph
+            render_graph.reset();
+            RenderGraph::Resource backbuffer = render_graph.importFramebuffer(
+                "Backbuffer", default_framebuffer, window_width, window_height);
+            city_scene.addPasses(render_graph, backbuffer);
+
+            // Draw font
+            render_graph.addPass("Text", {}, {backbuffer}, [&]() {
+                activateShaderProgram(font_shader);
+                font_uniforms.set(texture_slot_font, 0);
+                font_uniforms.set(colour_font, glm::vec3(1.0, 1.0, 0.0));
+                ft_font_renderer.renderText(L"Hello World!\nNew Line", 100, 50);
+                font_uniforms.set(colour_font, glm::vec3(0.6, 0.2, 0.8));
+                ft_font_renderer.renderText(L"Zażółć gęślą jaźń ...", 200, 200);
+                font_uniforms.set(colour_font, glm::vec3(1.0, 0.1, 0.9));
+                ft_font_renderer.renderText(L"\x410\x411\x412\x413\x414", 300, 400);
+                font_uniforms.set(colour_font, glm::vec3(0.0, 1.0, 0.9));
+                ft_font_renderer.renderText(L"\x3B2\x436\x2122\x263A", 50, 500);
+            });
+
+            // Draw statistics overlay
+            render_graph.addPass("Overlay", {}, {backbuffer}, [&]() {
+                stats_overlay.render(10, 10, 240, 80, window_width, window_height);
+
+                activateShaderProgram(font_shader);
+                font_uniforms.set(colour_font, glm::vec3(1.0, 1.0, 1.0));
+                for (std::size_t i = 0; i < overlay_lines.size(); i++)
+                    stats_font_renderer.renderText(overlay_lines[i].str(), 10,
+                                                   140 + static_cast<int>(i) * 20);
+            });
+
+            if (render_graph.compile())
+                return -1;
+            render_graph.execute(profiler);
+
+            if (benchmark)
+            {
+                // Without a swap chain the frame ends when the GPU has finished it
+                profiler.beginScope("Finish", false);
+                glFinish();
+                profiler.endScope();
+
+                BenchmarkFrame benchmark_frame_result;
+                benchmark_frame_result.frame_time = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - frame_start_time).count();
+                benchmark_frame_result.draw_calls = draw_stats.draw_calls;
+                benchmark_frame_result.triangles = draw_stats.triangles;
+                benchmark_frame_result.state_changes = gl_state.getChangesCount();
+                benchmark_frame_result.uniforms_skipped = uniform_stats.skipped;
+                benchmark_frame_result.uniforms_uploaded = uniform_stats.uploaded;
+                benchmark_frame_result.overdraw = city_scene.getOverdraw();
+                benchmark_frame_result.draw_list_time = city_scene.getDrawList().getBuildTime();
+                benchmark_results.push_back(benchmark_frame_result);
+
+                if (benchmark_results.size() == benchmark_frames)
+                    break;
+
+                continue;
+            }
+
+            // Process window, swap may wait for the GPU so it is timed on the CPU only
+            profiler.beginScope("Swap", false);
+            if (render_thread)
+                glfwSwapBuffers(window_handle);
+            else
+                processWindowEvents();
+            profiler.endScope();
+
+            frame_snapshots.addLatency(snapshot);
+
+            // Newest snapshot of the event thread, the render thread never waits for input
+            if (render_thread)
+                frame_snapshots.acquire(snapshot);
+            else
+                snapshot = sampleFrameSnapshot();
+
+            // Size callback would touch the camera from the event thread, resize is applied here
+            if (render_thread && snapshot.window_width > 0 && snapshot.window_height > 0 &&
+                (snapshot.window_width != window_width || snapshot.window_height != window_height))
+                windowSizeCallback(window_handle, snapshot.window_width, snapshot.window_height);
+
+            if (!input_recorder.isReplaying())
+                input = snapshot.input;
+            applyInput(input);
+
+            CameraState camera = getCameraState();
+            if (input_recorder.isReplaying())
+            {
+                input_recorder.restoreReplayCamera(camera);
+                setCameraState(camera);
+            }
+
+            input_recorder.record(input, getTimeDelta(), camera);
+        }
+
+        return 0;
+    };
+
+    if (render_thread)
+    {
+        // Context can be current on one thread only, the events stay on the main thread
+        glfwSetWindowSizeCallback(window_handle, nullptr);
+        glfwMakeContextCurrent(nullptr);
+        frame_snapshots.publish(snapshot);
+
+        std::thread renderer([&]() {
+            glfwMakeContextCurrent(window_handle);
+            result = render_frames();
+            glfwMakeContextCurrent(nullptr);
+
+            // Failed or finished replay ends the event loop as well
+            closeWindow(window_handle);
+        });
+
+        // Input is sampled every millisecond or on an event, vsync of the swap does not block it
+        while (renderingEnabled())
+        {
+            glfwWaitEventsTimeout(0.001);
+            frame_snapshots.publish(sampleFrameSnapshot());
+
+            double fps = render_fps.exchange(0.0);
+            if (fps > 0.0)
+            {
+                std::string title = "GL Window @ FPS: " + std::to_string(fps);
+                glfwSetWindowTitle(window_handle, title.c_str());
+            }
+        }
+
+        renderer.join();
+        glfwMakeContextCurrent(window_handle);
+    }
+    else
+    {
+        result = render_frames();
+    }
+
+    if (result)
+        return -1;
+
+    if (benchmark)
+    {
+        // Two more frames resolve the last GPU queries
+        profiler.beginFrame();
+        profiler.beginFrame();
+
+        result = saveBenchmarkReport("benchmark_report.json", benchmark_results, profiler,
+                                     city_scene.isDeferredShading(), city_scene.getDepthOrder());
+        profiler.exportTrace("benchmark_trace.json", 1, benchmark_frames);
+        destroyHeadlessContext();
+
+        return result;
     }
 
     terminate();
@@ -536,55 +999,11 @@ void closeWindow(GLFWwindow *window)
 int createShaderProgram(GLuint &handle, std::string vertex_shader_file,
                         std::string fragment_shader_file)
 {
-    GLuint vertex_shader_handle = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragment_shader_handle = glCreateShader(GL_FRAGMENT_SHADER);
-
-    if (loadShader(vertex_shader_handle, vertex_shader_file, ShaderType::VERTEX_SHADER))
-        return -1;
-
-    if (loadShader(fragment_shader_handle, fragment_shader_file, ShaderType::FRAGMENT_SHADER))
-        return -1;
-
-    handle = glCreateProgram();
-
-    if (linkShaderProgram(handle, vertex_shader_handle, fragment_shader_handle))
+    ShaderProgramBatch shader_batch;
+    if (shader_batch.submit(handle, vertex_shader_file, fragment_shader_file))
         return -1;
 
-    std::cout << "Shader program created successfully." << std::endl;
-
-    return 0;
-}
-//*************************************************************************************************
-int loadShader(GLuint &shader_handle, std::string file_name, ShaderType shader_type)
-{
-    std::string shader_data;
-    if (loadShaderCode(file_name, shader_data))
-    {
-        std::cout << "Error opening shader file \"" + file_name + "\"." << std::endl;
-        return -1;
-    }
-
-    std::cout << "Shader file \"" << file_name << "\" loaded." << std::endl;
-
-    if (shader_type == ShaderType::VERTEX_SHADER)
-        shader_handle = glCreateShader(GL_VERTEX_SHADER);
-    else if (shader_type == ShaderType::FRAGMENT_SHADER)
-        shader_handle = glCreateShader(GL_FRAGMENT_SHADER);
-
-    const char *shader_code = shader_data.c_str();
-    glShaderSource(shader_handle, 1, &shader_code, nullptr);
-
-    if (compileShader(shader_handle))
-    {
-        std::cout << "Shader \"" << file_name << "\" compile error." << std::endl;
-        std::cout << "Shader compile log:" << std::endl;
-        std::cout << getShaderCompileMsg(shader_handle) << std::endl;
-        return -1;
-    }
-
-    std::cout << "Shader file \"" << file_name << "\" compile success." << std::endl;
-
-    return 0;
+    return shader_batch.resolve(handle);
 }
 //*************************************************************************************************
 int loadShaderCode(std::string file_name, std::string &shader_code)
@@ -667,16 +1086,6 @@ int linkShaderProgram(GLuint &shader_program, GLuint vertex_shader_handle,
     return 0;
 }
 //*************************************************************************************************
-int findUniform(GLuint shader_program, std::string uniform_name)
-{
-    GLint result = glGetUniformLocation(shader_program, uniform_name.c_str());
-
-    if (result == -1)
-        std::cout << "Uniform \"" << uniform_name << "\" not found." << std::endl;
-
-    return result;
-}
-//*************************************************************************************************
 void recalculateCamera()
 {
     camera_up = glm::cross(camera_right, camera_direction);
@@ -705,271 +1114,67 @@ void setCameraAngles(float horizontal, float vertical)
     view_matrix = glm::lookAt(camera_position, camera_position + camera_direction, camera_up);
 }
 //*************************************************************************************************
-void loadTextureSkybox(std::string front, std::string back, std::string left, std::string right,
-                       std::string up, std::string down, GLuint &texture_handle)
-{
-    glGenTextures(1, &texture_handle);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, texture_handle);
-
-    std::string textures[] = {right, left, down, up, back, front};
-
-    for (int i = 0; i < 6; i++)
-    {
-        Texture texture;
-        loadTexture(textures[i], texture);
-
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, texture.width, texture.height,
-                     0, GL_BGR, GL_UNSIGNED_BYTE, texture.bits);
-
-        freeTextureData(texture);
-    }
-
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-}
-//*************************************************************************************************
 int loadTexture(std::string file_name, Texture &texture)
 {
-    FREE_IMAGE_FORMAT image_format = FIF_UNKNOWN;
-    FIBITMAP *image_ptr = nullptr;
-    BYTE *bits = nullptr;
-
-    image_format = FreeImage_GetFileType(file_name.c_str(), 0);
-    if (image_format == FIF_UNKNOWN)
-        image_format = FreeImage_GetFIFFromFilename(file_name.c_str());
-
-    if (image_format == FIF_UNKNOWN)
+    for (auto &decoder : getImageDecoders())
     {
-        std::cout << "Texture \"" << file_name << "\" has unknown file format." << std::endl;
-        return -1;
-    }
-
-    if (FreeImage_FIFSupportsReading(image_format))
-        image_ptr = FreeImage_Load(image_format, file_name.c_str());
-
-    if (!image_ptr)
-    {
-        std::cout << "Unable to load texture \"" << file_name << "\"." << std::endl;
-        return -1;
-    }
-
-    bits = FreeImage_GetBits(image_ptr);
-
-    unsigned int image_width = 0;
-    unsigned int image_height = 0;
-    image_width = FreeImage_GetWidth(image_ptr);
-    image_height = FreeImage_GetHeight(image_ptr);
-
-    if ((bits == 0) || (image_width == 0) || (image_height == 0))
-    {
-        std::cout << "Texture \"" << file_name << "\" format error." << std::endl;
-        return -1;
+        if (decoder->decode(file_name, texture) == 0)
+        {
+            std::cout << "Texture \"" << file_name << "\" loaded (" << decoder->getName() << ")."
+                      << std::endl;
+            return 0;
+        }
     }
 
-    std::cout << "Texture \"" << file_name << "\" loaded." << std::endl;
-
-    texture.bits = bits;
-    texture.image_ptr = image_ptr;
-    texture.width = image_width;
-    texture.height = image_height;
-
-    return 0;
+    std::cout << "Unable to load texture \"" << file_name << "\"." << std::endl;
+    return -1;
 }
 //*************************************************************************************************
 void freeTextureData(Texture &texture)
 {
-    FreeImage_Unload(texture.image_ptr);
-}
-//*************************************************************************************************
-int loadSceneFromFile(std::string file_name, std::vector<Mesh*>& mesh_handle)
-{
-    const aiScene* scene = aiImportFile(file_name.c_str(), aiProcessPreset_TargetRealtime_Fast);
-    if (!scene)
-    {
-        std::cout << "Mesh file \"" << file_name << "\" not found." << std::endl;
-        return -1;
-    }
-
-    std::vector<Mesh*> complete_mesh;
-
-    for (unsigned int m = 0; m != scene->mNumMeshes; m++)
-    {
-        aiMesh *mesh = scene->mMeshes[m];
-
-        Mesh *mesh_entity = new Mesh();
-        std::vector<GLfloat> position_container;
-        std::vector<GLfloat> normal_vector_container;
-        std::vector<GLfloat> texture_coord_container;
-
-        for (unsigned int f = 0; f != mesh->mNumFaces; f++)
-        {
-            const aiFace *face = &mesh->mFaces[f];
-
-            for (unsigned int v = 0; v != 3; v++)
-            {
-                aiVector3D position{0, 0, 0};
-                aiVector3D normal_vector{0, 0, 0};
-                aiVector3D texture_coords{0, 0, 0};
-
-                if (mesh->HasPositions())
-                    position = mesh->mVertices[face->mIndices[v]];
-
-                if (mesh->HasNormals())
-                    normal_vector = mesh->mNormals[face->mIndices[v]];
-
-                if (mesh->HasTextureCoords(0))
-                    texture_coords = mesh->mTextureCoords[0][face->mIndices[v]];
-
-                position_container.push_back(position.x);
-                position_container.push_back(position.y);
-                position_container.push_back(position.z);
-
-                normal_vector_container.push_back(normal_vector.x);
-                normal_vector_container.push_back(normal_vector.y);
-                normal_vector_container.push_back(normal_vector.z);
-
-                texture_coord_container.push_back(texture_coords.x);
-                texture_coord_container.push_back(texture_coords.y);
-            }
-        }
-
-        GLuint position_vbo = 0;
-        glGenBuffers(1, &position_vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, position_vbo);
-        glBufferData(GL_ARRAY_BUFFER, position_container.size() * sizeof(GLfloat),
-                     position_container.data(), GL_STATIC_DRAW);
-
-        GLuint normal_vector_vbo = 0;
-        glGenBuffers(1, &normal_vector_vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, normal_vector_vbo);
-        glBufferData(GL_ARRAY_BUFFER, normal_vector_container.size() * sizeof(GLfloat),
-                     normal_vector_container.data(), GL_STATIC_DRAW);
-
-        GLuint texture_coord_vbo = 0;
-        glGenBuffers(1, &texture_coord_vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, texture_coord_vbo);
-        glBufferData(GL_ARRAY_BUFFER, texture_coord_container.size() * sizeof(GLfloat),
-                     texture_coord_container.data(), GL_STATIC_DRAW);
-
-        glGenVertexArrays(1, &mesh_entity->handle);
-        glBindVertexArray(mesh_entity->handle);
-
-        glBindBuffer(GL_ARRAY_BUFFER, position_vbo);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    if (texture.image_ptr)
+        FreeImage_Unload(texture.image_ptr);
 
-        glBindBuffer(GL_ARRAY_BUFFER, normal_vector_vbo);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    unmapFile(texture.mapping);
+    std::vector<BYTE>().swap(texture.pixels);
 
-        glBindBuffer(GL_ARRAY_BUFFER, texture_coord_vbo);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
-
-        glEnableVertexAttribArray(0);
-        glEnableVertexAttribArray(1);
-        glEnableVertexAttribArray(2);
-
-        glBindVertexArray(0);
-
-        mesh_entity->vertices_count = position_container.size();
-
-        if (scene->mNumMaterials != 0)
-        {
-            const aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
-
-            aiString texture_path;
-
-            GLuint texture_diffuse = 0;
-            if (material->GetTexture(aiTextureType_DIFFUSE, 0, &texture_path) == AI_SUCCESS)
-            {
-                unsigned int found_pos = file_name.find_last_of("/\\");
-                std::string path = file_name.substr(0, found_pos);
-                std::string name(texture_path.C_Str());
-                if (name[0] == '/')
-                    name.erase(0, 1);
-
-                std::string file_path = path + "/" + name;
-
-                Texture tex;
-                if (loadTexture(file_path, tex))
-                    std::cout << "Texture \"" << file_path << "\" not found." << std::endl;
-                else
-                {
-                    loadTexture2D(texture_diffuse, tex);
-                    std::cout << "Texture \"" << file_path << "\" loaded." << std::endl;
-                }
-
-                freeTextureData(tex);
-            }
-
-            mesh_entity->diffuse_texture = texture_diffuse;
-        }
-
-        complete_mesh.push_back(mesh_entity);
-    }
-
-    mesh_handle = complete_mesh;
-
-    return 0;
+    texture.bits = nullptr;
+    texture.image_ptr = nullptr;
 }
 //*************************************************************************************************
-int loadTexture2D(GLuint& texture_handle, Texture texture)
+int loadTexture2D(JobSystem &jobs, GLuint& texture_handle, const Texture &texture)
 {
-    glGenTextures(1, &texture_handle);
-    glBindTexture(GL_TEXTURE_2D, texture_handle);
-
-    unsigned int colours = FreeImage_GetBPP(texture.image_ptr);
-    if (colours == 24)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texture.width, texture.height, 0, GL_BGR,
-                     GL_UNSIGNED_BYTE, texture.bits);
-    else if (colours == 32)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.width, texture.height, 0, GL_BGRA,
-                     GL_UNSIGNED_BYTE, texture.bits);
-
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    GLfloat anisotropy_factor = 0.0f;
-    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &anisotropy_factor);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy_factor);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
+    MipChain mip_chain;
+    if (generateMipChain(texture, MipFilter::BOX, true, &jobs, mip_chain))
+        return -1;
 
-    return 0;
+    return uploadMipChain(texture_handle, mip_chain);
 }
 //*************************************************************************************************
 void enableDepthTesting(bool state)
 {
-    glDepthFunc(GL_LESS);
-
-    if (state)
-        glEnable(GL_DEPTH_TEST);
-    else
-        glDisable(GL_DEPTH_TEST);
+    gl_state.depthFunc(GL_LESS);
+    gl_state.enable(GL_DEPTH_TEST, state);
 }
 //*************************************************************************************************
 void enableFaceCulling(bool state)
 {
-    glFrontFace(GL_CCW);
-    glCullFace(GL_BACK);
-
-    if (state)
-        glEnable(GL_CULL_FACE);
-    else
-        glDisable(GL_CULL_FACE);
+    gl_state.frontFace(GL_CCW);
+    gl_state.cullFace(GL_BACK);
+    gl_state.enable(GL_CULL_FACE, state);
 }
 //*************************************************************************************************
 bool renderingEnabled()
 {
-    if (glfwWindowShouldClose(window_handle))
+    // Headless benchmark has no window and ends after its frame count
+    if (window_handle && glfwWindowShouldClose(window_handle))
         return false;
 
     return true;
 }
 //*************************************************************************************************
-void FPSCounter(double& fps)
+// True when the average has just been refreshed, about once per second
+bool FPSCounter(double& fps)
 {
     static double prev_time = glfwGetTime();
     double actual_time = glfwGetTime();
@@ -985,6 +1190,8 @@ void FPSCounter(double& fps)
     }
 
     frames_counter++;
+
+    return frames_counter == 1;
 }
 //*************************************************************************************************
 void clearColor(float r, float g, float b)
@@ -997,36 +1204,18 @@ void clearColor(float r, float g, float b)
 //*************************************************************************************************
 void activateShaderProgram(GLuint shader_program)
 {
-    glUseProgram(shader_program);
+    gl_state.useProgram(shader_program);
 }
 //*************************************************************************************************
-void setUniform(GLint uniform_handle, GLint value)
+void drawArrays(GLenum mode, GLint first, GLsizei count)
 {
-    glUniform1iv(uniform_handle, 1, &value);
-}
-//*************************************************************************************************
-void setUniform(GLint uniform_handle, const glm::mat4 &matrix)
-{
-    glUniformMatrix4fv(uniform_handle, 1, GL_FALSE, glm::value_ptr(matrix));
-}
-//*************************************************************************************************
-void setUniform(GLint uniform_handle, const glm::vec3 &vector)
-{
-    glUniform3fv(uniform_handle, 1, glm::value_ptr(vector));
-}
-//*************************************************************************************************
-void drawMesh(const MeshHandle& mesh)
-{
-    for (const auto &it : mesh)
-    {
-        glBindVertexArray(it->handle); // TODO: Fix it !
-        // Diffuse texture
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, it->diffuse_texture);
+    glDrawArrays(mode, first, count);
 
-        glDrawArrays(GL_TRIANGLES, 0, it->vertices_count);
-        glBindVertexArray(0);
-    }
+    draw_stats.draw_calls++;
+    if (mode == GL_TRIANGLES)
+        draw_stats.triangles += count / 3;
+    else if (mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN)
+        draw_stats.triangles += std::max(count - 2, 0);
 }
 //*************************************************************************************************
 void processWindowEvents()
@@ -1041,55 +1230,69 @@ void terminate()
     glfwTerminate();
 }
 //*************************************************************************************************
-void pollKeyboad()
+InputState readInput()
+{
+    InputState input;
+    glfwGetCursorPos(window_handle, &input.cursor_x, &input.cursor_y);
+
+    const std::pair<int, std::uint8_t> keys[] = {
+        {GLFW_KEY_W, INPUT_FORWARD},
+        {GLFW_KEY_S, INPUT_BACK},
+        {GLFW_KEY_A, INPUT_LEFT},
+        {GLFW_KEY_D, INPUT_RIGHT},
+        {GLFW_KEY_ESCAPE, INPUT_EXIT},
+    };
+
+    for (const auto &key : keys)
+        if (glfwGetKey(window_handle, key.first))
+            input.buttons |= key.second;
+
+    if (glfwGetMouseButton(window_handle, GLFW_MOUSE_BUTTON_LEFT))
+        input.buttons |= INPUT_LOOK;
+
+    return input;
+}
+//*************************************************************************************************
+// All camera changes come from here, so a recorded input gives the same camera path
+void applyInput(const InputState &input)
 {
-    if (glfwGetKey(window_handle, GLFW_KEY_ESCAPE))
+    if (input.buttons & INPUT_EXIT)
         closeWindow(window_handle);
 
     bool camera_moved = false;
     float move_speed = 0.5f;
 
-    if (glfwGetKey(window_handle, GLFW_KEY_A))
+    if (input.buttons & INPUT_LEFT)
     {
         camera_position -= camera_right * move_speed;
         camera_moved = true;
     }
 
-    if (glfwGetKey(window_handle, GLFW_KEY_D))
+    if (input.buttons & INPUT_RIGHT)
     {
         camera_position += camera_right * move_speed;
         camera_moved = true;
     }
 
-    if (glfwGetKey(window_handle, GLFW_KEY_W))
+    if (input.buttons & INPUT_FORWARD)
     {
         camera_position += camera_direction * move_speed;
         camera_moved = true;
     }
 
-    if (glfwGetKey(window_handle, GLFW_KEY_S))
+    if (input.buttons & INPUT_BACK)
     {
         camera_position -= camera_direction * move_speed;
         camera_moved = true;
     }
 
-    if (camera_moved)
-        recalculateCamera();
-}
-//*************************************************************************************************
-void pollMouse()
-{
     static double cursor_x = 0;
     static double cursor_y = 0;
 
-    if (glfwGetMouseButton(window_handle, GLFW_MOUSE_BUTTON_LEFT))
+    if (input.buttons & INPUT_LOOK)
     {
-        double cur_x;
-        double cur_y;
-        glfwGetCursorPos(window_handle, &cur_x, &cur_y);
-
-        double x_diff = cursor_x - cur_x;
-        double y_diff = cursor_y - cur_y;
+        double x_diff = cursor_x - input.cursor_x;
+        double y_diff = cursor_y - input.cursor_y;
 
         float mouse_speed = 0.01f;
 
@@ -1102,14 +1305,13 @@ void pollMouse()
             camera_vertical_angle = -glm::half_pi<float>();
 
         setCameraAngles(camera_horizontal_angle, camera_vertical_angle);
-        recalculateCamera();
-
-        cursor_x = cur_x;
-        cursor_y = cur_y;
-    }
-    else
-    {
-        glfwGetCursorPos(window_handle, &cursor_x, &cursor_y);
+        camera_moved = true;
     }
+
+    cursor_x = input.cursor_x;
+    cursor_y = input.cursor_y;
+
+    if (camera_moved)
+        recalculateCamera();
 }
 //*************************************************************************************************
\ No newline at end of file
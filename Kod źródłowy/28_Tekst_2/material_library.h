@@ -0,0 +1,590 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Materials of lesson 28: diffuse textures packed into atlases and texture arrays,
+// streamed by distance. Included by main.cpp after its declarations.
+#ifndef TEKST_2_MATERIAL_LIBRARY_H
+#define TEKST_2_MATERIAL_LIBRARY_H
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+//******************************************************************************
+class MaterialLibrary
+{
+public:
+    MaterialLibrary(TextureStreamer &texture_streamer, unsigned int atlas_size,
+                    GLsizeiptr vram_budget)
+        : texture_streamer_(texture_streamer)
+    {
+        atlas_size_ = atlas_size;
+        vram_budget_ = vram_budget;
+    }
+
+    ~MaterialLibrary()
+    {
+        for (auto &texture_array : texture_arrays_)
+            gl_state.deleteTextures(1, &texture_array.handle);
+    }
+
+    // Bounding sphere of a mesh using the material, drives the required mip level
+    void addMeshBounds(int material, const glm::vec3 &center, float radius, float uv_extent)
+    {
+        if (material < 0)
+            return;
+
+        materials_[material].bounds.push_back(glm::vec4(center, radius));
+        materials_[material].uv_extent = std::max(materials_[material].uv_extent, uv_extent);
+    }
+
+    // Registers a diffuse texture during import. Textures whose UVs leave the 0..1 range
+    // repeat, so they can't be placed in the atlas.
+    int addTexture(std::string file_name, bool atlas_allowed)
+    {
+        for (unsigned int i = 0; i < materials_.size(); i++)
+        {
+            if (materials_[i].file_name == file_name)
+            {
+                materials_[i].atlas_allowed &= atlas_allowed;
+                return i;
+            }
+        }
+
+        FREE_IMAGE_FORMAT image_format = FreeImage_GetFileType(file_name.c_str(), 0);
+        if (image_format == FIF_UNKNOWN)
+            image_format = FreeImage_GetFIFFromFilename(file_name.c_str());
+
+        FIBITMAP *image_ptr = nullptr;
+        if (image_format != FIF_UNKNOWN && FreeImage_FIFSupportsReading(image_format))
+            image_ptr = FreeImage_Load(image_format, file_name.c_str(), FIF_LOAD_NOPIXELS);
+
+        if (!image_ptr)
+        {
+            std::cout << "Texture \"" << file_name << "\" not found." << std::endl;
+            return -1;
+        }
+
+        Material material;
+        material.file_name = file_name;
+        material.atlas_allowed = atlas_allowed;
+        material.width = FreeImage_GetWidth(image_ptr);
+        material.height = FreeImage_GetHeight(image_ptr);
+        material.bpp = FreeImage_GetBPP(image_ptr) == 24 ? 24 : 32;
+
+        FreeImage_Unload(image_ptr);
+
+        materials_.push_back(material);
+
+        return materials_.size() - 1;
+    }
+
+    // Groups same sized textures into texture arrays, the rest goes to atlas pages.
+    // Only coarse levels are streamed here, finer ones follow screen space demand.
+    void build()
+    {
+        std::map<std::vector<unsigned int>, std::vector<int>> groups;
+        for (unsigned int i = 0; i < materials_.size(); i++)
+        {
+            if (materials_[i].texture_array < 0)
+                groups[{materials_[i].width, materials_[i].height, materials_[i].bpp}].push_back(i);
+        }
+
+        std::vector<int> atlas_entries;
+
+        for (auto &group : groups)
+        {
+            const Material &first = materials_[group.second.front()];
+
+            if (group.second.size() == 1 && first.atlas_allowed &&
+                first.width <= atlas_size_ / 2 && first.height <= atlas_size_ / 2)
+            {
+                atlas_entries.push_back(group.second.front());
+                continue;
+            }
+
+            unsigned int levels_count = 1;
+            while ((std::max(first.width, first.height) >> levels_count) > 0)
+                levels_count++;
+
+            int texture_array = createTextureArray(first.width, first.height,
+                                                   group.second.size(), levels_count,
+                                                   first.bpp == 24 ? GL_RGB : GL_RGBA);
+
+            for (unsigned int layer = 0; layer < group.second.size(); layer++)
+            {
+                Material &material = materials_[group.second[layer]];
+                material.texture_array = texture_array;
+                material.layer = layer;
+                material.resident_level = levels_count;
+
+                texture_arrays_[texture_array].materials.push_back(group.second[layer]);
+            }
+        }
+
+        packAtlas(atlas_entries);
+
+        for (auto &texture_array : texture_arrays_)
+            requestLevels(texture_array, texture_array.allocated_level, texture_array.levels_count);
+
+        std::cout << "Material library: " << materials_.size() << " textures in "
+                  << texture_arrays_.size() << " texture arrays, "
+                  << resident_bytes_ / (1024 * 1024) << " MB resident." << std::endl;
+    }
+
+    float getLayer(int material)
+    {
+        return material < 0 ? 0.0f : static_cast<float>(materials_[material].layer);
+    }
+
+    GLuint getTextureArray(int material)
+    {
+        return material < 0 ? 0 : texture_arrays_[materials_[material].texture_array].handle;
+    }
+
+    void printResidencyStats()
+    {
+        std::cout << "Texture residency: " << resident_bytes_ / (1024 * 1024) << " MB of "
+                  << vram_budget_ / (1024 * 1024) << " MB budget, " << streamed_levels_
+                  << " levels streamed in, " << evicted_levels_ << " levels evicted."
+                  << std::endl;
+
+        for (auto &material : materials_)
+        {
+            if (material.texture_array < 0)
+                continue;
+
+            const TextureArray &texture_array = texture_arrays_[material.texture_array];
+
+            std::cout << "  \"" << material.file_name << "\" " << material.width << "x"
+                      << material.height << " array " << texture_array.handle << " layer "
+                      << material.layer << ": required level " << material.required_level
+                      << ", resident level " << material.resident_level << ", base level "
+                      << texture_array.base_level << ", unused for "
+                      << frame_ - texture_array.last_used_frame << " frames" << std::endl;
+        }
+    }
+
+    glm::vec2 remapUV(int material, const glm::vec2 &uv)
+    {
+        if (material < 0)
+            return uv;
+
+        const Material &entry = materials_[material];
+        return glm::vec2(entry.uv_offset.x + uv.x * entry.uv_scale.x,
+                         entry.uv_offset.y + uv.y * entry.uv_scale.y);
+    }
+
+    // Estimates required mip levels from projected mesh size, then streams in finer levels
+    // or evicts least recently used ones to stay within the budget.
+    void updateResidency(const glm::vec3 &camera_position, const glm::vec3 &camera_direction,
+                         const glm::mat4 &model_matrix, float fov, int viewport_height)
+    {
+        frame_++;
+
+        // Failed layers show the error colour on every allocated level and count as resident
+        for (auto &material : materials_)
+        {
+            if (material.texture_array < 0 ||
+                material.resident_level != TextureStreamer::LOAD_FAILED)
+                continue;
+
+            TextureArray &texture_array = texture_arrays_[material.texture_array];
+            material.failed = true;
+            material.resident_level = texture_array.allocated_level;
+            fillErrorColour(texture_array, material, texture_array.allocated_level,
+                            texture_array.levels_count);
+        }
+
+        float model_scale = glm::length(glm::vec3(model_matrix[0]));
+        float projection_factor = viewport_height / (2.0f * std::tan(fov * 0.5f));
+
+        for (auto &texture_array : texture_arrays_)
+            texture_array.required_level = texture_array.levels_count - 1;
+
+        for (auto &material : materials_)
+        {
+            if (material.texture_array < 0)
+                continue;
+
+            TextureArray &texture_array = texture_arrays_[material.texture_array];
+            material.required_level = texture_array.levels_count - 1;
+
+            float texels = std::max(material.width, material.height) * material.uv_extent;
+
+            for (auto &bounds : material.bounds)
+            {
+                glm::vec3 center = glm::vec3(model_matrix * glm::vec4(glm::vec3(bounds), 1.0f));
+                float radius = bounds.w * model_scale;
+
+                glm::vec3 to_center = center - camera_position;
+                if (glm::dot(to_center, camera_direction) < -radius)
+                    continue;
+
+                float distance = std::max(glm::length(to_center) - radius, 0.001f);
+                float projected_size = 2.0f * radius * projection_factor / distance;
+
+                int level = static_cast<int>(std::floor(std::log2(texels / projected_size)));
+                level = std::max(0, std::min(level, material.required_level));
+
+                material.required_level = level;
+                texture_array.last_used_frame = frame_;
+            }
+
+            texture_array.required_level = std::min(texture_array.required_level,
+                                                     material.required_level);
+        }
+
+        for (auto &texture_array : texture_arrays_)
+        {
+            if (texture_array.required_level >= texture_array.allocated_level ||
+                isStreaming(texture_array))
+                continue;
+
+            // Free least recently used levels until the finer levels fit, otherwise ask for less
+            int target_level = texture_array.required_level;
+            while (target_level < texture_array.allocated_level &&
+                   resident_bytes_ + getLevelsSize(texture_array, target_level,
+                                                   texture_array.allocated_level) > vram_budget_)
+            {
+                TextureArray *victim = findEvictionVictim(texture_array);
+                if (victim)
+                    evictLevel(*victim);
+                else
+                    target_level++;
+            }
+
+            if (target_level < texture_array.allocated_level)
+                requestLevels(texture_array, target_level, texture_array.allocated_level);
+        }
+
+        // Base level is lowered only once every layer has the level
+        for (auto &texture_array : texture_arrays_)
+        {
+            int base_level = texture_array.allocated_level;
+            for (auto &material : texture_array.materials)
+                base_level = std::max(base_level, std::min(materials_[material].resident_level,
+                                                           texture_array.levels_count - 1));
+
+            if (base_level != texture_array.base_level)
+            {
+                glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array.handle);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, base_level);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+                texture_array.base_level = base_level;
+            }
+        }
+    }
+
+protected:
+    struct Material
+    {
+        bool atlas_allowed = false;
+        bool failed = false;
+        float uv_extent = 1.0f;
+        glm::vec2 uv_offset{0.0f, 0.0f};
+        glm::vec2 uv_scale{1.0f, 1.0f};
+        int layer = 0;
+        int required_level = 0;
+        int resident_level = 0;
+        int texture_array = -1;
+        std::string file_name;
+        std::vector<glm::vec4> bounds;
+        unsigned int bpp = 0;
+        unsigned int height = 0;
+        unsigned int width = 0;
+        unsigned int x = 0;
+        unsigned int y = 0;
+    };
+
+    struct TextureArray
+    {
+        GLint internal_format = 0;
+        GLuint handle = 0;
+        int allocated_level = 0;
+        int base_level = 0;
+        int levels_count = 0;
+        int required_level = 0;
+        std::vector<int> materials;
+        unsigned int height = 0;
+        unsigned int layers = 0;
+        unsigned int width = 0;
+        unsigned long long last_used_frame = 0;
+    };
+
+    void allocateLevel(TextureArray &texture_array, int level)
+    {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, texture_array.internal_format,
+                     std::max(texture_array.width >> level, 1u),
+                     std::max(texture_array.height >> level, 1u), texture_array.layers, 0,
+                     GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+    }
+
+    int createTextureArray(unsigned int width, unsigned int height, unsigned int layers,
+                           int levels_count, GLint internal_format)
+    {
+        TextureArray texture_array;
+        texture_array.internal_format = internal_format;
+        texture_array.levels_count = levels_count;
+        texture_array.width = width;
+        texture_array.height = height;
+        texture_array.layers = layers;
+
+        // Only levels up to initial_size are allocated at load
+        const unsigned int initial_size = 128;
+        while (texture_array.allocated_level < levels_count - 1 &&
+               std::max(width, height) >> texture_array.allocated_level > initial_size)
+            texture_array.allocated_level++;
+
+        texture_array.base_level = texture_array.allocated_level;
+
+        glGenTextures(1, &texture_array.handle);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array.handle);
+
+        for (int level = texture_array.allocated_level; level < levels_count; level++)
+            allocateLevel(texture_array, level);
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, texture_array.base_level);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels_count - 1);
+
+        GLfloat anisotropy_factor = 0.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &anisotropy_factor);
+        glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy_factor);
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        // Layers are grey until the streamer fills them
+        GLuint framebuffer = 0;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+        const GLfloat placeholder_colour[] = {0.5f, 0.5f, 0.5f, 1.0f};
+        for (int level = texture_array.allocated_level; level < levels_count; level++)
+        {
+            for (unsigned int layer = 0; layer < layers; layer++)
+            {
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                          texture_array.handle, level, layer);
+                glClearBufferfv(GL_COLOR, 0, placeholder_colour);
+            }
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, default_framebuffer);
+        glDeleteFramebuffers(1, &framebuffer);
+
+        resident_bytes_ += getLevelsSize(texture_array, texture_array.allocated_level,
+                                         levels_count);
+
+        texture_arrays_.push_back(texture_array);
+
+        return texture_arrays_.size() - 1;
+    }
+
+    void evictLevel(TextureArray &texture_array)
+    {
+        int level = texture_array.allocated_level++;
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array.handle);
+        if (texture_array.base_level < texture_array.allocated_level)
+        {
+            texture_array.base_level = texture_array.allocated_level;
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, texture_array.base_level);
+        }
+
+        // Zero sized image releases the level storage
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, texture_array.internal_format, 0, 0, 0, 0,
+                     GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        for (auto &material : texture_array.materials)
+            materials_[material].resident_level = std::max(materials_[material].resident_level,
+                                                           texture_array.allocated_level);
+
+        resident_bytes_ -= getLevelsSize(texture_array, level, level + 1);
+        evicted_levels_++;
+    }
+
+    // Clears the region of the material on levels first_level..last_level - 1
+    void fillErrorColour(const TextureArray &texture_array, const Material &material,
+                         int first_level, int last_level)
+    {
+        GLuint framebuffer = 0;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        gl_state.enable(GL_SCISSOR_TEST, true);
+
+        const GLfloat error_colour[] = {1.0f, 0.0f, 1.0f, 1.0f};
+        for (int level = first_level; level < last_level; level++)
+        {
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_array.handle,
+                                      level, material.layer);
+            glScissor(material.x >> level, material.y >> level,
+                      std::max(material.width >> level, 1u),
+                      std::max(material.height >> level, 1u));
+            glClearBufferfv(GL_COLOR, 0, error_colour);
+        }
+
+        gl_state.enable(GL_SCISSOR_TEST, false);
+        glBindFramebuffer(GL_FRAMEBUFFER, default_framebuffer);
+        glDeleteFramebuffers(1, &framebuffer);
+    }
+
+    // Least recently used array holding levels finer than it currently needs
+    TextureArray* findEvictionVictim(const TextureArray &requester)
+    {
+        TextureArray *victim = nullptr;
+
+        for (auto &texture_array : texture_arrays_)
+        {
+            if (&texture_array == &requester || isStreaming(texture_array) ||
+                texture_array.allocated_level >= texture_array.required_level)
+                continue;
+
+            if (!victim || texture_array.last_used_frame < victim->last_used_frame)
+                victim = &texture_array;
+        }
+
+        return victim;
+    }
+
+    GLsizeiptr getLevelsSize(const TextureArray &texture_array, int first_level, int last_level)
+    {
+        GLsizeiptr size = 0;
+        for (int level = first_level; level < last_level; level++)
+            size += static_cast<GLsizeiptr>(std::max(texture_array.width >> level, 1u)) *
+                    std::max(texture_array.height >> level, 1u) * texture_array.layers * 4;
+
+        return size;
+    }
+
+    bool isStreaming(const TextureArray &texture_array)
+    {
+        for (auto &material : texture_array.materials)
+        {
+            if (materials_[material].resident_level > texture_array.allocated_level)
+                return true;
+        }
+
+        return false;
+    }
+
+    // Shelf packing. Entries are aligned so every atlas mip level addresses them exactly, and
+    // separated by a gutter of one texel on the coarsest level so filtering stays inside them.
+    void packAtlas(std::vector<int> entries)
+    {
+        if (entries.empty())
+            return;
+
+        const unsigned int atlas_levels = 6;
+        const unsigned int alignment = 1 << (atlas_levels - 1);
+        const unsigned int gutter = alignment;
+
+        std::sort(entries.begin(), entries.end(), [this](int a, int b) {
+            return materials_[a].height > materials_[b].height;
+        });
+
+        unsigned int page = 0;
+        unsigned int shelf_x = 0;
+        unsigned int shelf_y = 0;
+        unsigned int shelf_height = 0;
+
+        for (auto &entry : entries)
+        {
+            Material &material = materials_[entry];
+
+            unsigned int width = (material.width + alignment - 1) & ~(alignment - 1);
+            unsigned int height = (material.height + alignment - 1) & ~(alignment - 1);
+            width += gutter * 2;
+            height += gutter * 2;
+
+            if (shelf_x + width > atlas_size_)
+            {
+                shelf_x = 0;
+                shelf_y += shelf_height;
+                shelf_height = 0;
+            }
+
+            if (shelf_y + height > atlas_size_)
+            {
+                page++;
+                shelf_x = 0;
+                shelf_y = 0;
+                shelf_height = 0;
+            }
+
+            material.layer = page;
+            material.x = shelf_x + gutter;
+            material.y = shelf_y + gutter;
+            material.uv_offset = glm::vec2(material.x, material.y) /
+                                 static_cast<float>(atlas_size_);
+            material.uv_scale = glm::vec2(material.width, material.height) /
+                                static_cast<float>(atlas_size_);
+
+            shelf_x += width;
+            shelf_height = std::max(shelf_height, height);
+        }
+
+        int atlas = createTextureArray(atlas_size_, atlas_size_, page + 1, atlas_levels, GL_RGBA);
+
+        for (auto &entry : entries)
+        {
+            materials_[entry].texture_array = atlas;
+            materials_[entry].resident_level = atlas_levels;
+        }
+
+        texture_arrays_[atlas].materials = entries;
+
+        std::cout << "Atlas: " << entries.size() << " textures on " << page + 1 << " pages."
+                  << std::endl;
+    }
+
+    // Allocates and streams levels first_level..last_level - 1 of every layer
+    void requestLevels(TextureArray &texture_array, int first_level, int last_level)
+    {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array.handle);
+        for (int level = first_level; level < texture_array.allocated_level; level++)
+            allocateLevel(texture_array, level);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        resident_bytes_ += getLevelsSize(texture_array, first_level,
+                                         texture_array.allocated_level);
+        streamed_levels_ += texture_array.allocated_level - first_level;
+
+        texture_array.allocated_level = first_level;
+
+        for (auto &material : texture_array.materials)
+        {
+            Material &entry = materials_[material];
+            if (entry.failed)
+            {
+                fillErrorColour(texture_array, entry, first_level, last_level);
+                entry.resident_level = first_level;
+                continue;
+            }
+
+            texture_streamer_.requestTextureLayer(entry.file_name, texture_array.handle,
+                                                  entry.layer, entry.x, entry.y, first_level,
+                                                  last_level, &entry.resident_level);
+        }
+    }
+
+protected:
+    TextureStreamer &texture_streamer_;
+    GLsizeiptr evicted_levels_{0};
+    GLsizeiptr resident_bytes_{0};
+    GLsizeiptr streamed_levels_{0};
+    GLsizeiptr vram_budget_{0};
+    std::deque<Material> materials_;
+    std::vector<TextureArray> texture_arrays_;
+    unsigned int atlas_size_{0};
+    unsigned long long frame_{0};
+
+};
+
+#endif
@@ -1,16 +1,33 @@
 #version 330
 in vec2 texture_coordinates;
+flat in float texture_layer;
 in vec3 vertex_to_camera;
 in vec3 normal_to_camera;
 
-uniform mat4 view_matrix;
-uniform sampler2D basic_texture;
+layout(std140) uniform Camera
+{
+    mat4 view_matrix;
+    mat4 projection_matrix;
+    mat4 view_projection_matrix;
+    mat4 sky_view_projection_matrix;
+    vec4 camera_position;
+};
+
+uniform sampler2DArray basic_texture;
+
+// Three texels per light: view position and radius, colour and spot cutoff, view direction
+uniform samplerBuffer light_data;
+// Offset and count into light_indices for every cluster
+uniform usamplerBuffer light_clusters;
+uniform usamplerBuffer light_indices;
+// Viewport size in pixels, scale and bias of the logarithmic depth slices
+uniform vec4 cluster_grid;
 
 out vec4 frag_colour;
 
-vec3 light_position = vec3(0.0, 3.0, 0.0);
+const uvec3 clusters_count = uvec3(16u, 9u, 24u);
+
 vec3 ambient_color = vec3(0.4, 0.4, 0.4);
-vec3 diffuse_color = vec3(0.8, 0.8, 0.8);
 vec3 specular_color = vec3(1.0, 1.0, 1.0);
 
 vec3 object_ambient_factor = vec3(1.0, 1.0, 1.0);
@@ -22,22 +39,53 @@ void main()
    // Ambient
    vec3 ambient_intense = ambient_color * object_ambient_factor;  
 
-   // Diffuse
-   vec3 distance_to_light = vec3(view_matrix * vec4(light_position, 1.0)) - vertex_to_camera;
-   vec3 light_direction = normalize(distance_to_light);
-   float dot_product = dot(light_direction, normal_to_camera);
-   dot_product = max(dot_product, 0.0);
-   vec3 diffuse_intense = diffuse_color * object_diffuse_factor * dot_product;  
+   // Cluster of this fragment
+   float depth = -vertex_to_camera.z;
+   uint slice = uint(clamp(log(depth) * cluster_grid.z - cluster_grid.w, 0.0,
+                           float(clusters_count.z - 1u)));
+   // Same NDC tiles the lights are binned into on the CPU
+   uvec2 tile = min(uvec2(gl_FragCoord.xy * vec2(clusters_count.xy) / cluster_grid.xy),
+                    clusters_count.xy - 1u);
+   uint cluster = tile.x + clusters_count.x * (tile.y + clusters_count.y * slice);
+   uvec2 light_range = texelFetch(light_clusters, int(cluster)).xy;
 
-   // Specular
-   vec3 reflection = reflect(-light_direction, normal_to_camera);
    vec3 surface_to_camera = normalize(-vertex_to_camera);
-   float dot_specular = dot(reflection, surface_to_camera);
-   dot_specular = max(dot_specular, 0.0);
-   float specular_power = 10.0;
-   float specular_factor = pow(dot_specular, specular_power);
-   vec3 specular_intense = specular_color * object_specular_factor * specular_factor; 
+   vec3 diffuse_intense = vec3(0.0);
+   vec3 specular_intense = vec3(0.0);
+
+   for (uint i = 0u; i < light_range.y; i++)
+   {
+      int light = int(texelFetch(light_indices, int(light_range.x + i)).x) * 3;
+      vec4 position_radius = texelFetch(light_data, light);
+      vec4 colour_cutoff = texelFetch(light_data, light + 1);
+
+      vec3 distance_to_light = position_radius.xyz - vertex_to_camera;
+      float light_distance = length(distance_to_light);
+      vec3 light_direction = distance_to_light / light_distance;
+
+      float attenuation = clamp(1.0 - light_distance / position_radius.w, 0.0, 1.0);
+      attenuation *= attenuation;
+
+      if (colour_cutoff.w > -1.0)
+      {
+         vec3 spot_direction = texelFetch(light_data, light + 2).xyz;
+         float spot_cosine = dot(-light_direction, spot_direction);
+         attenuation *= clamp((spot_cosine - colour_cutoff.w) / 0.1, 0.0, 1.0);
+      }
+
+      // Diffuse
+      float dot_product = max(dot(light_direction, normal_to_camera), 0.0);
+      diffuse_intense += colour_cutoff.rgb * object_diffuse_factor * dot_product * attenuation;
+
+      // Specular
+      vec3 reflection = reflect(-light_direction, normal_to_camera);
+      float dot_specular = max(dot(reflection, surface_to_camera), 0.0);
+      float specular_power = 10.0;
+      float specular_factor = pow(dot_specular, specular_power);
+      specular_intense += specular_color * object_specular_factor * specular_factor *
+                          attenuation;
+   }
 
-   vec4 texel = texture(basic_texture, texture_coordinates);   
+   vec4 texel = texture(basic_texture, vec3(texture_coordinates, texture_layer));   
    frag_colour = vec4(ambient_intense + diffuse_intense + specular_intense, 1.0) * texel;
 }
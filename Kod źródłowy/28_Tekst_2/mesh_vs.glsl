@@ -2,20 +2,29 @@
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal_vector;
 layout(location = 2) in vec2 vt;
+layout(location = 3) in float layer;
 
-uniform mat4 view_matrix;
-uniform mat4 projection_matrix;
-uniform mat4 model_matrix;
+layout(std140) uniform Object
+{
+    mat4 mvp_matrix;
+    mat4 model_view_matrix;
+    mat4 normal_matrix;
+};
  
 out vec2 texture_coordinates;
+flat out float texture_layer;
 out vec3 vertex_to_camera;
 out vec3 normal_to_camera;
+
+// Depth of the pre-pass is compared with GL_LEQUAL
+invariant gl_Position;
  
 void main() 
 {
-   normal_to_camera = vec3(view_matrix * vec4(normal_vector, 0.0));
-   vertex_to_camera = vec3(view_matrix * vec4(position, 1.0));
+   normal_to_camera = normalize(mat3(normal_matrix) * normal_vector);
+   vertex_to_camera = vec3(model_view_matrix * vec4(position, 1.0));
 
    texture_coordinates = vt;
-   gl_Position = projection_matrix * view_matrix * model_matrix *  vec4(position, 1.0);
+   texture_layer = layer;
+   gl_Position = mvp_matrix * vec4(position, 1.0);
 }
@@ -0,0 +1,498 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Mip chains of lesson 28, filtered on the CPU and cached next to the source
+// images. Included by main.cpp after its declarations.
+#ifndef TEKST_2_MIP_CHAIN_H
+#define TEKST_2_MIP_CHAIN_H
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+//******************************************************************************
+enum class MipFilter
+{
+    BOX,
+    KAISER,
+    LANCZOS,
+};
+
+struct MipLevel
+{
+    std::vector<BYTE> bits;
+    unsigned int height = 0;
+    unsigned int pitch = 0;
+    unsigned int width = 0;
+};
+
+struct MipChain
+{
+    std::vector<MipLevel> levels;
+    unsigned int bpp = 0;
+};
+
+int generateMipChain(const Texture &texture, MipFilter filter, bool gamma_correct,
+                     JobSystem *jobs, MipChain &mip_chain);
+int hashFile(std::string file_name, std::uint64_t &hash);
+int loadMipChain(std::string file_name, std::uint64_t source_hash, MipChain &mip_chain);
+int loadTextureMipChain(std::string file_name, MipFilter filter, JobSystem *jobs,
+                        std::uint64_t &source_hash, MipChain &mip_chain);
+int saveMipChain(std::string file_name, std::uint64_t source_hash, const MipChain &mip_chain);
+int uploadMipChain(GLuint &texture_handle, const MipChain &mip_chain);
+std::uint64_t hashData(const void *data, std::size_t size, std::uint64_t hash);
+void filterMipColumns(const float *source, unsigned int source_width, unsigned int target_width,
+                      const std::vector<int> &offsets, const std::vector<float> &weights,
+                      float *target, unsigned int first_row, unsigned int last_row);
+void filterMipRows(const float *source, unsigned int source_height, unsigned int width,
+                   const std::vector<int> &offsets, const std::vector<float> &weights,
+                   float *target, unsigned int first_row, unsigned int last_row);
+//*************************************************************************************************
+// Without a job system the calling thread filters all rows itself
+int generateMipChain(const Texture &texture, MipFilter filter, bool gamma_correct,
+                     JobSystem *jobs, MipChain &mip_chain)
+{
+    static const std::vector<float> srgb_to_linear = [] {
+        std::vector<float> table(256);
+        for (unsigned int i = 0; i < table.size(); i++)
+        {
+            float value = i / 255.0f;
+            table[i] = value <= 0.04045f ? value / 12.92f :
+                                           std::pow((value + 0.055f) / 1.055f, 2.4f);
+        }
+        return table;
+    }();
+
+    static const std::vector<BYTE> linear_to_srgb = [] {
+        std::vector<BYTE> table(4096);
+        for (unsigned int i = 0; i < table.size(); i++)
+        {
+            float value = i / 4095.0f;
+            value = value <= 0.0031308f ? value * 12.92f :
+                                          1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+            table[i] = static_cast<BYTE>(value * 255.0f + 0.5f);
+        }
+        return table;
+    }();
+
+    unsigned int bpp = texture.bpp;
+    if (bpp != 24 && bpp != 32)
+        return -1;
+
+    unsigned int channels = bpp / 8;
+    unsigned int source_width = texture.width;
+    unsigned int source_height = texture.height;
+
+    // Taps of a 2:1 reduction, the same kernel serves both separable passes
+    std::vector<int> offsets;
+    std::vector<float> weights;
+
+    if (filter == MipFilter::BOX)
+    {
+        offsets = {0, 1};
+        weights = {0.5f, 0.5f};
+    }
+    else
+    {
+        const float kaiser_alpha = 4.0f;
+        const float support = 3.0f;
+
+        auto sinc = [](float x) {
+            if (x == 0.0f)
+                return 1.0f;
+
+            x *= glm::pi<float>();
+            return std::sin(x) / x;
+        };
+
+        auto bessel = [](float x) {
+            float sum = 1.0f;
+            float term = 1.0f;
+            for (int k = 1; k < 16; k++)
+            {
+                term *= (x / (2.0f * k)) * (x / (2.0f * k));
+                sum += term;
+            }
+            return sum;
+        };
+
+        float weights_sum = 0.0f;
+        for (int k = -5; k <= 6; k++)
+        {
+            float x = (k - 0.5f) / 2.0f;
+            float window = 0.0f;
+            if (filter == MipFilter::LANCZOS)
+                window = sinc(x / support);
+            else
+                window = bessel(kaiser_alpha * std::sqrt(1.0f - (x / support) * (x / support))) /
+                         bessel(kaiser_alpha);
+
+            offsets.push_back(k);
+            weights.push_back(sinc(x) * window);
+            weights_sum += weights.back();
+        }
+
+        for (auto &weight : weights)
+            weight /= weights_sum;
+    }
+
+    mip_chain.bpp = bpp;
+    mip_chain.levels.clear();
+
+    MipLevel base_level;
+    base_level.width = source_width;
+    base_level.height = source_height;
+    base_level.pitch = texture.pitch;
+    base_level.bits.assign(texture.bits, texture.bits + base_level.pitch * source_height);
+    mip_chain.levels.push_back(base_level);
+
+    // Filtering is done on linear RGBA floats, alpha is never gamma corrected
+    std::vector<float> source(source_width * source_height * 4, 1.0f);
+    for (unsigned int y = 0; y < source_height; y++)
+    {
+        const BYTE *row = base_level.bits.data() + y * base_level.pitch;
+        for (unsigned int x = 0; x < source_width; x++)
+        {
+            for (unsigned int c = 0; c < channels; c++)
+            {
+                BYTE value = row[x * channels + c];
+                source[(y * source_width + x) * 4 + c] = gamma_correct && c < 3 ?
+                                                         srgb_to_linear[value] : value / 255.0f;
+            }
+        }
+    }
+
+    std::vector<float> rows_pass;
+    std::vector<float> target;
+
+    while (source_width > 1 || source_height > 1)
+    {
+        unsigned int target_width = std::max(source_width / 2, 1u);
+        unsigned int target_height = std::max(source_height / 2, 1u);
+
+        rows_pass.assign(source_width * target_height * 4, 0.0f);
+        target.assign(target_width * target_height * 4, 0.0f);
+
+        // Bands of rows are independent, so each thread runs both passes on its own band
+        auto filter_band = [&](unsigned int first_row, unsigned int last_row) {
+            filterMipRows(source.data(), source_height, source_width, offsets, weights,
+                          rows_pass.data(), first_row, last_row);
+            filterMipColumns(rows_pass.data(), source_width, target_width, offsets, weights,
+                             target.data(), first_row, last_row);
+        };
+
+        // Four bands per thread leave room for stealing, small levels are not worth a task
+        if (jobs && target_width * target_height >= 128 * 128)
+        {
+            int grain = std::max(1u, target_height / (jobs->getThreadsCount() * 4));
+            JobSystem::Job bands_job = jobs->parallelFor(0, target_height, grain,
+                                                         [&](int first, int last) {
+                filter_band(first, last);
+            });
+            jobs->wait(bands_job);
+        }
+        else
+        {
+            filter_band(0, target_height);
+        }
+
+        MipLevel level;
+        level.width = target_width;
+        level.height = target_height;
+        level.pitch = (target_width * channels + 3) & ~3u;
+        level.bits.resize(level.pitch * target_height);
+
+        for (unsigned int y = 0; y < target_height; y++)
+        {
+            BYTE *row = level.bits.data() + y * level.pitch;
+            for (unsigned int x = 0; x < target_width; x++)
+            {
+                for (unsigned int c = 0; c < channels; c++)
+                {
+                    float value = glm::clamp(target[(y * target_width + x) * 4 + c], 0.0f, 1.0f);
+                    row[x * channels + c] = gamma_correct && c < 3 ?
+                        linear_to_srgb[static_cast<unsigned int>(value * 4095.0f + 0.5f)] :
+                        static_cast<BYTE>(value * 255.0f + 0.5f);
+                }
+            }
+        }
+
+        mip_chain.levels.push_back(level);
+
+        source.swap(target);
+        source_width = target_width;
+        source_height = target_height;
+    }
+
+    return 0;
+}
+//*************************************************************************************************
+void filterMipRows(const float *source, unsigned int source_height, unsigned int width,
+                   const std::vector<int> &offsets, const std::vector<float> &weights,
+                   float *target, unsigned int first_row, unsigned int last_row)
+{
+    unsigned int row_size = width * 4;
+
+    for (unsigned int y = first_row; y < last_row; y++)
+    {
+        float *target_row = target + y * row_size;
+
+        for (std::size_t k = 0; k < offsets.size(); k++)
+        {
+            int source_y = std::min(std::max(static_cast<int>(2 * y) + offsets[k], 0),
+                                    static_cast<int>(source_height) - 1);
+            const float *source_row = source + source_y * row_size;
+
+            unsigned int x = 0;
+#if defined(__AVX__)
+            __m256 weight_8 = _mm256_set1_ps(weights[k]);
+            for (; x + 8 <= row_size; x += 8)
+            {
+                __m256 sum = _mm256_loadu_ps(target_row + x);
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(source_row + x), weight_8));
+                _mm256_storeu_ps(target_row + x, sum);
+            }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+            __m128 weight_4 = _mm_set1_ps(weights[k]);
+            for (; x + 4 <= row_size; x += 4)
+            {
+                __m128 sum = _mm_loadu_ps(target_row + x);
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(source_row + x), weight_4));
+                _mm_storeu_ps(target_row + x, sum);
+            }
+#endif
+            for (; x < row_size; x++)
+                target_row[x] += source_row[x] * weights[k];
+        }
+    }
+}
+//*************************************************************************************************
+void filterMipColumns(const float *source, unsigned int source_width, unsigned int target_width,
+                      const std::vector<int> &offsets, const std::vector<float> &weights,
+                      float *target, unsigned int first_row, unsigned int last_row)
+{
+    for (unsigned int y = first_row; y < last_row; y++)
+    {
+        const float *source_row = source + y * source_width * 4;
+        float *target_row = target + y * target_width * 4;
+
+        for (unsigned int x = 0; x < target_width; x++)
+        {
+#if defined(__SSE2__) || defined(_M_X64)
+            __m128 sum = _mm_setzero_ps();
+#else
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+#endif
+            for (std::size_t k = 0; k < offsets.size(); k++)
+            {
+                int source_x = std::min(std::max(static_cast<int>(2 * x) + offsets[k], 0),
+                                        static_cast<int>(source_width) - 1);
+#if defined(__SSE2__) || defined(_M_X64)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(source_row + source_x * 4),
+                                                 _mm_set1_ps(weights[k])));
+#else
+                for (unsigned int c = 0; c < 4; c++)
+                    sum[c] += source_row[source_x * 4 + c] * weights[k];
+#endif
+            }
+#if defined(__SSE2__) || defined(_M_X64)
+            _mm_storeu_ps(target_row + x * 4, sum);
+#else
+            for (unsigned int c = 0; c < 4; c++)
+                target_row[x * 4 + c] = sum[c];
+#endif
+        }
+    }
+}
+//*************************************************************************************************
+int uploadMipChain(GLuint &texture_handle, const MipChain &mip_chain)
+{
+    if (mip_chain.levels.empty())
+        return -1;
+
+    glGenTextures(1, &texture_handle);
+    glBindTexture(GL_TEXTURE_2D, texture_handle);
+
+    GLint unpack_alignment = 0;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    for (unsigned int i = 0; i < mip_chain.levels.size(); i++)
+    {
+        const MipLevel &level = mip_chain.levels[i];
+        if (mip_chain.bpp == 24)
+            glTexImage2D(GL_TEXTURE_2D, i, GL_RGB, level.width, level.height, 0, GL_BGR,
+                         GL_UNSIGNED_BYTE, level.bits.data());
+        else
+            glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, level.width, level.height, 0, GL_BGRA,
+                         GL_UNSIGNED_BYTE, level.bits.data());
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mip_chain.levels.size() - 1);
+
+    GLfloat anisotropy_factor = 0.0f;
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &anisotropy_factor);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy_factor);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return 0;
+}
+//*************************************************************************************************
+// Source hash is computed when it is 0, callers keep it so the source is read only once
+int loadTextureMipChain(std::string file_name, MipFilter filter, JobSystem *jobs,
+                        std::uint64_t &source_hash, MipChain &mip_chain)
+{
+    if (source_hash == 0)
+    {
+        if (hashFile(file_name, source_hash))
+        {
+            std::cout << "Unable to load texture \"" << file_name << "\"." << std::endl;
+            return -1;
+        }
+
+        int filter_id = static_cast<int>(filter);
+        source_hash = hashData(&filter_id, sizeof(filter_id), source_hash);
+    }
+
+    // Mip chain is cached next to the source image and reused while the source is unchanged
+    std::string cache_file_name = file_name + ".mips";
+    if (loadMipChain(cache_file_name, source_hash, mip_chain) == 0)
+    {
+        std::cout << "Texture \"" << file_name << "\" loaded from mip cache." << std::endl;
+        return 0;
+    }
+
+    Texture texture;
+    if (loadTexture(file_name, texture))
+        return -1;
+
+    int result = generateMipChain(texture, filter, true, jobs, mip_chain);
+    freeTextureData(texture);
+
+    if (result)
+        return -1;
+
+    if (saveMipChain(cache_file_name, source_hash, mip_chain))
+        std::cout << "Unable to write mip cache \"" << cache_file_name << "\"." << std::endl;
+
+    return 0;
+}
+//*************************************************************************************************
+int loadMipChain(std::string file_name, std::uint64_t source_hash, MipChain &mip_chain)
+{
+    std::ifstream cache_file(file_name, std::ios::in | std::ios::binary);
+    if (!cache_file.is_open())
+        return -1;
+
+    char magic[4] = {0, 0, 0, 0};
+    std::uint64_t stored_hash = 0;
+    std::uint32_t bpp = 0;
+    std::uint32_t levels_count = 0;
+
+    cache_file.read(magic, sizeof(magic));
+    cache_file.read(reinterpret_cast<char*>(&stored_hash), sizeof(stored_hash));
+    cache_file.read(reinterpret_cast<char*>(&bpp), sizeof(bpp));
+    cache_file.read(reinterpret_cast<char*>(&levels_count), sizeof(levels_count));
+
+    if (!cache_file || std::string(magic, 4) != "MIP1" || stored_hash != source_hash ||
+        (bpp != 24 && bpp != 32) || levels_count == 0 || levels_count > 32)
+        return -1;
+
+    mip_chain.bpp = bpp;
+    mip_chain.levels.resize(levels_count);
+
+    for (auto &level : mip_chain.levels)
+    {
+        std::uint32_t size[3] = {0, 0, 0};
+        cache_file.read(reinterpret_cast<char*>(size), sizeof(size));
+
+        level.width = size[0];
+        level.height = size[1];
+        level.pitch = size[2];
+
+        if (!cache_file || level.pitch < level.width * bpp / 8)
+            return -1;
+
+        level.bits.resize(level.pitch * level.height);
+        cache_file.read(reinterpret_cast<char*>(level.bits.data()), level.bits.size());
+    }
+
+    if (!cache_file)
+        return -1;
+
+    return 0;
+}
+//*************************************************************************************************
+int saveMipChain(std::string file_name, std::uint64_t source_hash, const MipChain &mip_chain)
+{
+    std::ofstream cache_file(file_name, std::ios::out | std::ios::binary);
+    if (!cache_file.is_open())
+        return -1;
+
+    std::uint32_t bpp = mip_chain.bpp;
+    std::uint32_t levels_count = mip_chain.levels.size();
+
+    cache_file.write("MIP1", 4);
+    cache_file.write(reinterpret_cast<const char*>(&source_hash), sizeof(source_hash));
+    cache_file.write(reinterpret_cast<const char*>(&bpp), sizeof(bpp));
+    cache_file.write(reinterpret_cast<const char*>(&levels_count), sizeof(levels_count));
+
+    for (const auto &level : mip_chain.levels)
+    {
+        std::uint32_t size[3] = {level.width, level.height, level.pitch};
+        cache_file.write(reinterpret_cast<const char*>(size), sizeof(size));
+        cache_file.write(reinterpret_cast<const char*>(level.bits.data()), level.bits.size());
+    }
+
+    if (!cache_file)
+        return -1;
+
+    return 0;
+}
+//*************************************************************************************************
+std::uint64_t hashData(const void *data, std::size_t size, std::uint64_t hash)
+{
+    // FNV-1a
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+//*************************************************************************************************
+int hashFile(std::string file_name, std::uint64_t &hash)
+{
+    std::ifstream file(file_name, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+        return -1;
+
+    hash = 14695981039346656037ull;
+
+    std::vector<char> buffer(64 * 1024);
+    while (file)
+    {
+        file.read(buffer.data(), buffer.size());
+        hash = hashData(buffer.data(), file.gcount(), hash);
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,74 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Overdraw of the opaque pass of lesson 28, counted with sample queries. Included by main.cpp
+// after its declarations.
+#ifndef TEKST_2_OVERDRAW_COUNTER_H
+#define TEKST_2_OVERDRAW_COUNTER_H
+
+#include <cstdint>
+//******************************************************************************
+// Samples passing the depth test of the opaque pass per screen sample, results are read a few
+// frames late so the query never stalls
+class OverdrawCounter
+{
+public:
+    OverdrawCounter()
+    {
+        glGenQueries(QUERIES_COUNT, queries_);
+    }
+
+    ~OverdrawCounter()
+    {
+        glDeleteQueries(QUERIES_COUNT, queries_);
+    }
+
+    void begin()
+    {
+        glBeginQuery(GL_SAMPLES_PASSED, queries_[next_query_]);
+    }
+
+    void end(std::uint64_t screen_samples)
+    {
+        glEndQuery(GL_SAMPLES_PASSED);
+        screen_samples_[next_query_] = screen_samples;
+        pending_[next_query_] = true;
+        next_query_ = (next_query_ + 1) % QUERIES_COUNT;
+
+        // Oldest query is the one issued next
+        if (!pending_[next_query_])
+            return;
+
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries_[next_query_], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+
+        GLuint64 samples_passed = 0;
+        glGetQueryObjectui64v(queries_[next_query_], GL_QUERY_RESULT, &samples_passed);
+        pending_[next_query_] = false;
+
+        if (screen_samples_[next_query_] > 0)
+            overdraw_ = static_cast<float>(samples_passed) / screen_samples_[next_query_];
+    }
+
+    float getOverdraw() const
+    {
+        return overdraw_;
+    }
+
+protected:
+    static const unsigned int QUERIES_COUNT = 4;
+
+protected:
+    bool pending_[QUERIES_COUNT] = {false, false, false, false};
+    float overdraw_{0.0f};
+    GLuint queries_[QUERIES_COUNT];
+    std::uint64_t screen_samples_[QUERIES_COUNT] = {0, 0, 0, 0};
+    unsigned int next_query_{0};
+
+};
+
+#endif
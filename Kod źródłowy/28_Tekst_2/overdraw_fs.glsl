@@ -0,0 +1,10 @@
+#version 330
+out vec4 frag_colour;
+
+// Added once per fragment, an RGBA8 target counts up to 31 layers
+const float layer_step = 8.0 / 255.0;
+
+void main()
+{
+   frag_colour = vec4(layer_step);
+}
@@ -0,0 +1,19 @@
+#version 330
+uniform sampler2D overdraw_buffer;
+
+out vec4 frag_colour;
+
+const float layer_step = 8.0 / 255.0;
+
+void main()
+{
+   float value = texelFetch(overdraw_buffer, ivec2(gl_FragCoord.xy), 0).r;
+   float layers = floor(value / layer_step + 0.5);
+
+   // Black where nothing was drawn, blue for one layer, through green to red at eight and more
+   float heat = clamp((layers - 1.0) / 7.0, 0.0, 1.0);
+   vec3 colour = heat < 0.5 ? mix(vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), heat * 2.0) :
+                              mix(vec3(0.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0), heat * 2.0 - 1.0);
+
+   frag_colour = vec4(layers > 0.0 ? colour : vec3(0.0), 1.0);
+}
@@ -0,0 +1,518 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Render graph of lesson 28: passes ordered by what they read and write, with transient
+// textures shared between passes. Included by main.cpp after its declarations.
+#ifndef TEKST_2_RENDER_GRAPH_H
+#define TEKST_2_RENDER_GRAPH_H
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+//******************************************************************************
+// Passes declare what they read and write, compile() orders them, culls unused ones and lets
+// transient textures with disjoint lifetimes share one GL texture
+class RenderGraph
+{
+public:
+    typedef int Resource;
+
+    ~RenderGraph()
+    {
+        releaseFramebuffers();
+        for (auto &texture : textures_pool_)
+            gl_state.deleteTextures(1, &texture.handle);
+    }
+
+    // Passes run in declaration order, a pass may only read what an earlier pass has written
+    void addPass(std::string name, std::vector<Resource> reads, std::vector<Resource> writes,
+                 std::function<void()> execute)
+    {
+        Pass pass;
+        pass.name = name;
+        pass.reads = reads;
+        pass.writes = writes;
+        pass.execute = execute;
+        passes_.push_back(pass);
+    }
+
+    int compile()
+    {
+        auto start_time = std::chrono::steady_clock::now();
+
+        // Producers of every resource, in declaration order
+        for (std::size_t i = 0; i < passes_.size(); i++)
+        {
+            Pass &pass = passes_[i];
+            pass.references = static_cast<unsigned int>(pass.writes.size());
+
+            // Target is either one imported framebuffer or a set of transient textures
+            bool valid_target = !pass.writes.empty();
+            for (Resource resource : pass.writes)
+                if (resources_[resource].imported != resources_[pass.writes[0]].imported)
+                    valid_target = false;
+            if (valid_target && resources_[pass.writes[0]].imported && pass.writes.size() > 1)
+                valid_target = false;
+
+            if (!valid_target)
+            {
+                std::cout << "Render graph pass \"" << pass.name << "\" has no valid target."
+                          << std::endl;
+                return -1;
+            }
+
+            for (Resource resource : pass.reads)
+            {
+                if (resources_[resource].producers.empty())
+                {
+                    std::cout << "Render graph pass \"" << pass.name << "\" reads \""
+                              << resources_[resource].name << "\" before it is written."
+                              << std::endl;
+                    return -1;
+                }
+
+                resources_[resource].readers++;
+            }
+
+            for (Resource resource : pass.writes)
+                resources_[resource].producers.push_back(i);
+        }
+
+        // Imported resources are read outside of the graph, everything else needs a reader
+        std::vector<Resource> unreferenced;
+        for (std::size_t i = 0; i < resources_.size(); i++)
+        {
+            if (resources_[i].imported)
+                resources_[i].readers++;
+            if (resources_[i].readers == 0)
+                unreferenced.push_back(static_cast<Resource>(i));
+        }
+
+        while (!unreferenced.empty())
+        {
+            Resource resource = unreferenced.back();
+            unreferenced.pop_back();
+
+            for (std::size_t producer : resources_[resource].producers)
+            {
+                Pass &pass = passes_[producer];
+                if (pass.culled || --pass.references > 0)
+                    continue;
+
+                pass.culled = true;
+                culled_passes_count_++;
+
+                for (Resource read : pass.reads)
+                    if (--resources_[read].readers == 0)
+                        unreferenced.push_back(read);
+            }
+        }
+
+        // Lifetime of every transient texture over the passes that remain
+        for (std::size_t i = 0; i < passes_.size(); i++)
+        {
+            if (passes_[i].culled)
+                continue;
+
+            for (const auto *list : {&passes_[i].reads, &passes_[i].writes})
+            {
+                for (Resource resource : *list)
+                {
+                    ResourceData &data = resources_[resource];
+                    if (data.first_pass < 0)
+                        data.first_pass = static_cast<int>(i);
+                    data.last_pass = static_cast<int>(i);
+                }
+            }
+        }
+
+        if (allocateTextures())
+            return -1;
+
+        logDecisions();
+
+        compile_time_ = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start_time).count();
+
+        return 0;
+    }
+
+    // Adds a texture that only lives within this frame
+    Resource createTexture(std::string name, int width, int height, GLenum internal_format)
+    {
+        ResourceData resource;
+        resource.name = name;
+        resource.width = width;
+        resource.height = height;
+        resource.internal_format = internal_format;
+        resources_.push_back(resource);
+
+        return static_cast<Resource>(resources_.size() - 1);
+    }
+
+    // Culled passes are skipped, every pass is a profiler scope
+    void execute(FrameProfiler &profiler)
+    {
+        auto start_time = std::chrono::steady_clock::now();
+
+        for (auto &pass : passes_)
+        {
+            if (pass.culled)
+                continue;
+
+            profiler.beginScope(pass.name);
+
+            GLuint framebuffer = getFramebuffer(pass);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+            const ResourceData &target = resources_[pass.writes.front()];
+            glViewport(0, 0, target.width, target.height);
+
+            pass.execute();
+
+            profiler.endScope();
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, default_framebuffer);
+
+        execute_time_ = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start_time).count();
+    }
+
+    double getCompileTime() const
+    {
+        return compile_time_;
+    }
+
+    unsigned int getCulledPassesCount() const
+    {
+        return culled_passes_count_;
+    }
+
+    double getExecuteTime() const
+    {
+        return execute_time_;
+    }
+
+    unsigned int getPassesCount() const
+    {
+        return static_cast<unsigned int>(passes_.size());
+    }
+
+    GLuint getTexture(Resource resource) const
+    {
+        return textures_pool_[resources_[resource].texture].handle;
+    }
+
+    unsigned int getTexturesCount() const
+    {
+        return static_cast<unsigned int>(textures_pool_.size());
+    }
+
+    std::size_t getTexturesMemorySize() const
+    {
+        std::size_t size = 0;
+        for (const auto &texture : textures_pool_)
+            size += static_cast<std::size_t>(texture.width) * texture.height *
+                    getPixelSize(texture.internal_format);
+
+        return size;
+    }
+
+    unsigned int getTransientsCount() const
+    {
+        unsigned int transients_count = 0;
+        for (const auto &resource : resources_)
+            if (!resource.imported)
+                transients_count++;
+
+        return transients_count;
+    }
+
+    // Framebuffer owned outside of the graph, e.g. the window, it is never culled
+    Resource importFramebuffer(std::string name, GLuint framebuffer, int width, int height)
+    {
+        ResourceData resource;
+        resource.name = name;
+        resource.width = width;
+        resource.height = height;
+        resource.imported = true;
+        resource.framebuffer = framebuffer;
+        resources_.push_back(resource);
+
+        return static_cast<Resource>(resources_.size() - 1);
+    }
+
+    // Graph is declared again every frame, the textures and framebuffers are kept
+    void reset()
+    {
+        passes_.clear();
+        resources_.clear();
+        culled_passes_count_ = 0;
+    }
+
+protected:
+    struct Pass
+    {
+        std::string name;
+        std::vector<Resource> reads;
+        std::vector<Resource> writes;
+        std::function<void()> execute;
+        bool culled = false;
+        unsigned int references = 0;
+    };
+
+    struct ResourceData
+    {
+        std::string name;
+        bool imported = false;
+        GLenum internal_format = 0;
+        GLuint framebuffer = 0;
+        int first_pass = -1;
+        int height = 0;
+        int last_pass = -1;
+        int texture = -1;
+        int width = 0;
+        std::vector<std::size_t> producers;
+        unsigned int readers = 0;
+    };
+
+    struct PooledTexture
+    {
+        GLuint handle = 0;
+        GLenum internal_format = 0;
+        int height = 0;
+        int width = 0;
+        int busy_until = -1;
+        // Previous transient in this texture, this frame
+        Resource owner = -1;
+        bool used = false;
+    };
+
+    // Textures are handed out in order of first use, a texture is free after its last reader
+    int allocateTextures()
+    {
+        std::vector<Resource> transients;
+        for (std::size_t i = 0; i < resources_.size(); i++)
+            if (!resources_[i].imported && resources_[i].first_pass >= 0)
+                transients.push_back(static_cast<Resource>(i));
+
+        std::sort(transients.begin(), transients.end(), [this](Resource a, Resource b) {
+            return resources_[a].first_pass < resources_[b].first_pass;
+        });
+
+        aliases_.clear();
+        for (auto &texture : textures_pool_)
+        {
+            texture.busy_until = -1;
+            texture.owner = -1;
+            texture.used = false;
+        }
+
+        for (Resource resource : transients)
+        {
+            ResourceData &data = resources_[resource];
+
+            for (std::size_t i = 0; i < textures_pool_.size() && data.texture < 0; i++)
+            {
+                PooledTexture &texture = textures_pool_[i];
+                if (texture.busy_until < data.first_pass && texture.width == data.width &&
+                    texture.height == data.height &&
+                    texture.internal_format == data.internal_format)
+                    data.texture = static_cast<int>(i);
+            }
+
+            if (data.texture < 0)
+            {
+                PooledTexture texture;
+                texture.width = data.width;
+                texture.height = data.height;
+                texture.internal_format = data.internal_format;
+                if (createPooledTexture(texture))
+                    return -1;
+
+                textures_pool_.push_back(texture);
+                data.texture = static_cast<int>(textures_pool_.size() - 1);
+            }
+
+            PooledTexture &texture = textures_pool_[data.texture];
+            if (texture.owner >= 0)
+                aliases_.push_back(std::make_pair(resource, texture.owner));
+
+            texture.busy_until = data.last_pass;
+            texture.owner = resource;
+            texture.used = true;
+        }
+
+        // Textures of an old viewport size or of a disabled path go away with their framebuffers
+        bool released = false;
+        for (std::size_t i = textures_pool_.size(); i-- > 0;)
+        {
+            if (textures_pool_[i].used)
+                continue;
+
+            gl_state.deleteTextures(1, &textures_pool_[i].handle);
+            textures_pool_.erase(textures_pool_.begin() + i);
+            released = true;
+        }
+
+        if (released)
+        {
+            releaseFramebuffers();
+            for (auto &data : resources_)
+                data.texture = -1;
+            return allocateTextures();
+        }
+
+        return 0;
+    }
+
+    static int createPooledTexture(PooledTexture &texture)
+    {
+        GLenum format = 0;
+        GLenum type = 0;
+        switch (texture.internal_format)
+        {
+        case GL_RGBA8:
+            format = GL_RGBA;
+            type = GL_UNSIGNED_BYTE;
+            break;
+        case GL_RGBA16F:
+            format = GL_RGBA;
+            type = GL_FLOAT;
+            break;
+        case GL_RG16F:
+            format = GL_RG;
+            type = GL_FLOAT;
+            break;
+        case GL_DEPTH24_STENCIL8:
+            format = GL_DEPTH_STENCIL;
+            type = GL_UNSIGNED_INT_24_8;
+            break;
+        default:
+            std::cout << "Unsupported render graph texture format: " << texture.internal_format
+                      << std::endl;
+            return -1;
+        }
+
+        glGenTextures(1, &texture.handle);
+        gl_state.bindTexture(0, GL_TEXTURE_2D, texture.handle);
+        glTexImage2D(GL_TEXTURE_2D, 0, texture.internal_format, texture.width, texture.height,
+                     0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        return 0;
+    }
+
+    // One framebuffer per distinct set of attached textures, built on first use
+    GLuint getFramebuffer(const Pass &pass)
+    {
+        const ResourceData &first_target = resources_[pass.writes.front()];
+        if (first_target.imported)
+            return first_target.framebuffer;
+
+        std::vector<GLuint> attachments;
+        for (Resource resource : pass.writes)
+            attachments.push_back(getTexture(resource));
+
+        auto it = framebuffers_.find(attachments);
+        if (it != framebuffers_.end())
+            return it->second;
+
+        GLuint framebuffer = 0;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+        std::vector<GLenum> draw_buffers;
+        for (Resource resource : pass.writes)
+        {
+            const ResourceData &data = resources_[resource];
+            GLenum attachment = GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(draw_buffers.size());
+            if (data.internal_format == GL_DEPTH24_STENCIL8)
+                attachment = GL_DEPTH_STENCIL_ATTACHMENT;
+            else
+                draw_buffers.push_back(attachment);
+
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, getTexture(resource),
+                                   0);
+        }
+
+        if (draw_buffers.empty())
+            glDrawBuffer(GL_NONE);
+        else
+            glDrawBuffers(static_cast<GLsizei>(draw_buffers.size()), draw_buffers.data());
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Render graph pass \"" << pass.name << "\" framebuffer incomplete."
+                      << std::endl;
+
+        framebuffers_[attachments] = framebuffer;
+
+        return framebuffer;
+    }
+
+    // Culled passes and shared textures are printed whenever they differ from the last frame
+    void logDecisions()
+    {
+        std::ostringstream decisions;
+        for (const auto &pass : passes_)
+            if (pass.culled)
+                decisions << "  pass \"" << pass.name << "\" culled\n";
+
+        for (const auto &alias : aliases_)
+            decisions << "  \"" << resources_[alias.first].name << "\" aliases \""
+                      << resources_[alias.second].name << "\"\n";
+
+        if (decisions.str() == last_decisions_)
+            return;
+
+        last_decisions_ = decisions.str();
+        std::cout << "Render graph, " << passes_.size() - culled_passes_count_ << "/"
+                  << passes_.size() << " passes, " << textures_pool_.size() << " textures for "
+                  << getTransientsCount() << " transients:\n"
+                  << last_decisions_ << std::flush;
+    }
+
+    static unsigned int getPixelSize(GLenum internal_format)
+    {
+        switch (internal_format)
+        {
+        case GL_RGBA16F:
+            return 8;
+        default:
+            return 4;
+        }
+    }
+
+    void releaseFramebuffers()
+    {
+        for (auto &framebuffer : framebuffers_)
+            glDeleteFramebuffers(1, &framebuffer.second);
+        framebuffers_.clear();
+    }
+
+protected:
+    double compile_time_{0.0};
+    double execute_time_{0.0};
+    std::map<std::vector<GLuint>, GLuint> framebuffers_;
+    std::string last_decisions_;
+    std::vector<std::pair<Resource, Resource>> aliases_;
+    std::vector<Pass> passes_;
+    std::vector<PooledTexture> textures_pool_;
+    std::vector<ResourceData> resources_;
+    unsigned int culled_passes_count_{0};
+
+};
+
+#endif
@@ -0,0 +1,267 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Shader programs of lesson 28, compiled as a batch and cached as driver binaries. Included
+// by main.cpp after its declarations.
+#ifndef TEKST_2_SHADER_PROGRAMS_H
+#define TEKST_2_SHADER_PROGRAMS_H
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+//******************************************************************************
+int loadProgramBinary(std::string file_name, std::uint64_t program_hash, GLuint shader_program);
+int saveProgramBinary(std::string file_name, std::uint64_t program_hash, GLuint shader_program);
+
+class ShaderProgramBatch
+{
+public:
+    ShaderProgramBatch()
+    {
+        // Driver compiles on its own threads, status queries are what would block
+        if (GLEW_KHR_parallel_shader_compile)
+        {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+            parallel_compile_ = true;
+        }
+
+        if (GLEW_ARB_get_program_binary)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binary_formats_count_);
+    }
+
+    ~ShaderProgramBatch()
+    {
+        for (auto &pending : pending_programs_)
+        {
+            glDeleteShader(pending.second.vertex_shader);
+            glDeleteShader(pending.second.fragment_shader);
+        }
+    }
+
+    // True when the program can be resolved without stalling
+    bool isReady(GLuint shader_program)
+    {
+        if (!parallel_compile_ || pending_programs_.count(shader_program) == 0)
+            return true;
+
+        GLint completed = GL_FALSE;
+        glGetProgramiv(shader_program, GL_COMPLETION_STATUS_KHR, &completed);
+
+        return completed == GL_TRUE;
+    }
+
+    // Checks compile and link status, must be called before the program is first used
+    int resolve(GLuint shader_program)
+    {
+        auto pending = pending_programs_.find(shader_program);
+        if (pending == pending_programs_.end())
+            return 0;
+
+        PendingProgram &program = pending->second;
+        int result = 0;
+
+        if (checkShaderCompileStatus(program.vertex_shader))
+        {
+            std::cout << "Shader \"" << program.vertex_shader_file << "\" compile error."
+                      << std::endl;
+            std::cout << "Shader compile log:" << std::endl;
+            std::cout << getShaderCompileMsg(program.vertex_shader) << std::endl;
+            result = -1;
+        }
+
+        if (checkShaderCompileStatus(program.fragment_shader))
+        {
+            std::cout << "Shader \"" << program.fragment_shader_file << "\" compile error."
+                      << std::endl;
+            std::cout << "Shader compile log:" << std::endl;
+            std::cout << getShaderCompileMsg(program.fragment_shader) << std::endl;
+            result = -1;
+        }
+
+        if (result == 0 && checkShaderProgramLinkStatus(shader_program))
+        {
+            std::cout << "Shader program link error." << std::endl;
+            result = -1;
+        }
+
+        glDeleteShader(program.vertex_shader);
+        glDeleteShader(program.fragment_shader);
+
+        if (result == 0)
+        {
+            std::cout << "Shader program created successfully." << std::endl;
+
+            if (binary_formats_count_ > 0 &&
+                saveProgramBinary(program.cache_file_name, program.program_hash, shader_program))
+                std::cout << "Unable to write program cache \"" << program.cache_file_name
+                          << "\"." << std::endl;
+        }
+
+        pending_programs_.erase(pending);
+
+        return result;
+    }
+
+    // Starts compiling and linking without waiting for the result
+    int submit(GLuint &shader_program, std::string vertex_shader_file,
+               std::string fragment_shader_file)
+    {
+        std::string shader_files[] = {vertex_shader_file, fragment_shader_file};
+        std::string shader_codes[2];
+
+        for (int i = 0; i < 2; i++)
+        {
+            if (loadShaderCode(shader_files[i], shader_codes[i]))
+            {
+                std::cout << "Error opening shader file \"" + shader_files[i] + "\"." << std::endl;
+                return -1;
+            }
+
+            std::cout << "Shader file \"" << shader_files[i] << "\" loaded." << std::endl;
+        }
+
+        // Program binary is only valid for the same sources on the same driver
+        std::uint64_t program_hash = 14695981039346656037ull;
+        std::vector<std::string> cache_keys = {
+            shader_codes[0], shader_codes[1],
+            reinterpret_cast<const char*>(glGetString(GL_VENDOR)),
+            reinterpret_cast<const char*>(glGetString(GL_RENDERER)),
+            reinterpret_cast<const char*>(glGetString(GL_VERSION))};
+
+        for (auto &cache_key : cache_keys)
+            program_hash = hashData(cache_key.c_str(), cache_key.size() + 1, program_hash);
+
+        std::string cache_file_name =
+            vertex_shader_file.substr(0, vertex_shader_file.find('.')) + "_" +
+            fragment_shader_file.substr(0, fragment_shader_file.find('.')) + ".program";
+
+        shader_program = glCreateProgram();
+
+        if (binary_formats_count_ > 0)
+        {
+            if (loadProgramBinary(cache_file_name, program_hash, shader_program) == 0)
+            {
+                std::cout << "Shader program \"" << cache_file_name << "\" loaded from cache."
+                          << std::endl;
+                return 0;
+            }
+
+            glProgramParameteri(shader_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+
+        PendingProgram program;
+        program.cache_file_name = cache_file_name;
+        program.fragment_shader_file = fragment_shader_file;
+        program.program_hash = program_hash;
+        program.vertex_shader_file = vertex_shader_file;
+
+        program.vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+        const char *vertex_shader_code = shader_codes[0].c_str();
+        glShaderSource(program.vertex_shader, 1, &vertex_shader_code, nullptr);
+        glCompileShader(program.vertex_shader);
+
+        program.fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+        const char *fragment_shader_code = shader_codes[1].c_str();
+        glShaderSource(program.fragment_shader, 1, &fragment_shader_code, nullptr);
+        glCompileShader(program.fragment_shader);
+
+        glAttachShader(shader_program, program.vertex_shader);
+        glAttachShader(shader_program, program.fragment_shader);
+        glLinkProgram(shader_program);
+
+        pending_programs_[shader_program] = program;
+
+        return 0;
+    }
+
+protected:
+    struct PendingProgram
+    {
+        GLuint fragment_shader = 0;
+        GLuint vertex_shader = 0;
+        std::string cache_file_name;
+        std::string fragment_shader_file;
+        std::string vertex_shader_file;
+        std::uint64_t program_hash = 0;
+    };
+
+protected:
+    GLint binary_formats_count_{0};
+    bool parallel_compile_{false};
+    std::map<GLuint, PendingProgram> pending_programs_;
+
+};
+//*************************************************************************************************
+int loadProgramBinary(std::string file_name, std::uint64_t program_hash, GLuint shader_program)
+{
+    std::ifstream cache_file(file_name, std::ios::in | std::ios::binary);
+    if (!cache_file.is_open())
+        return -1;
+
+    char magic[4] = {0, 0, 0, 0};
+    std::uint64_t stored_hash = 0;
+    std::uint32_t binary_format = 0;
+    std::uint32_t binary_size = 0;
+
+    cache_file.read(magic, sizeof(magic));
+    cache_file.read(reinterpret_cast<char*>(&stored_hash), sizeof(stored_hash));
+    cache_file.read(reinterpret_cast<char*>(&binary_format), sizeof(binary_format));
+    cache_file.read(reinterpret_cast<char*>(&binary_size), sizeof(binary_size));
+
+    if (!cache_file || std::string(magic, 4) != "PRG1" || stored_hash != program_hash ||
+        binary_size == 0)
+        return -1;
+
+    std::vector<char> binary(binary_size);
+    cache_file.read(binary.data(), binary.size());
+    if (!cache_file)
+        return -1;
+
+    // Driver may still reject the binary, e.g. after an update with the same version string
+    glProgramBinary(shader_program, binary_format, binary.data(), binary.size());
+    if (checkShaderProgramLinkStatus(shader_program))
+    {
+        std::cout << "Program binary \"" << file_name << "\" rejected, recompiling."
+                  << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+//*************************************************************************************************
+int saveProgramBinary(std::string file_name, std::uint64_t program_hash, GLuint shader_program)
+{
+    GLint binary_size = 0;
+    glGetProgramiv(shader_program, GL_PROGRAM_BINARY_LENGTH, &binary_size);
+    if (binary_size <= 0)
+        return -1;
+
+    std::vector<char> binary(binary_size);
+    GLenum binary_format = 0;
+    glGetProgramBinary(shader_program, binary_size, nullptr, &binary_format, binary.data());
+
+    std::ofstream cache_file(file_name, std::ios::out | std::ios::binary);
+    if (!cache_file.is_open())
+        return -1;
+
+    std::uint32_t stored_format = binary_format;
+    std::uint32_t stored_size = binary_size;
+
+    cache_file.write("PRG1", 4);
+    cache_file.write(reinterpret_cast<const char*>(&program_hash), sizeof(program_hash));
+    cache_file.write(reinterpret_cast<const char*>(&stored_format), sizeof(stored_format));
+    cache_file.write(reinterpret_cast<const char*>(&stored_size), sizeof(stored_size));
+    cache_file.write(binary.data(), binary.size());
+
+    if (!cache_file)
+        return -1;
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,209 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Uniforms of lesson 28 reflected once per program, uploads of unchanged values are skipped.
+// Included by main.cpp after its declarations.
+#ifndef TEKST_2_SHADER_UNIFORMS_H
+#define TEKST_2_SHADER_UNIFORMS_H
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+//******************************************************************************
+// Index into the reflected uniforms of one program, typed by the value it accepts
+template <typename T>
+struct UniformHandle
+{
+    int index = -1;
+};
+
+// Uniform uploads sent and skipped as unchanged, reset every frame
+struct UniformStats
+{
+    unsigned int skipped = 0;
+    unsigned int uploaded = 0;
+};
+
+UniformStats uniform_stats;
+
+class ShaderUniforms
+{
+public:
+    // Active uniforms are listed once, right after the program has linked
+    ShaderUniforms(GLuint shader_program)
+    {
+        program_ = shader_program;
+
+        GLint uniforms_count = 0;
+        GLint max_name_length = 0;
+        glGetProgramiv(program_, GL_ACTIVE_UNIFORMS, &uniforms_count);
+        glGetProgramiv(program_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+
+        std::vector<GLchar> name(max_name_length + 1);
+        for (GLint i = 0; i < uniforms_count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(program_, i, static_cast<GLsizei>(name.size()), &length, &size,
+                               &type, name.data());
+
+            // Uniform block members have no location of their own
+            GLint location = glGetUniformLocation(program_, name.data());
+            if (location == -1)
+                continue;
+
+            Uniform uniform;
+            uniform.name = std::string(name.data(), length);
+            uniform.location = location;
+            uniform.type = type;
+
+            // Arrays are reported as "name[0]"
+            std::size_t bracket = uniform.name.find('[');
+            if (bracket != std::string::npos)
+                uniform.name.erase(bracket);
+
+            uniforms_.push_back(uniform);
+        }
+    }
+
+    template <typename T>
+    UniformHandle<T> find(std::string uniform_name) const
+    {
+        UniformHandle<T> handle;
+
+        for (std::size_t i = 0; i < uniforms_.size(); i++)
+        {
+            if (uniforms_[i].name != uniform_name)
+                continue;
+
+            if (!isType(uniforms_[i].type, static_cast<const T*>(nullptr)))
+            {
+                std::cout << "Uniform \"" << uniform_name << "\" type mismatch." << std::endl;
+                return handle;
+            }
+
+            handle.index = static_cast<int>(i);
+            return handle;
+        }
+
+        std::cout << "Uniform \"" << uniform_name << "\" not found." << std::endl;
+
+        return handle;
+    }
+
+    // The program must be active. Values equal to the shadow copy are not sent again.
+    template <typename T>
+    void set(UniformHandle<T> handle, const T &value)
+    {
+        if (handle.index < 0)
+            return;
+
+        Uniform &uniform = uniforms_[handle.index];
+        if (uniform.initialized && std::memcmp(uniform.value, &value, sizeof(T)) == 0)
+        {
+            uniform_stats.skipped++;
+            return;
+        }
+
+        std::memcpy(uniform.value, &value, sizeof(T));
+        uniform.initialized = true;
+
+        upload(uniform.location, value);
+        uniform_stats.uploaded++;
+    }
+
+protected:
+    struct Uniform
+    {
+        std::string name;
+        GLint location = -1;
+        GLenum type = 0;
+        bool initialized = false;
+        BYTE value[sizeof(glm::mat4)];
+    };
+
+    static bool isType(GLenum type, const GLint *)
+    {
+        switch (type)
+        {
+        case GL_INT:
+        case GL_BOOL:
+        case GL_SAMPLER_2D:
+        case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_3D:
+        case GL_SAMPLER_BUFFER:
+        case GL_SAMPLER_CUBE:
+        case GL_INT_SAMPLER_BUFFER:
+        case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static bool isType(GLenum type, const GLfloat *)
+    {
+        return type == GL_FLOAT;
+    }
+
+    static bool isType(GLenum type, const glm::vec2 *)
+    {
+        return type == GL_FLOAT_VEC2;
+    }
+
+    static bool isType(GLenum type, const glm::vec3 *)
+    {
+        return type == GL_FLOAT_VEC3;
+    }
+
+    static bool isType(GLenum type, const glm::vec4 *)
+    {
+        return type == GL_FLOAT_VEC4;
+    }
+
+    static bool isType(GLenum type, const glm::mat4 *)
+    {
+        return type == GL_FLOAT_MAT4;
+    }
+
+    static void upload(GLint location, GLint value)
+    {
+        glUniform1i(location, value);
+    }
+
+    static void upload(GLint location, GLfloat value)
+    {
+        glUniform1f(location, value);
+    }
+
+    static void upload(GLint location, const glm::vec2 &vector)
+    {
+        glUniform2fv(location, 1, glm::value_ptr(vector));
+    }
+
+    static void upload(GLint location, const glm::vec3 &vector)
+    {
+        glUniform3fv(location, 1, glm::value_ptr(vector));
+    }
+
+    static void upload(GLint location, const glm::vec4 &vector)
+    {
+        glUniform4fv(location, 1, glm::value_ptr(vector));
+    }
+
+    static void upload(GLint location, const glm::mat4 &matrix)
+    {
+        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(matrix));
+    }
+
+protected:
+    GLuint program_{0};
+    std::vector<Uniform> uniforms_;
+
+};
+
+#endif
@@ -1,13 +1,20 @@
 #version 330
 layout(location = 0) in vec3 position;
 
-uniform mat4 view_matrix;
-uniform mat4 projection_matrix;
+layout(std140) uniform Camera
+{
+    mat4 view_matrix;
+    mat4 projection_matrix;
+    mat4 view_projection_matrix;
+    mat4 sky_view_projection_matrix;
+    vec4 camera_position;
+};
  
 out vec3 texture_coordinates;
  
 void main() 
 {
     texture_coordinates = vec3(position.x, -position.yz);
-    gl_Position = projection_matrix * view_matrix * vec4(position, 1.0);
+    // Far plane depth, drawn last behind everything with GL_LEQUAL
+    gl_Position = (sky_view_projection_matrix * vec4(position, 1.0)).xyww;
 }
@@ -0,0 +1,228 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Frame time statistics of lesson 28 and the overlay graph drawn over the scene. Included by
+// main.cpp after its declarations.
+#ifndef TEKST_2_STATS_OVERLAY_H
+#define TEKST_2_STATS_OVERLAY_H
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+//******************************************************************************
+// Milliseconds over the frame time history
+struct FrameTimeStats
+{
+    float avg = 0.0f;
+    float max = 0.0f;
+    float min = 0.0f;
+    float p95 = 0.0f;
+    float p99 = 0.0f;
+};
+
+FrameTimeStats calculateFrameTimeStats(std::vector<float> frame_times);
+int getGPUMemoryInfo(GLint &available_kb, GLint &total_kb);
+
+// Frame time history with percentiles and a rolling graph drawn over the scene
+class StatsOverlay
+{
+public:
+    StatsOverlay(GLuint shader_program, unsigned int history_size,
+                 StreamingBuffer &streaming_buffer) : uniforms_(shader_program)
+    {
+        shader_program_ = shader_program;
+        streaming_buffer_ = &streaming_buffer;
+        colour_ = uniforms_.find<glm::vec4>("colour");
+        frame_times_.resize(history_size, 0.0f);
+
+        // Vertices are sourced from the streaming buffer when drawn
+        glGenVertexArrays(1, &handle_);
+        gl_state.bindVertexArray(handle_);
+        glEnableVertexAttribArray(0);
+        gl_state.bindVertexArray(0);
+    }
+
+    ~StatsOverlay()
+    {
+        gl_state.deleteVertexArrays(1, &handle_);
+    }
+
+    // Milliseconds, the oldest sample is overwritten once the history is full
+    void addFrameTime(double frame_time)
+    {
+        frame_times_[next_sample_] = static_cast<float>(frame_time);
+        next_sample_ = (next_sample_ + 1) % frame_times_.size();
+        samples_count_ = std::min(samples_count_ + 1, frame_times_.size());
+    }
+
+    FrameTimeStats getStats() const
+    {
+        return calculateFrameTimeStats(getSamples());
+    }
+
+    // Graph in window pixels, with 16.7 ms and 33.3 ms reference lines
+    void render(int x, int y, int width, int height, int viewport_width, int viewport_height)
+    {
+        std::vector<float> samples = getSamples();
+        float scale_max = 1000.0f / 30.0f;
+        for (float frame_time : samples)
+            scale_max = std::max(scale_max, frame_time);
+
+        auto to_screen = [&](float pixel_x, float pixel_y) {
+            vertices_.push_back(pixel_x / viewport_width * 2.0f - 1.0f);
+            vertices_.push_back(1.0f - pixel_y / viewport_height * 2.0f);
+        };
+
+        auto to_graph_y = [&](float frame_time) {
+            return y + height - frame_time / scale_max * height;
+        };
+
+        vertices_.clear();
+
+        // Background
+        to_screen(x, y);
+        to_screen(x, y + height);
+        to_screen(x + width, y);
+        to_screen(x + width, y);
+        to_screen(x, y + height);
+        to_screen(x + width, y + height);
+
+        // 60 and 30 FPS
+        for (float reference_time : {1000.0f / 60.0f, 1000.0f / 30.0f})
+        {
+            to_screen(x, to_graph_y(reference_time));
+            to_screen(x + width, to_graph_y(reference_time));
+        }
+
+        for (std::size_t i = 0; i < samples.size(); i++)
+            to_screen(x + width * static_cast<float>(i) / (frame_times_.size() - 1),
+                      to_graph_y(samples[i]));
+
+        gl_state.useProgram(shader_program_);
+        gl_state.enable(GL_DEPTH_TEST, false);
+        gl_state.bindVertexArray(handle_);
+
+        GLintptr offset = streaming_buffer_->upload(vertices_.data(),
+                                                    vertices_.size() * sizeof(float),
+                                                    sizeof(float));
+        gl_state.bindBuffer(GL_ARRAY_BUFFER, streaming_buffer_->getBuffer());
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<const void*>(offset));
+
+        uniforms_.set(colour_, glm::vec4(0.0f, 0.0f, 0.0f, 0.5f));
+        drawArrays(GL_TRIANGLES, 0, 6);
+        uniforms_.set(colour_, glm::vec4(1.0f, 1.0f, 1.0f, 0.3f));
+        drawArrays(GL_LINES, 6, 4);
+
+        if (samples.size() > 1)
+        {
+            uniforms_.set(colour_, glm::vec4(0.2f, 1.0f, 0.2f, 1.0f));
+            drawArrays(GL_LINE_STRIP, 10, static_cast<GLsizei>(samples.size()));
+        }
+    }
+
+    int saveCSV(std::string file_name) const
+    {
+        std::ofstream csv_file(file_name, std::ios::out);
+        if (!csv_file.is_open())
+        {
+            std::cout << "Error creating file \"" << file_name << "\"." << std::endl;
+            return -1;
+        }
+
+        std::vector<float> samples = getSamples();
+
+        csv_file << "sample,frame_time_ms\n";
+        for (std::size_t i = 0; i < samples.size(); i++)
+            csv_file << i << "," << samples[i] << "\n";
+
+        if (!csv_file)
+            return -1;
+
+        std::cout << samples.size() << " frame times saved to \"" << file_name << "\"."
+                  << std::endl;
+
+        return 0;
+    }
+
+protected:
+    // Samples from the oldest to the newest
+    std::vector<float> getSamples() const
+    {
+        std::vector<float> samples;
+        samples.reserve(samples_count_);
+
+        std::size_t first_sample = (next_sample_ + frame_times_.size() - samples_count_) %
+                                   frame_times_.size();
+        for (std::size_t i = 0; i < samples_count_; i++)
+            samples.push_back(frame_times_[(first_sample + i) % frame_times_.size()]);
+
+        return samples;
+    }
+
+protected:
+    GLuint handle_{0};
+    GLuint shader_program_{0};
+    ShaderUniforms uniforms_;
+    StreamingBuffer *streaming_buffer_{nullptr};
+    std::size_t next_sample_{0};
+    std::size_t samples_count_{0};
+    std::vector<float> frame_times_;
+    std::vector<float> vertices_;
+    UniformHandle<glm::vec4> colour_;
+
+};
+//*************************************************************************************************
+FrameTimeStats calculateFrameTimeStats(std::vector<float> frame_times)
+{
+    FrameTimeStats stats;
+    if (frame_times.empty())
+        return stats;
+
+    std::sort(frame_times.begin(), frame_times.end());
+
+    stats.min = frame_times.front();
+    stats.max = frame_times.back();
+    for (float frame_time : frame_times)
+        stats.avg += frame_time;
+    stats.avg /= frame_times.size();
+
+    // Nearest rank percentiles
+    auto percentile = [&frame_times](double fraction) {
+        std::size_t rank = static_cast<std::size_t>(std::ceil(fraction * frame_times.size()));
+        return frame_times[std::max<std::size_t>(rank, 1) - 1];
+    };
+
+    stats.p95 = percentile(0.95);
+    stats.p99 = percentile(0.99);
+
+    return stats;
+}
+//*************************************************************************************************
+int getGPUMemoryInfo(GLint &available_kb, GLint &total_kb)
+{
+    if (GLEW_NVX_gpu_memory_info)
+    {
+        glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &available_kb);
+        glGetIntegerv(GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &total_kb);
+        return 0;
+    }
+
+    // Free memory of the texture pool only, the total is not reported
+    if (GLEW_ATI_meminfo)
+    {
+        GLint free_memory[4] = {0, 0, 0, 0};
+        glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, free_memory);
+        available_kb = free_memory[0];
+        total_kb = 0;
+        return 0;
+    }
+
+    return -1;
+}
+
+#endif
@@ -0,0 +1,621 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Asynchronous texture streaming of lesson 28. Included by main.cpp after its
+// declarations.
+#ifndef TEKST_2_TEXTURE_STREAMER_H
+#define TEKST_2_TEXTURE_STREAMER_H
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+//******************************************************************************
+class TextureStreamer
+{
+public:
+    TextureStreamer(GLsizeiptr frame_budget, GLsizeiptr staging_size, MipFilter mip_filter)
+    {
+        frame_budget_ = frame_budget;
+        staging_size_ = staging_size;
+        mip_filter_ = mip_filter;
+
+        // Placeholder sampled by meshes until the coarsest mip of their texture is resident
+        GLubyte placeholder_texel[] = {128, 128, 128, 255};
+
+        glGenTextures(1, &placeholder_texture_);
+        glBindTexture(GL_TEXTURE_2D, placeholder_texture_);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                     placeholder_texel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        // Magenta and black checker replaces textures that failed to load
+        GLubyte error_texels[] = {255, 0, 255, 255, 0, 0, 0, 255, 0, 0, 0, 255, 255, 0, 255, 255};
+
+        glGenTextures(1, &error_texture_);
+        glBindTexture(GL_TEXTURE_2D, error_texture_);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, error_texels);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // Persistently mapped staging buffer, workers write decoded pixels straight into it.
+        // Without ARB_buffer_storage the upload falls back to an orphaned PBO.
+        glGenBuffers(1, &staging_pbo_);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_pbo_);
+        if (GLEW_ARB_buffer_storage)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, staging_size_, nullptr, flags);
+            staging_ptr_ = static_cast<GLubyte*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+                                                                  staging_size_, flags));
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        if (staging_ptr_)
+            std::cout << "Texture streamer uses persistently mapped PBO." << std::endl;
+        else
+            std::cout << "Texture streamer uses orphaned PBO." << std::endl;
+
+        unsigned int workers_count = std::thread::hardware_concurrency();
+        if (workers_count > 1)
+            workers_count--;
+        if (workers_count == 0)
+            workers_count = 1;
+
+        for (unsigned int i = 0; i < workers_count; i++)
+            workers_.emplace_back(&TextureStreamer::decodeTextures, this);
+    }
+
+    ~TextureStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(requests_mutex_);
+            stop_ = true;
+        }
+        requests_cv_.notify_all();
+
+        {
+            std::lock_guard<std::mutex> lock(staging_mutex_);
+            staging_cv_.notify_all();
+        }
+
+        for (auto &worker : workers_)
+            worker.join();
+
+        for (auto &request : streaming_requests_)
+        {
+            if (request.second->layer < 0)
+                gl_state.deleteTextures(1, &request.second->texture);
+
+            delete request.second;
+        }
+
+        for (auto &retired : retired_uploads_)
+            glDeleteSync(retired.first);
+
+        if (staging_ptr_)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_pbo_);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+
+        gl_state.deleteBuffers(1, &staging_pbo_);
+        gl_state.deleteTextures(1, &placeholder_texture_);
+        gl_state.deleteTextures(1, &error_texture_);
+    }
+
+    unsigned int getStreamingCount()
+    {
+        return streaming_requests_.size();
+    }
+
+    GLsizeiptr getUploadedBytes()
+    {
+        return uploaded_bytes_;
+    }
+
+    void requestTexture(std::string file_name, GLuint *texture_handle)
+    {
+        // Meshes sharing a material share one streamed texture
+        auto resident = resident_textures_.find(file_name);
+        if (resident != resident_textures_.end())
+        {
+            *texture_handle = resident->second;
+            return;
+        }
+
+        auto streaming = streaming_requests_.find(file_name);
+        if (streaming != streaming_requests_.end())
+        {
+            StreamRequest *request = streaming->second;
+            *texture_handle = request->published ? request->texture : placeholder_texture_;
+            request->targets.push_back(texture_handle);
+            return;
+        }
+
+        *texture_handle = placeholder_texture_;
+
+        StreamRequest *request = new StreamRequest();
+        request->file_name = file_name;
+        request->request_key = file_name;
+        request->targets.push_back(texture_handle);
+
+        queueRequest(request);
+    }
+
+    // Streams levels first_level..levels_count - 1 of the texture into a region of an already
+    // allocated GL_TEXTURE_2D_ARRAY layer. Finest uploaded level is published to resident_level,
+    // LOAD_FAILED when the texture could not be loaded.
+    void requestTextureLayer(std::string file_name, GLuint texture_array, int layer, int x, int y,
+                             int first_level, unsigned int levels_count, int *resident_level)
+    {
+        StreamRequest *request = new StreamRequest();
+        request->file_name = file_name;
+        request->request_key = file_name + "@" + std::to_string(texture_array) + ":" +
+                               std::to_string(layer);
+        request->texture = texture_array;
+        request->first_level = first_level;
+        request->layer = layer;
+        request->levels_limit = levels_count;
+        request->resident_level = resident_level;
+        request->x = x;
+        request->y = y;
+
+        queueRequest(request);
+    }
+
+    // Must be called once per frame from the thread owning the GL context
+    void update()
+    {
+        retireStagingMemory();
+
+        uploaded_bytes_ = 0;
+
+        GLint unpack_alignment = 0;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_alignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_pbo_);
+
+        while (uploaded_bytes_ < frame_budget_)
+        {
+            if (!active_request_)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(requests_mutex_);
+                    if (ready_requests_.empty())
+                        break;
+
+                    active_request_ = ready_requests_.front();
+                    ready_requests_.pop_front();
+                }
+
+                if (active_request_->levels.empty())
+                {
+                    failRequest(active_request_);
+                    active_request_ = nullptr;
+                    continue;
+                }
+
+                beginUpload(active_request_);
+
+                if (active_request_->uploading_level < active_request_->first_level)
+                {
+                    finishUpload(active_request_);
+                    active_request_ = nullptr;
+                    continue;
+                }
+            }
+
+            const StreamLevel &level = active_request_->levels[active_request_->uploading_level];
+            GLsizeiptr rows = (frame_budget_ - uploaded_bytes_) / level.pitch;
+            if (rows == 0 && uploaded_bytes_ > 0)
+                break;
+
+            uploadRows(active_request_, std::max<GLsizeiptr>(rows, 1));
+
+            if (active_request_->uploading_level < active_request_->first_level)
+            {
+                finishUpload(active_request_);
+                active_request_ = nullptr;
+            }
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment);
+    }
+
+    static const int LOAD_FAILED = -1;
+
+protected:
+    struct StreamLevel
+    {
+        GLsizeiptr offset = 0;
+        unsigned int height = 0;
+        unsigned int pitch = 0;
+        unsigned int width = 0;
+    };
+
+    struct StreamRequest
+    {
+        GLuint texture = 0;
+        GLsizeiptr staging_offset = -1;
+        MipChain mip_chain;
+        bool published = false;
+        int first_level = 0;
+        int layer = -1;
+        int *resident_level = nullptr;
+        int uploading_level = -1;
+        int x = 0;
+        int y = 0;
+        std::string file_name;
+        std::string request_key;
+        std::vector<GLuint*> targets;
+        std::vector<StreamLevel> levels;
+        unsigned int bpp = 0;
+        unsigned int levels_limit = 0;
+        unsigned int uploaded_rows = 0;
+    };
+
+    struct StagingAllocation
+    {
+        GLsizeiptr offset = 0;
+        GLsizeiptr size = 0;
+        bool released = false;
+    };
+
+    // Ring allocator over the staging buffer. Blocks until enough memory is retired.
+    GLsizeiptr allocateStaging(GLsizeiptr size)
+    {
+        std::unique_lock<std::mutex> lock(staging_mutex_);
+
+        while (true)
+        {
+            GLsizeiptr offset = -1;
+
+            if (staging_allocations_.empty())
+                offset = 0;
+            else
+            {
+                GLsizeiptr begin = staging_allocations_.front().offset;
+                GLsizeiptr end = staging_allocations_.back().offset +
+                                 staging_allocations_.back().size;
+
+                if (end > begin)
+                {
+                    if (end + size <= staging_size_)
+                        offset = end;
+                    else if (size <= begin)
+                        offset = 0;
+                }
+                else if (end + size <= begin)
+                    offset = end;
+            }
+
+            if (offset >= 0)
+            {
+                StagingAllocation allocation;
+                allocation.offset = offset;
+                allocation.size = size;
+                staging_allocations_.push_back(allocation);
+
+                return offset;
+            }
+
+            if (stop_)
+                return -1;
+
+            staging_cv_.wait(lock);
+        }
+    }
+
+    void beginUpload(StreamRequest *request)
+    {
+        // Coarsest level goes first, so the texture can be shown before it is complete
+        request->uploading_level = request->levels.size() - 1;
+        request->uploaded_rows = 0;
+
+        // Array layers live in storage allocated by their owner
+        if (request->layer >= 0)
+            return;
+
+        glGenTextures(1, &request->texture);
+        glBindTexture(GL_TEXTURE_2D, request->texture);
+
+        // Storage only, PBO must not be bound or the null pointer becomes an offset
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        for (unsigned int i = 0; i < request->levels.size(); i++)
+        {
+            const StreamLevel &level = request->levels[i];
+            if (request->bpp == 24)
+                glTexImage2D(GL_TEXTURE_2D, i, GL_RGB, level.width, level.height, 0, GL_BGR,
+                             GL_UNSIGNED_BYTE, nullptr);
+            else
+                glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, level.width, level.height, 0, GL_BGRA,
+                             GL_UNSIGNED_BYTE, nullptr);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_pbo_);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, request->uploading_level);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, request->uploading_level);
+
+        GLfloat anisotropy_factor = 0.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &anisotropy_factor);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy_factor);
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void decodeTextures()
+    {
+        while (true)
+        {
+            StreamRequest *request = nullptr;
+
+            {
+                std::unique_lock<std::mutex> lock(requests_mutex_);
+                requests_cv_.wait(lock, [this] { return stop_ || !pending_requests_.empty(); });
+                if (stop_)
+                    return;
+
+                request = pending_requests_.front();
+                pending_requests_.pop_front();
+            }
+
+            // Source is hashed on the first request only, refinements of the same texture go
+            // straight to its mip cache
+            std::uint64_t source_hash = 0;
+            {
+                std::lock_guard<std::mutex> lock(requests_mutex_);
+                auto hash = source_hashes_.find(request->file_name);
+                if (hash != source_hashes_.end())
+                    source_hash = hash->second;
+            }
+
+            // Other workers decode other textures, so mip generation stays on this thread.
+            // Failed requests are handed back with no levels.
+            if (loadTextureMipChain(request->file_name, mip_filter_, nullptr, source_hash,
+                                    request->mip_chain) == 0)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(requests_mutex_);
+                    source_hashes_[request->file_name] = source_hash;
+                }
+
+                if (request->levels_limit > 0 &&
+                    request->mip_chain.levels.size() > request->levels_limit)
+                    request->mip_chain.levels.resize(request->levels_limit);
+
+                // Levels finer than first_level are already resident, they take no staging memory
+                GLsizeiptr size = 0;
+                for (unsigned int i = 0; i < request->mip_chain.levels.size(); i++)
+                {
+                    const MipLevel &mip_level = request->mip_chain.levels[i];
+
+                    StreamLevel level;
+                    level.offset = size;
+                    level.width = mip_level.width;
+                    level.height = mip_level.height;
+                    level.pitch = mip_level.pitch;
+                    request->levels.push_back(level);
+
+                    if (static_cast<int>(i) >= request->first_level)
+                        size += mip_level.bits.size();
+                }
+
+                request->bpp = request->mip_chain.bpp;
+
+                if (staging_ptr_ && size <= staging_size_)
+                    request->staging_offset = allocateStaging(size);
+
+                if (request->staging_offset >= 0)
+                {
+                    for (unsigned int i = request->first_level; i < request->levels.size(); i++)
+                        std::memcpy(staging_ptr_ + request->staging_offset +
+                                    request->levels[i].offset,
+                                    request->mip_chain.levels[i].bits.data(),
+                                    request->mip_chain.levels[i].bits.size());
+
+                    request->mip_chain = MipChain();
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(requests_mutex_);
+            ready_requests_.push_back(request);
+        }
+    }
+
+    // Reported once per file, meshes sample the error texture instead of the placeholder
+    void failRequest(StreamRequest *request)
+    {
+        if (failed_textures_.insert(request->file_name).second)
+            std::cout << "Texture \"" << request->file_name << "\" failed to stream." << std::endl;
+
+        if (request->layer < 0)
+        {
+            for (auto &target : request->targets)
+                *target = error_texture_;
+
+            resident_textures_[request->file_name] = error_texture_;
+        }
+        else if (request->resident_level)
+        {
+            *request->resident_level = LOAD_FAILED;
+        }
+
+        streaming_requests_.erase(request->request_key);
+
+        delete request;
+    }
+
+    void finishUpload(StreamRequest *request)
+    {
+        if (request->staging_offset >= 0)
+            retired_uploads_.push_back(std::make_pair(
+                glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), request->staging_offset));
+
+        std::cout << "Texture \"" << request->file_name << "\" streamed." << std::endl;
+
+        if (request->layer < 0)
+            resident_textures_[request->file_name] = request->texture;
+
+        streaming_requests_.erase(request->request_key);
+
+        delete request;
+    }
+
+    void publishLevel(StreamRequest *request)
+    {
+        if (request->layer >= 0)
+        {
+            if (request->resident_level)
+                *request->resident_level = request->uploading_level;
+            return;
+        }
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, request->uploading_level);
+
+        if (!request->published)
+        {
+            for (auto &target : request->targets)
+                *target = request->texture;
+
+            request->published = true;
+        }
+    }
+
+    void queueRequest(StreamRequest *request)
+    {
+        streaming_requests_[request->request_key] = request;
+
+        {
+            std::lock_guard<std::mutex> lock(requests_mutex_);
+            pending_requests_.push_back(request);
+        }
+        requests_cv_.notify_one();
+    }
+
+    void retireStagingMemory()
+    {
+        bool released = false;
+
+        while (!retired_uploads_.empty())
+        {
+            GLenum result = glClientWaitSync(retired_uploads_.front().first, 0, 0);
+            if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+                break;
+
+            glDeleteSync(retired_uploads_.front().first);
+
+            std::lock_guard<std::mutex> lock(staging_mutex_);
+            for (auto &allocation : staging_allocations_)
+            {
+                if (allocation.offset == retired_uploads_.front().second)
+                    allocation.released = true;
+            }
+
+            while (!staging_allocations_.empty() && staging_allocations_.front().released)
+                staging_allocations_.pop_front();
+
+            retired_uploads_.pop_front();
+            released = true;
+        }
+
+        if (released)
+            staging_cv_.notify_all();
+    }
+
+    void uploadRows(StreamRequest *request, GLsizeiptr rows)
+    {
+        const StreamLevel &level = request->levels[request->uploading_level];
+
+        rows = std::min<GLsizeiptr>(rows, level.height - request->uploaded_rows);
+        GLsizeiptr first_byte = static_cast<GLsizeiptr>(request->uploaded_rows) * level.pitch;
+        GLsizeiptr size = rows * level.pitch;
+
+        GLsizeiptr source_offset = 0;
+        if (request->staging_offset >= 0)
+            source_offset = request->staging_offset + level.offset + first_byte;
+        else
+        {
+            const MipLevel &mip_level = request->mip_chain.levels[request->uploading_level];
+
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+            void *pbo_ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            std::memcpy(pbo_ptr, mip_level.bits.data() + first_byte, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+
+        GLenum format = request->bpp == 24 ? GL_BGR : GL_BGRA;
+
+        if (request->layer >= 0)
+        {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, request->texture);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, request->uploading_level,
+                            request->x >> request->uploading_level,
+                            (request->y >> request->uploading_level) + request->uploaded_rows,
+                            request->layer, level.width, rows, 1, format, GL_UNSIGNED_BYTE,
+                            reinterpret_cast<const void*>(source_offset));
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        }
+        else
+        {
+            glBindTexture(GL_TEXTURE_2D, request->texture);
+            glTexSubImage2D(GL_TEXTURE_2D, request->uploading_level, 0, request->uploaded_rows,
+                            level.width, rows, format, GL_UNSIGNED_BYTE,
+                            reinterpret_cast<const void*>(source_offset));
+        }
+
+        request->uploaded_rows += rows;
+        uploaded_bytes_ += size;
+
+        if (request->uploaded_rows == level.height)
+        {
+            publishLevel(request);
+
+            request->uploading_level--;
+            request->uploaded_rows = 0;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+protected:
+    GLubyte *staging_ptr_{nullptr};
+    GLsizeiptr frame_budget_{0};
+    GLsizeiptr staging_size_{0};
+    GLsizeiptr uploaded_bytes_{0};
+    GLuint error_texture_{0};
+    GLuint placeholder_texture_{0};
+    GLuint staging_pbo_{0};
+    MipFilter mip_filter_{MipFilter::BOX};
+    StreamRequest *active_request_{nullptr};
+    // Set under requests_mutex_, also read by allocateStaging() under staging_mutex_
+    std::atomic<bool> stop_{false};
+    std::condition_variable requests_cv_;
+    std::condition_variable staging_cv_;
+    std::deque<StagingAllocation> staging_allocations_;
+    std::deque<StreamRequest*> pending_requests_;
+    std::deque<StreamRequest*> ready_requests_;
+    std::deque<std::pair<GLsync, GLsizeiptr>> retired_uploads_;
+    std::map<std::string, GLuint> resident_textures_;
+    std::map<std::string, StreamRequest*> streaming_requests_;
+    // Guarded by requests_mutex_
+    std::map<std::string, std::uint64_t> source_hashes_;
+    std::mutex requests_mutex_;
+    std::mutex staging_mutex_;
+    std::set<std::string> failed_textures_;
+    std::vector<std::thread> workers_;
+
+};
+
+#endif
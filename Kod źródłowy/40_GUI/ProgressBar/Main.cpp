@@ -12,12 +12,17 @@
 
 #include <FreeImage.h>
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <map>
 #include <string>
 #include <vector>
+
+#include "../../Wspolne/gl_state_cache.h"
+#include "../../Wspolne/streaming_buffer.h"
 //******************************************************************************
 GLFWwindow *window_handle = nullptr;
 int window_height = 0;
@@ -55,6 +60,7 @@ struct Texture
     int height;
 };
 
+bool FPSCounter(double& fps);
 bool renderingEnabled();
 double getTimeDelta();
 int checkShaderCompileStatus(GLuint shader_handle);
@@ -76,7 +82,6 @@ void clearColor(float r, float g, float b);
 void closeWindow(GLFWwindow *window);
 void enableDepthTesting(bool state);
 void enableFaceCulling(bool state);
-void FPSCounter(double& fps);
 void freeTextureData(Texture &texture);
 void loadTextureSkybox(std::string front, std::string back, std::string left, std::string right,
                        std::string up, std::string down, GLuint &texture_handle);
@@ -91,6 +96,9 @@ void setUniform(GLint uniform_handle, const glm::vec3 &vector);
 void terminate();
 void updateTimer();
 
+// Caly stan GL ustawiany jest przez ten obiekt
+GLStateCache gl_state;
+
 class GUIElement
 {
 public:
@@ -110,15 +118,10 @@ public:
 
         glGenVertexArrays(1, &handle_);
 
-        glGenBuffers(1, &colours_vbo_);
-        glGenBuffers(1, &vertices_vbo_);
         glGenBuffers(1, &indices_vbo_);
 
+        // Wierzcholki i kolory pochodza z bufora strumieniowego, wskazniki ustawia render()
         glBindVertexArray(handle_);
-        glBindBuffer(GL_ARRAY_BUFFER, vertices_vbo_);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-        glBindBuffer(GL_ARRAY_BUFFER, colours_vbo_);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
         glEnableVertexAttribArray(0);
         glEnableVertexAttribArray(1);
         glBindVertexArray(0);
@@ -140,11 +143,9 @@ public:
 
     virtual ~GUIElement()
     {
-        glDeleteBuffers(1, &colours_vbo_);
-        glDeleteBuffers(1, &vertices_vbo_);
-        glDeleteBuffers(1, &indices_vbo_);
+        gl_state.deleteBuffers(1, &indices_vbo_);
 
-        glDeleteVertexArrays(1, &handle_);
+        gl_state.deleteVertexArrays(1, &handle_);
     }
 
     void setBackgroundColours(const glm::vec3 &colour1, const glm::vec3 &colour2)
@@ -158,6 +159,12 @@ public:
         border_colour_ = colour;
     }
 
+    // Wspolny dla wszystkich elementow, musi istniec przed pierwszym render()
+    static void setStreamingBuffer(StreamingBuffer &streaming_buffer)
+    {
+        streaming_buffer_ = &streaming_buffer;
+    }
+
     static void setViewportSize(int width, int height)
     {
         if (width > 0 && height > 0)
@@ -181,17 +188,16 @@ protected:
     }
 
 protected:
+    static StreamingBuffer *streaming_buffer_;
     static int viewport_height_;
     static int viewport_width_;
 
     glm::vec3 background_colour_1_{0.5f, 0.5f, 0.5f};
     glm::vec3 background_colour_2_{0.8f, 0.8f, 0.8f};
     glm::vec3 border_colour_{0.0f, 0.0f, 0.0f};
-    GLuint colours_vbo_{0};
     GLuint gui_shader_{0};
     GLuint handle_{0};
     GLuint indices_vbo_{0};
-    GLuint vertices_vbo_{0};
     int height_{0};
     int width_{0};
     int x_{0};
@@ -212,6 +218,16 @@ public:
         alpha_uniform_ = glGetUniformLocation(gui_shader_, "alpha_factor");
         border_colour_uniform_ = glGetUniformLocation(gui_shader_, "border_colour");
         rendering_border_uniform_ = glGetUniformLocation(gui_shader_, "rendering_border");
+
+        // Indeksy sie nie zmieniaja, trafiaja do bufora raz: tlo, pasek i ramka
+        std::vector<GLuint> indices(fill_indices_);
+        indices.insert(indices.end(), bar_indices.begin(), bar_indices.end());
+        indices.insert(indices.end(), border_indices_.begin(), border_indices_.end());
+
+        gl_state.bindVertexArray(handle_);
+        gl_state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(),
+                     GL_STATIC_DRAW);
     }
 
     void render()
@@ -269,40 +285,40 @@ public:
 
         
 
-        glBindVertexArray(handle_);
+        gl_state.bindVertexArray(handle_);
 
-        glBindBuffer(GL_ARRAY_BUFFER, vertices_vbo_);
-        glBufferData(GL_ARRAY_BUFFER, vertices_buffer.size() * sizeof(GLfloat),
-                     vertices_buffer.data(), GL_DYNAMIC_DRAW);
+        // Oba strumienie trafiaja do obszaru biezacej klatki, bez kopii po stronie sterownika.
+        // Wysylka moze przeniesc dane do nowego bufora, wskaznik ustawiany jest zaraz po niej.
+        GLintptr vertices_offset = streaming_buffer_->upload(
+            vertices_buffer.data(), vertices_buffer.size() * sizeof(GLfloat), sizeof(GLfloat));
+        gl_state.bindBuffer(GL_ARRAY_BUFFER, streaming_buffer_->getBuffer());
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0,
+                              reinterpret_cast<const void*>(vertices_offset));
 
-        glBindBuffer(GL_ARRAY_BUFFER, colours_vbo_);
-        glBufferData(GL_ARRAY_BUFFER, colours_buffer.size() * sizeof(GLfloat),
-                     colours_buffer.data(), GL_DYNAMIC_DRAW);
+        GLintptr colours_offset = streaming_buffer_->upload(
+            colours_buffer.data(), colours_buffer.size() * sizeof(GLfloat), sizeof(GLfloat));
+        gl_state.bindBuffer(GL_ARRAY_BUFFER, streaming_buffer_->getBuffer());
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0,
+                              reinterpret_cast<const void*>(colours_offset));
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_);
-
-        glUseProgram(gui_shader_);
+        gl_state.useProgram(gui_shader_);
         glUniform1i(alpha_uniform_, alpha_);
 
-        glDisable(GL_DEPTH_TEST);
+        // GUI rysowane jest bez testu glebokosci, kolejne elementy nie zmieniaja juz stanu
+        gl_state.enable(GL_DEPTH_TEST, false);
         // Narysuj tlo elementu gui
         glUniform1i(rendering_border_uniform_, 0); // Rysujemy elementy dwukolorowe
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, fill_indices_.size() * sizeof(GLuint),
-                     fill_indices_.data(), GL_DYNAMIC_DRAW);
         glDrawElements(GL_TRIANGLES, fill_indices_.size(), GL_UNSIGNED_INT, 0);
         // Narysuj pasek postepu
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, bar_indices.size() * sizeof(GLuint),
-                     bar_indices.data(), GL_DYNAMIC_DRAW);
-        glDrawElements(GL_TRIANGLES, bar_indices.size(), GL_UNSIGNED_INT, 0);
+        std::size_t bar_offset = fill_indices_.size() * sizeof(GLuint);
+        glDrawElements(GL_TRIANGLES, bar_indices.size(), GL_UNSIGNED_INT,
+                       reinterpret_cast<const void*>(bar_offset));
         // Narysuj ramke dookola elementu GUI
         glUniform1i(rendering_border_uniform_, 1); // Rysujemy elementy jednokolorowe
         glUniform3fv(border_colour_uniform_, 1, glm::value_ptr(border_colour_));
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, border_indices_.size() * sizeof(GLuint),
-                     border_indices_.data(), GL_DYNAMIC_DRAW);
-        glDrawElements(GL_LINE_LOOP, border_indices_.size(), GL_UNSIGNED_INT, 0);
-
-        glEnable(GL_DEPTH_TEST);
-        glBindVertexArray(0);
+        std::size_t border_offset = bar_offset + bar_indices.size() * sizeof(GLuint);
+        glDrawElements(GL_LINE_LOOP, border_indices_.size(), GL_UNSIGNED_INT,
+                       reinterpret_cast<const void*>(border_offset));
     }
 
     void setAlpha(int value)
@@ -343,6 +359,7 @@ protected:
 
 };
 
+StreamingBuffer *GUIElement::streaming_buffer_ = nullptr;
 int GUIElement::viewport_height_;
 int GUIElement::viewport_width_;
 //*************************************************************************************************
@@ -429,7 +446,9 @@ int main()
                       "craterlake_rt.tga", "craterlake_up.tga", "craterlake_dn.tga", 
                       skybox_texture);
 
-    // Stworz GUI
+    // Stworz GUI, wierzcholki wszystkich elementow trafiaja do jednego bufora strumieniowego
+    StreamingBuffer streaming_buffer(16 * 1024, &gl_state);
+    GUIElement::setStreamingBuffer(streaming_buffer);
     GUIElement::setViewportSize(window_width, window_height);
     GUIProgressBar progress_bar(100, 300, 300, 50);
     progress_bar.setAlpha(65);
@@ -449,17 +468,23 @@ int main()
     enableFaceCulling(true);
     enableDepthTesting(true);
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl_state.enable(GL_BLEND, true);
+    gl_state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     while (renderingEnabled())
     {
         static double fps = 0.0f;
-        FPSCounter(fps);
-        std::string title = window_caption + " @ FPS: " + std::to_string(fps);
-        glfwSetWindowTitle(window_handle, title.c_str());
+        if (FPSCounter(fps))
+        {
+            std::string title = window_caption + " @ FPS: " + std::to_string(fps) +
+                                " | State changes: " + std::to_string(gl_state.getChangesCount()) +
+                                " of " + std::to_string(gl_state.getCallsCount());
+            glfwSetWindowTitle(window_handle, title.c_str());
+        }
+        gl_state.resetCounters();
 
         updateTimer();
+        streaming_buffer.beginFrame();
 
         clearColor(0.5f, 0.5f, 0.5f);
 
@@ -472,11 +497,9 @@ int main()
         setUniform(projection_uniform_sky, projection_matrix);
 
         enableDepthTesting(false);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_texture);
-        glBindVertexArray(skybox_vao);
+        gl_state.bindTexture(0, GL_TEXTURE_CUBE_MAP, skybox_texture);
+        gl_state.bindVertexArray(skybox_vao);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
         enableDepthTesting(true);
 
         // Narysuj GUI
@@ -845,23 +868,15 @@ int loadTexture2D(GLuint& texture_handle, Texture texture)
 //*************************************************************************************************
 void enableDepthTesting(bool state)
 {
-    glDepthFunc(GL_LESS);
-
-    if (state)
-        glEnable(GL_DEPTH_TEST);
-    else
-        glDisable(GL_DEPTH_TEST);
+    gl_state.depthFunc(GL_LESS);
+    gl_state.enable(GL_DEPTH_TEST, state);
 }
 //*************************************************************************************************
 void enableFaceCulling(bool state)
 {
-    glFrontFace(GL_CCW);
-    glCullFace(GL_BACK);
-
-    if (state)
-        glEnable(GL_CULL_FACE);
-    else
-        glDisable(GL_CULL_FACE);
+    gl_state.frontFace(GL_CCW);
+    gl_state.cullFace(GL_BACK);
+    gl_state.enable(GL_CULL_FACE, state);
 }
 //*************************************************************************************************
 bool renderingEnabled()
@@ -872,7 +887,7 @@ bool renderingEnabled()
     return true;
 }
 //*************************************************************************************************
-void FPSCounter(double& fps)
+bool FPSCounter(double& fps)
 {
     static double prev_time = glfwGetTime();
     double actual_time = glfwGetTime();
@@ -888,6 +903,8 @@ void FPSCounter(double& fps)
     }
 
     frames_counter++;
+
+    return frames_counter == 1;
 }
 //*************************************************************************************************
 void clearColor(float r, float g, float b)
@@ -900,7 +917,7 @@ void clearColor(float r, float g, float b)
 //*************************************************************************************************
 void activateShaderProgram(GLuint shader_program)
 {
-    glUseProgram(shader_program);
+    gl_state.useProgram(shader_program);
 }
 //*************************************************************************************************
 void setUniform(GLint uniform_handle, GLint value)
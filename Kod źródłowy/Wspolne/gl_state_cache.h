@@ -0,0 +1,327 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// GL state cache shared by the lessons, included with a path relative to the
+// lesson's main.cpp. The lesson defines the global instance.
+#ifndef WSPOLNE_GL_STATE_CACHE_H
+#define WSPOLNE_GL_STATE_CACHE_H
+
+#include <GL/glew.h>
+//******************************************************************************
+// Skips GL calls that would set state to the value it already has and counts
+// the calls that reached the driver.
+class GLStateCache
+{
+public:
+    GLStateCache()
+    {
+        invalidate();
+    }
+
+    void bindBuffer(GLenum target, GLuint buffer)
+    {
+        if (record(findBuffer(target), buffer))
+            glBindBuffer(target, buffer);
+    }
+
+    // Indexed bindings also replace the generic binding of the target. Only
+    // uniform buffer ranges are tracked, an equal range is skipped.
+    void bindBufferRange(GLenum target, GLuint index, GLuint buffer,
+                         GLintptr offset, GLsizeiptr size)
+    {
+        calls_count_++;
+
+        BufferRange *cached_range = findBufferRange(target, index);
+        if (cached_range &&
+            cached_range->buffer == static_cast<GLint>(buffer) &&
+            cached_range->offset == offset && cached_range->size == size)
+            return;
+
+        changes_count_++;
+        if (cached_range)
+            *cached_range = {static_cast<GLint>(buffer), offset, size};
+
+        GLint *cached = findBuffer(target);
+        if (cached)
+            *cached = buffer;
+
+        glBindBufferRange(target, index, buffer, offset, size);
+    }
+
+    void bindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        if (!record(findTexture(unit, target), texture))
+            return;
+
+        if (record(&active_texture_unit_, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+
+        glBindTexture(target, texture);
+    }
+
+    // Element array binding belongs to the vertex array object
+    void bindVertexArray(GLuint vertex_array)
+    {
+        if (record(&vertex_array_, vertex_array))
+        {
+            glBindVertexArray(vertex_array);
+            *findBuffer(GL_ELEMENT_ARRAY_BUFFER) = UNKNOWN;
+        }
+    }
+
+    void blendFunc(GLenum source_factor, GLenum destination_factor)
+    {
+        bool source_changed = record(&blend_source_, source_factor);
+        bool destination_changed = record(&blend_destination_,
+                                          destination_factor);
+        if (source_changed || destination_changed)
+            glBlendFunc(source_factor, destination_factor);
+    }
+
+    void colorMask(bool state)
+    {
+        if (record(&color_mask_, state))
+            glColorMask(state, state, state, state);
+    }
+
+    void cullFace(GLenum mode)
+    {
+        if (record(&cull_face_, mode))
+            glCullFace(mode);
+    }
+
+    // Names of deleted objects may be reused, so bindings to them are forgotten
+    void deleteBuffers(GLsizei count, const GLuint *buffers)
+    {
+        for (GLsizei i = 0; i < count; i++)
+        {
+            for (auto &buffer : buffers_)
+                if (buffer == static_cast<GLint>(buffers[i]))
+                    buffer = UNKNOWN;
+
+            for (auto &range : uniform_ranges_)
+                if (range.buffer == static_cast<GLint>(buffers[i]))
+                    range.buffer = UNKNOWN;
+        }
+
+        glDeleteBuffers(count, buffers);
+    }
+
+    void deleteTextures(GLsizei count, const GLuint *textures)
+    {
+        for (GLsizei i = 0; i < count; i++)
+            for (auto &unit : textures_)
+                for (auto &texture : unit)
+                    if (texture == static_cast<GLint>(textures[i]))
+                        texture = UNKNOWN;
+
+        glDeleteTextures(count, textures);
+    }
+
+    void deleteVertexArrays(GLsizei count, const GLuint *vertex_arrays)
+    {
+        for (GLsizei i = 0; i < count; i++)
+            if (vertex_array_ == static_cast<GLint>(vertex_arrays[i]))
+                vertex_array_ = UNKNOWN;
+
+        glDeleteVertexArrays(count, vertex_arrays);
+    }
+
+    void depthFunc(GLenum function)
+    {
+        if (record(&depth_func_, function))
+            glDepthFunc(function);
+    }
+
+    // Also masks glClear of the depth buffer
+    void depthMask(bool state)
+    {
+        if (record(&depth_mask_, state))
+            glDepthMask(state);
+    }
+
+    void enable(GLenum capability, bool state)
+    {
+        if (!record(findCapability(capability), state))
+            return;
+
+        if (state)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+
+    void frontFace(GLenum mode)
+    {
+        if (record(&front_face_, mode))
+            glFrontFace(mode);
+    }
+
+    unsigned int getCallsCount() const
+    {
+        return calls_count_;
+    }
+
+    unsigned int getChangesCount() const
+    {
+        return changes_count_;
+    }
+
+    // Forgets all cached values, the next call of each kind reaches the driver
+    void invalidate()
+    {
+        active_texture_unit_ = UNKNOWN;
+        blend_destination_ = UNKNOWN;
+        blend_source_ = UNKNOWN;
+        color_mask_ = UNKNOWN;
+        cull_face_ = UNKNOWN;
+        depth_func_ = UNKNOWN;
+        depth_mask_ = UNKNOWN;
+        front_face_ = UNKNOWN;
+        program_ = UNKNOWN;
+        vertex_array_ = UNKNOWN;
+
+        for (auto &capability : capabilities_)
+            capability = UNKNOWN;
+
+        for (auto &range : uniform_ranges_)
+            range.buffer = UNKNOWN;
+
+        invalidateBindings();
+    }
+
+    // For code that binds buffers and textures directly, like texture uploads.
+    // Uniform ranges are kept, generic binds do not replace indexed ones.
+    void invalidateBindings()
+    {
+        for (auto &buffer : buffers_)
+            buffer = UNKNOWN;
+
+        for (auto &unit : textures_)
+            for (auto &texture : unit)
+                texture = UNKNOWN;
+    }
+
+    void resetCounters()
+    {
+        calls_count_ = 0;
+        changes_count_ = 0;
+    }
+
+    void useProgram(GLuint program)
+    {
+        if (record(&program_, program))
+            glUseProgram(program);
+    }
+
+protected:
+    struct BufferRange
+    {
+        GLint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    GLint* findBuffer(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER:
+            return &buffers_[0];
+        case GL_ELEMENT_ARRAY_BUFFER:
+            return &buffers_[1];
+        case GL_PIXEL_UNPACK_BUFFER:
+            return &buffers_[2];
+        case GL_TEXTURE_BUFFER:
+            return &buffers_[3];
+        case GL_UNIFORM_BUFFER:
+            return &buffers_[4];
+        default:
+            return nullptr;
+        }
+    }
+
+    BufferRange* findBufferRange(GLenum target, GLuint index)
+    {
+        if (target != GL_UNIFORM_BUFFER || index >= MAX_UNIFORM_BINDINGS)
+            return nullptr;
+
+        return &uniform_ranges_[index];
+    }
+
+    GLint* findCapability(GLenum capability)
+    {
+        switch (capability)
+        {
+        case GL_BLEND:
+            return &capabilities_[0];
+        case GL_CULL_FACE:
+            return &capabilities_[1];
+        case GL_DEPTH_TEST:
+            return &capabilities_[2];
+        default:
+            return nullptr;
+        }
+    }
+
+    GLint* findTexture(GLuint unit, GLenum target)
+    {
+        if (unit >= MAX_TEXTURE_UNITS)
+            return nullptr;
+
+        switch (target)
+        {
+        case GL_TEXTURE_2D:
+            return &textures_[unit][0];
+        case GL_TEXTURE_2D_ARRAY:
+            return &textures_[unit][1];
+        case GL_TEXTURE_BUFFER:
+            return &textures_[unit][2];
+        case GL_TEXTURE_CUBE_MAP:
+            return &textures_[unit][3];
+        default:
+            return nullptr;
+        }
+    }
+
+    // Untracked state (no cached value) always reaches the driver
+    bool record(GLint *cached, GLint value)
+    {
+        calls_count_++;
+        if (cached && *cached == value)
+            return false;
+
+        changes_count_++;
+        if (cached)
+            *cached = value;
+
+        return true;
+    }
+
+    static const GLint UNKNOWN = -1;
+    static const unsigned int MAX_TEXTURE_UNITS = 16;
+    static const unsigned int MAX_UNIFORM_BINDINGS = 16;
+
+protected:
+    GLint active_texture_unit_{UNKNOWN};
+    GLint blend_destination_{UNKNOWN};
+    GLint blend_source_{UNKNOWN};
+    GLint buffers_[5];
+    GLint capabilities_[3];
+    GLint color_mask_{UNKNOWN};
+    GLint cull_face_{UNKNOWN};
+    GLint depth_func_{UNKNOWN};
+    GLint depth_mask_{UNKNOWN};
+    GLint front_face_{UNKNOWN};
+    GLint program_{UNKNOWN};
+    GLint textures_[MAX_TEXTURE_UNITS][4];
+    GLint vertex_array_{UNKNOWN};
+    BufferRange uniform_ranges_[MAX_UNIFORM_BINDINGS];
+    unsigned int calls_count_{0};
+    unsigned int changes_count_{0};
+
+};
+
+#endif
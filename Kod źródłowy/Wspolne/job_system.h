@@ -0,0 +1,279 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Job system shared by the lessons, included with a path relative to the
+// lesson's main.cpp
+#ifndef WSPOLNE_JOB_SYSTEM_H
+#define WSPOLNE_JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+//******************************************************************************
+// Work stealing scheduler, every thread owns a deque: the owner takes the
+// newest task from the back, idle threads steal the oldest from the front.
+// Deque 0 belongs to the threads outside of the pool, usually the GL thread.
+class JobSystem
+{
+public:
+    struct JobState;
+    typedef std::shared_ptr<JobState> Job;
+
+    // Finished when all of its tasks have run, dependents are queued then
+    struct JobState
+    {
+        std::atomic<int> dependencies{1};
+        std::atomic<bool> finished{false};
+        std::atomic<int> unfinished{0};
+        std::vector<Job> dependents;
+        std::mutex mutex;
+        std::vector<std::function<void()>> tasks;
+    };
+
+    explicit JobSystem(unsigned int threads_count) :
+        queues_(std::max(threads_count, 1u))
+    {
+        for (unsigned int i = 1; i < queues_.size(); i++)
+            workers_.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+
+        for (auto &worker : workers_)
+            worker.join();
+    }
+
+    unsigned int getThreadsCount() const
+    {
+        return static_cast<unsigned int>(queues_.size());
+    }
+
+    // Calls function(first, last) for chunks of at most grain items, the
+    // chunks are spread over the pool by stealing
+    Job parallelFor(int begin, int end, int grain,
+                    std::function<void(int, int)> function,
+                    std::vector<Job> dependencies = {})
+    {
+        grain = std::max(grain, 1);
+
+        Job job = std::make_shared<JobState>();
+        for (int first = begin; first < end; first += grain)
+        {
+            int last = std::min(first + grain, end);
+            job->tasks.push_back([function, first, last]
+            {
+                function(first, last);
+            });
+        }
+
+        return schedule(job, dependencies);
+    }
+
+    // Single task, started once all dependencies have finished
+    Job submit(std::function<void()> function,
+               std::vector<Job> dependencies = {})
+    {
+        Job job = std::make_shared<JobState>();
+        job->tasks.push_back(function);
+
+        return schedule(job, dependencies);
+    }
+
+    // Waiting thread runs queued tasks instead of blocking
+    void wait(const Job &job)
+    {
+        unsigned int index = getQueueIndex();
+
+        while (!job->finished)
+        {
+            Task task;
+            if (popTask(index, task))
+                runTask(task);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+protected:
+    struct Task
+    {
+        std::function<void()> function;
+        Job job;
+    };
+
+    struct TaskQueue
+    {
+        std::deque<Task> tasks;
+        std::mutex mutex;
+    };
+
+    void finishJob(const Job &job)
+    {
+        std::vector<Job> dependents;
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->finished = true;
+            dependents.swap(job->dependents);
+        }
+
+        for (auto &dependent : dependents)
+            if (--dependent->dependencies == 0)
+                pushTasks(dependent);
+    }
+
+    unsigned int getQueueIndex() const
+    {
+        const Worker &worker = getWorker();
+        return worker.system == this ? worker.index : 0;
+    }
+
+    // Own deque first, newest task, then the oldest task of the others
+    bool popTask(unsigned int index, Task &task)
+    {
+        {
+            TaskQueue &queue = queues_[index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty())
+            {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+                queued_tasks_--;
+                return true;
+            }
+        }
+
+        for (std::size_t i = 1; i < queues_.size(); i++)
+        {
+            TaskQueue &queue = queues_[(index + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty())
+            {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                queued_tasks_--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void pushTasks(const Job &job)
+    {
+        std::vector<std::function<void()>> tasks;
+        tasks.swap(job->tasks);
+
+        if (tasks.empty())
+        {
+            finishJob(job);
+            return;
+        }
+
+        job->unfinished = static_cast<int>(tasks.size());
+
+        TaskQueue &queue = queues_[getQueueIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            for (auto &function : tasks)
+                queue.tasks.push_back(Task{std::move(function), job});
+        }
+
+        // Counter changes under the sleep lock so no wake up gets lost
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            queued_tasks_ += static_cast<int>(tasks.size());
+        }
+
+        if (tasks.size() == 1)
+            wake_.notify_one();
+        else
+            wake_.notify_all();
+    }
+
+    void runTask(Task &task)
+    {
+        task.function();
+
+        if (--task.job->unfinished == 0)
+            finishJob(task.job);
+    }
+
+    // Job is queued when the last of its dependencies finishes
+    Job schedule(const Job &job, const std::vector<Job> &dependencies)
+    {
+        for (const auto &dependency : dependencies)
+        {
+            std::lock_guard<std::mutex> lock(dependency->mutex);
+            if (dependency->finished)
+                continue;
+
+            job->dependencies++;
+            dependency->dependents.push_back(job);
+        }
+
+        if (--job->dependencies == 0)
+            pushTasks(job);
+
+        return job;
+    }
+
+    void workerLoop(unsigned int index)
+    {
+        getWorker().system = this;
+        getWorker().index = index;
+
+        while (true)
+        {
+            Task task;
+            if (popTask(index, task))
+            {
+                runTask(task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            wake_.wait(lock, [this] { return stop_ || queued_tasks_ > 0; });
+            if (stop_)
+                return;
+        }
+    }
+
+    // Pool and deque of the calling thread, a function local keeps the
+    // header usable from more than one translation unit
+    struct Worker
+    {
+        const JobSystem *system = nullptr;
+        unsigned int index = 0;
+    };
+
+    static Worker &getWorker()
+    {
+        static thread_local Worker worker;
+        return worker;
+    }
+
+protected:
+    bool stop_{false};
+    std::atomic<int> queued_tasks_{0};
+    std::vector<TaskQueue> queues_;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    std::vector<std::thread> workers_;
+
+};
+
+#endif
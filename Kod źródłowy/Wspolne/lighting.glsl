@@ -0,0 +1,177 @@
+// Wspolny kod oswietlenia Phonga dla lekcji 15, 17, 19, 21 i 26.
+//
+// Plik jest dolaczany dyrektywa #include przez shadery fragmentow lekcji.
+// Opcjonalne elementy (mgla, reflektor, mapa odbic, odbicie i refrakcja
+// otoczenia, odrzucanie fragmentow) sa kompilowane tylko wtedy, gdy program
+// zdefiniuje odpowiednie makro FEATURE_* - kazda kombinacja to osobna
+// permutacja shadera, wiec w shaderze nie ma rozgalezien zaleznych od
+// uniformow. Stale mozna nadpisac definiujac makro przed #include.
+//
+// Shader dolaczajacy musi zadeklarowac: vertex_to_camera, normal_to_camera
+// oraz texture_coordinates.
+
+// Wartosci stale dla calej klatki, liczone raz na CPU (uklad std140).
+// Skalarne operacje ALU na piksel (NIR, Mesa llvmpipe) - liczenie tych
+// wartosci w shaderze / z blokiem Lighting:
+//   15_Phong 73 / 64, 17_Mgla 84 / 78, 19_Wspolczynniki_odbicia 88 / 76,
+//   21_Reflektor 120 / 92, 26 Odbicie 263 / 118, 26 Refrakcja 206 / 79
+layout(std140) uniform Lighting
+{
+   vec4 light_position_view;   // xyz - pozycja swiatla w ukladzie kamery
+   vec4 spot_position_view;    // xyz - pozycja reflektora w ukladzie kamery
+   vec4 spot_direction_view;   // xyz - znormalizowany kierunek reflektora
+   vec4 spot_cone;             // x - cosinus granicy stozka, y - 1 / (1 - x)
+   mat4 inverse_view_matrix;
+};
+
+#ifndef AMBIENT_COLOUR
+#define AMBIENT_COLOUR vec3(0.1, 0.1, 0.1)
+#endif
+#ifndef DIFFUSE_COLOUR
+#define DIFFUSE_COLOUR vec3(0.7, 0.7, 0.7)
+#endif
+#ifndef SPECULAR_COLOUR
+#define SPECULAR_COLOUR vec3(1.0, 1.0, 1.0)
+#endif
+#ifndef SPECULAR_POWER
+#define SPECULAR_POWER 10.0
+#endif
+
+#ifndef OBJECT_AMBIENT_FACTOR
+#define OBJECT_AMBIENT_FACTOR vec3(1.0, 1.0, 1.0)
+#endif
+#ifndef OBJECT_DIFFUSE_FACTOR
+#define OBJECT_DIFFUSE_FACTOR vec3(0.5, 0.5, 0.5)
+#endif
+#ifndef OBJECT_SPECULAR_FACTOR
+#define OBJECT_SPECULAR_FACTOR vec3(1.0, 1.0, 1.0)
+#endif
+
+vec3 phongIntensity(vec3 ambient_factor, vec3 diffuse_factor,
+                    vec3 specular_factor)
+{
+   // Ambient
+   vec3 ambient_intense = AMBIENT_COLOUR * ambient_factor;
+
+   // Diffuse
+   vec3 distance_to_light = light_position_view.xyz - vertex_to_camera;
+   vec3 light_direction = normalize(distance_to_light);
+   float dot_product = max(dot(light_direction, normal_to_camera), 0.0);
+   vec3 diffuse_intense = DIFFUSE_COLOUR * diffuse_factor * dot_product;
+
+   // Specular
+   vec3 reflection = reflect(-light_direction, normal_to_camera);
+   vec3 surface_to_camera = normalize(-vertex_to_camera);
+   float dot_specular = max(dot(reflection, surface_to_camera), 0.0);
+   float specular_intensity = pow(dot_specular, SPECULAR_POWER);
+   vec3 specular_intense = SPECULAR_COLOUR * specular_factor * specular_intensity;
+
+   return ambient_intense + diffuse_intense + specular_intense;
+}
+
+#ifdef FEATURE_SPOT
+#ifndef SPOT_COLOUR
+#define SPOT_COLOUR vec3(0.7, 0.7, 0.7)
+#endif
+
+vec3 spotIntensity()
+{
+   vec3 direction_from_spot_camera = normalize(vertex_to_camera - spot_position_view.xyz);
+
+   float spot_dot = dot(spot_direction_view.xyz, direction_from_spot_camera);
+   float spot_factor = clamp((spot_dot - spot_cone.x) * spot_cone.y, 0.0, 1.0);
+
+   return spot_factor * SPOT_COLOUR;
+}
+#endif
+
+#ifdef FEATURE_FOG
+#ifndef FOG_COLOUR
+#define FOG_COLOUR vec3(0.5, 0.5, 0.5)
+#endif
+#ifndef MIN_FOG_DISTANCE
+#define MIN_FOG_DISTANCE 5.0
+#endif
+#ifndef MAX_FOG_DISTANCE
+#define MAX_FOG_DISTANCE 80.0
+#endif
+
+vec3 applyFog(vec3 colour)
+{
+   float distance = length(vertex_to_camera);
+   float fog_factor = (distance - MIN_FOG_DISTANCE) / (MAX_FOG_DISTANCE - MIN_FOG_DISTANCE);
+
+   return mix(colour, FOG_COLOUR, clamp(fog_factor, 0.0, 1.0));
+}
+#endif
+
+#ifdef FEATURE_SPECULAR_MAP
+uniform sampler2D specular_texture;
+#endif
+
+#if defined(FEATURE_REFLECTION) || defined(FEATURE_REFRACTION)
+#ifndef ENV_MAP_MIX
+#define ENV_MAP_MIX 0.6
+#endif
+#ifndef REFRACTION_RATIO
+#define REFRACTION_RATIO (1.0 / 1.49)
+#endif
+
+uniform samplerCube env_map;
+
+vec4 environmentColour()
+{
+   vec3 camera_vector = normalize(vertex_to_camera);
+   vec3 normal_vector = normalize(normal_to_camera);
+
+#ifdef FEATURE_REFRACTION
+   vec3 env_vector = refract(camera_vector, normal_vector, REFRACTION_RATIO);
+#else
+   vec3 env_vector = reflect(camera_vector, normal_vector);
+#endif
+   env_vector = mat3(inverse_view_matrix) * env_vector;
+   env_vector.yz = -env_vector.yz;
+
+   return texture(env_map, env_vector);
+}
+#endif
+
+#ifndef ALPHA_TEST_THRESHOLD
+#define ALPHA_TEST_THRESHOLD 0.6
+#endif
+
+vec4 shadeFragment(vec4 texel)
+{
+#ifdef FEATURE_ALPHA_TEST
+   if (texel.a < ALPHA_TEST_THRESHOLD)
+      discard;
+#endif
+
+   // Skladowa alfa jak w pierwotnych shaderach lekcji: swiatlo ma w = 1,
+   // wiec z reflektorem (lekcja 21) alfa wynosi 2 * texel.a
+#ifdef FEATURE_SPECULAR_MAP
+   // Wspolczynniki Ka i Kd z tekstury, Ks z mapy odbic
+   vec3 specular_sample = texture(specular_texture, texture_coordinates).rgb;
+   vec4 colour = vec4(phongIntensity(texel.rgb, texel.rgb, specular_sample), 1.0);
+#elif defined(FEATURE_REFRACTION)
+   // Obiekt przezroczysty - swiatlo Phonga nie jest uwzgledniane
+   vec4 colour = mix(environmentColour(), texel, ENV_MAP_MIX);
+#else
+   vec4 light = vec4(phongIntensity(OBJECT_AMBIENT_FACTOR, OBJECT_DIFFUSE_FACTOR,
+                                    OBJECT_SPECULAR_FACTOR), 1.0);
+#ifdef FEATURE_SPOT
+   light += vec4(spotIntensity(), 1.0);
+#endif
+#ifdef FEATURE_REFLECTION
+   vec4 colour = light * mix(environmentColour(), texel, ENV_MAP_MIX);
+#else
+   vec4 colour = light * texel;
+#endif
+#endif
+
+#ifdef FEATURE_FOG
+   colour.rgb = applyFog(colour.rgb);
+#endif
+
+   return colour;
+}
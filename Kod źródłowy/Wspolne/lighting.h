@@ -0,0 +1,251 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Strona CPU wspolnego oswietlenia z Wspolne/lighting.glsl dla lekcji 15, 17,
+// 19, 21 i 26: blok Lighting oraz wczytywanie permutacji shadera. Lekcja
+// dolacza GLEW i GLM przed tym plikiem i sama wypelnia blok raz na klatke.
+#ifndef WSPOLNE_LIGHTING_H
+#define WSPOLNE_LIGHTING_H
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+//******************************************************************************
+// Blok Lighting z Wspolne/lighting.glsl, uklad std140
+struct LightingBlock
+{
+    glm::vec4 light_position_view{0.0f};
+    glm::vec4 spot_position_view{0.0f};
+    glm::vec4 spot_direction_view{0.0f};
+    glm::vec4 spot_cone{0.0f};
+    glm::mat4 inverse_view_matrix{1.0f};
+};
+
+const GLuint LIGHTING_BINDING = 0;
+
+// Funkcje shadera oswietlenia wlaczane przy kompilacji (Wspolne/lighting.glsl)
+enum ShaderFeature
+{
+    SHADER_FEATURE_FOG = 1 << 0,
+    SHADER_FEATURE_SPOT = 1 << 1,
+    SHADER_FEATURE_SPECULAR_MAP = 1 << 2,
+    SHADER_FEATURE_REFLECTION = 1 << 3,
+    SHADER_FEATURE_REFRACTION = 1 << 4,
+    SHADER_FEATURE_ALPHA_TEST = 1 << 5,
+    SHADER_FEATURES_COUNT = 6
+};
+
+const char* const shader_feature_names[SHADER_FEATURES_COUNT] = {
+    "FEATURE_FOG",
+    "FEATURE_SPOT",
+    "FEATURE_SPECULAR_MAP",
+    "FEATURE_REFLECTION",
+    "FEATURE_REFRACTION",
+    "FEATURE_ALPHA_TEST",
+};
+//******************************************************************************
+inline std::string GetFileDirectory(std::string file_name)
+{
+    size_t separator = file_name.find_last_of("/\\");
+    if (separator == std::string::npos)
+        return "";
+
+    return file_name.substr(0, separator + 1);
+}
+//******************************************************************************
+// Wczytanie kodu shadera z rozwinieciem dyrektyw #include "plik". Sciezka
+// dolaczanego pliku jest wzgledna wobec pliku, ktory go dolacza.
+inline int PreprocessShader(std::string file_name, std::string& shader_code,
+                            int include_depth = 0)
+{
+    const int max_include_depth = 16;
+    if (include_depth > max_include_depth)
+    {
+        std::cout << "Too deep #include nesting in \"" << file_name << "\"."
+                  << std::endl;
+        return -1;
+    }
+
+    std::ifstream shader_file(file_name.c_str(), std::ios::in);
+    if (!shader_file.is_open())
+    {
+        std::cout << "Error opening shader file \"" << file_name << "\"."
+                  << std::endl;
+        return -1;
+    }
+
+    std::string line;
+    while (std::getline(shader_file, line))
+    {
+        size_t directive = line.find_first_not_of(" \t");
+        if (directive == std::string::npos ||
+            line.compare(directive, 8, "#include") != 0)
+        {
+            shader_code += line + "\n";
+            continue;
+        }
+
+        size_t first_quote = line.find('"', directive);
+        size_t last_quote = line.rfind('"');
+        if (first_quote == std::string::npos || first_quote == last_quote)
+        {
+            std::cout << "Invalid #include in \"" << file_name << "\": " << line
+                      << std::endl;
+            return -1;
+        }
+
+        std::string include_file = GetFileDirectory(file_name) +
+            line.substr(first_quote + 1, last_quote - first_quote - 1);
+        if (PreprocessShader(include_file, shader_code, include_depth + 1))
+            return -1;
+    }
+
+    return 0;
+}
+//******************************************************************************
+// Wstawienie definicji FEATURE_* zaraz po dyrektywie #version, ktora musi
+// pozostac pierwsza linia shadera.
+inline void InsertFeatureDefines(std::string& shader_code,
+                                 unsigned int features)
+{
+    std::string defines;
+    for (unsigned int i = 0; i < SHADER_FEATURES_COUNT; i++)
+    {
+        if (features & (1u << i))
+            defines += std::string("#define ") + shader_feature_names[i] + "\n";
+    }
+
+    size_t position = 0;
+    if (shader_code.compare(0, 8, "#version") == 0)
+    {
+        position = shader_code.find('\n');
+        position = (position == std::string::npos) ? shader_code.size() :
+                                                     position + 1;
+    }
+
+    shader_code.insert(position, defines);
+}
+//******************************************************************************
+// Zwraca 0, gdy pliku nie udalo sie wczytac lub skompilowac
+inline GLuint CompileShader(GLenum type, std::string file_name,
+                            unsigned int features)
+{
+    std::string shader_data;
+    if (PreprocessShader(file_name, shader_data))
+        return 0;
+
+    InsertFeatureDefines(shader_data, features);
+
+    GLuint shader_id = glCreateShader(type);
+    const char* shader_ptr = shader_data.c_str();
+    glShaderSource(shader_id, 1, &shader_ptr, NULL);
+    glCompileShader(shader_id);
+
+    GLint status = GL_FALSE;
+    glGetShaderiv(shader_id, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE)
+    {
+        char log_text[2048];
+        glGetShaderInfoLog(shader_id, sizeof(log_text), NULL, log_text);
+        std::cout << "Shader \"" << file_name << "\" compile error:" << std::endl
+                  << log_text << std::endl;
+
+        glDeleteShader(shader_id);
+        return 0;
+    }
+
+    return shader_id;
+}
+//******************************************************************************
+// Zwraca 0, gdy ktorys z shaderow lub konsolidacja programu zawiodly
+inline GLuint LoadShaders(std::string vertex_shader,
+                          std::string fragment_shader, unsigned int features)
+{
+    GLuint vertex_shader_id = CompileShader(GL_VERTEX_SHADER, vertex_shader,
+                                            features);
+    GLuint fragment_shader_id = CompileShader(GL_FRAGMENT_SHADER,
+                                              fragment_shader, features);
+    if (!vertex_shader_id || !fragment_shader_id)
+    {
+        glDeleteShader(vertex_shader_id);
+        glDeleteShader(fragment_shader_id);
+        return 0;
+    }
+
+    GLuint shader_programme = glCreateProgram();
+    glAttachShader(shader_programme, vertex_shader_id);
+    glAttachShader(shader_programme, fragment_shader_id);
+    glLinkProgram(shader_programme);
+
+    glDeleteShader(vertex_shader_id);
+    glDeleteShader(fragment_shader_id);
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(shader_programme, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE)
+    {
+        char log_text[2048];
+        glGetProgramInfoLog(shader_programme, sizeof(log_text), NULL,
+                            log_text);
+        std::cout << "Shader program link error:" << std::endl << log_text
+                  << std::endl;
+
+        glDeleteProgram(shader_programme);
+        return 0;
+    }
+
+    return shader_programme;
+}
+//******************************************************************************
+inline void BindLightingBlock(GLuint shader_program)
+{
+    GLuint block_index = glGetUniformBlockIndex(shader_program, "Lighting");
+    if (block_index == GL_INVALID_INDEX)
+    {
+        std::cout << "Uniform block \"Lighting\" not found." << std::endl;
+        return;
+    }
+
+    glUniformBlockBinding(shader_program, block_index, LIGHTING_BINDING);
+}
+//******************************************************************************
+inline GLuint CreateLightingBuffer()
+{
+    GLuint lighting_buffer = 0;
+    glGenBuffers(1, &lighting_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, lighting_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(LightingBlock), NULL,
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, LIGHTING_BINDING, lighting_buffer);
+
+    return lighting_buffer;
+}
+//******************************************************************************
+// Permutacje sa kompilowane tylko raz - kolejne zapytania o ten sam zestaw
+// funkcji zwracaja program z pamieci podrecznej. Zwraca 0 przy bledzie.
+inline GLuint GetShaderPermutation(unsigned int features)
+{
+    static std::map<unsigned int, GLuint> shader_permutations;
+
+    std::map<unsigned int, GLuint>::iterator it =
+        shader_permutations.find(features);
+    if (it != shader_permutations.end())
+        return it->second;
+
+    GLuint shader_programme = LoadShaders("vertex_shader.glsl",
+                                          "fragment_shader.glsl", features);
+    if (!shader_programme)
+        return 0;
+
+    BindLightingBlock(shader_programme);
+    shader_permutations[features] = shader_programme;
+
+    return shader_programme;
+}
+
+#endif
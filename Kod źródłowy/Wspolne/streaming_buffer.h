@@ -0,0 +1,210 @@
+//******************************************************************************
+// Kurs OpenGL - krok po kroku
+// http://kurs-opengl.pl
+// Sebastian Tabaka
+//******************************************************************************
+// Streaming buffer shared by the lessons, included with a path relative to the
+// lesson's main.cpp
+#ifndef WSPOLNE_STREAMING_BUFFER_H
+#define WSPOLNE_STREAMING_BUFFER_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "gl_state_cache.h"
+//******************************************************************************
+// Per frame vertex and uniform data, suballocated from one buffer split into
+// three frame regions. A fence per region keeps the CPU from overwriting data
+// the GPU has not read yet. Persistently mapped with ARB_buffer_storage,
+// otherwise written through unsynchronised map ranges.
+class StreamingBuffer
+{
+public:
+    // Lessons drawing through a GLStateCache pass it, so that bindings to
+    // retired buffers are forgotten
+    StreamingBuffer(GLsizeiptr frame_size, GLStateCache *state_cache = nullptr)
+    {
+        state_cache_ = state_cache;
+        createBuffer(frame_size);
+    }
+
+    ~StreamingBuffer()
+    {
+        deleteFences();
+        retired_buffers_.push_back(buffer_);
+        deleteRetiredBuffers();
+    }
+
+    // Once per frame before any upload, waits only when the GPU is three
+    // frames behind
+    void beginFrame()
+    {
+        deleteRetiredBuffers();
+
+        if (fences_[frame_region_])
+            glDeleteSync(fences_[frame_region_]);
+        fences_[frame_region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        used_size_ = head_ - frame_region_ * frame_size_;
+        frame_region_ = (frame_region_ + 1) % REGIONS_COUNT;
+        head_ = frame_region_ * frame_size_;
+
+        wait_time_ = 0.0;
+        if (!fences_[frame_region_])
+            return;
+
+        auto wait_start = std::chrono::steady_clock::now();
+        GLenum result = glClientWaitSync(fences_[frame_region_], 0, 0);
+        while (result == GL_TIMEOUT_EXPIRED)
+            result = glClientWaitSync(fences_[frame_region_],
+                                      GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        wait_time_ = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - wait_start).count();
+
+        glDeleteSync(fences_[frame_region_]);
+        fences_[frame_region_] = 0;
+    }
+
+    // Offset of the copy in getBuffer(). A full frame region replaces the
+    // buffer with a larger one, so the handle is read after each upload. The
+    // old one lives until the next frame.
+    GLintptr upload(const void *data, GLsizeiptr size, GLsizeiptr alignment)
+    {
+        GLintptr offset = (head_ + alignment - 1) / alignment * alignment;
+        if (size == 0)
+            return offset;
+
+        if (offset + size > (frame_region_ + 1) * frame_size_)
+        {
+            deleteFences();
+            retired_buffers_.push_back(buffer_);
+            createBuffer(std::max(frame_size_ * 2, size + alignment));
+
+            offset = 0;
+        }
+
+        if (mapped_ptr_)
+        {
+            std::memcpy(mapped_ptr_ + offset, data, size);
+        }
+        else
+        {
+            // Fence of the region already guarantees the range is free, the
+            // driver need not
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+            void *range_ptr = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset,
+                                               size, GL_MAP_WRITE_BIT |
+                                               GL_MAP_UNSYNCHRONIZED_BIT |
+                                               GL_MAP_INVALIDATE_RANGE_BIT);
+            std::memcpy(range_ptr, data, size);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+
+        head_ = offset + size;
+        return offset;
+    }
+
+    GLuint getBuffer() const
+    {
+        return buffer_;
+    }
+
+    GLsizeiptr getFrameSize() const
+    {
+        return frame_size_;
+    }
+
+    // Bytes uploaded in the previous frame
+    GLsizeiptr getUsedSize() const
+    {
+        return used_size_;
+    }
+
+    // Milliseconds the last beginFrame waited for the GPU
+    double getWaitTime() const
+    {
+        return wait_time_;
+    }
+
+    bool isPersistent() const
+    {
+        return mapped_ptr_ != nullptr;
+    }
+
+protected:
+    void createBuffer(GLsizeiptr frame_size)
+    {
+        frame_size_ = frame_size;
+        frame_region_ = 0;
+        head_ = 0;
+
+        mapped_ptr_ = nullptr;
+
+        glGenBuffers(1, &buffer_);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+        if (GLEW_ARB_buffer_storage)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+                               GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, frame_size_ * REGIONS_COUNT,
+                            nullptr, flags);
+            mapped_ptr_ = static_cast<GLubyte*>(glMapBufferRange(
+                GL_COPY_WRITE_BUFFER, 0, frame_size_ * REGIONS_COUNT, flags));
+        }
+        else
+        {
+            glBufferData(GL_COPY_WRITE_BUFFER, frame_size_ * REGIONS_COUNT,
+                         nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    void deleteFences()
+    {
+        for (auto &fence : fences_)
+        {
+            if (fence)
+                glDeleteSync(fence);
+            fence = 0;
+        }
+    }
+
+    // Deleted buffers are released by the driver once the GPU is done with
+    // them
+    void deleteRetiredBuffers()
+    {
+        if (retired_buffers_.empty())
+            return;
+
+        GLsizei count = static_cast<GLsizei>(retired_buffers_.size());
+        if (state_cache_)
+            state_cache_->deleteBuffers(count, retired_buffers_.data());
+        else
+            glDeleteBuffers(count, retired_buffers_.data());
+
+        retired_buffers_.clear();
+    }
+
+protected:
+    static const unsigned int REGIONS_COUNT = 3;
+
+protected:
+    double wait_time_{0.0};
+    GLintptr head_{0};
+    GLsizeiptr frame_size_{0};
+    GLsizeiptr used_size_{0};
+    GLStateCache *state_cache_{nullptr};
+    GLsync fences_[REGIONS_COUNT] = {0, 0, 0};
+    GLubyte *mapped_ptr_{nullptr};
+    GLuint buffer_{0};
+    std::vector<GLuint> retired_buffers_;
+    unsigned int frame_region_{0};
+
+};
+
+#endif